@@ -0,0 +1,82 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    微基准测试的公共工具函数
+    - 默认打印便于阅读的表格，加上 --json 参数时每项结果输出一行 JSON（JSON Lines），
+      可以重定向到文件，在不同提交之间直接 diff 或者用脚本对比；
+      此时被测代码自己打印到标准输出的内容（例如线程池创建线程的提示）改为输出到标准错误，不会混进 JSON
+    - 分配次数由 bench_alloc.cpp 替换全局 operator new 统计，所有线程共享一个计数器
+*/
+
+// 是否输出 JSON，当前基准测试程序的名称（JSON 中的 suite 字段），以及 JSON 输出到的原来的标准输出
+inline bool bench_json = false;
+inline const char* bench_suite = "";
+inline FILE* bench_out = NULL;
+
+// 解析命令行参数，param_name 是表格中参数一列的名称
+inline void benchInit(int argc, char* argv[], const char* suite, const char* param_name) {
+    bench_suite = suite;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            bench_json = true;
+        }
+    }
+    if (bench_json) {
+        fflush(stdout);
+        bench_out = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        setvbuf(bench_out, NULL, _IOLBF, 0);
+    }
+    else {
+        printf("%-32s %10s %15s %17s %14s\n", "benchmark", param_name, "latency", "throughput", "allocs");
+    }
+}
+
+// 获取单调时钟的当前时间（纳秒）
+inline long long benchNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 程序启动以来调用 operator new 的次数，在 bench_alloc.cpp 中实现
+long long benchAllocs();
+
+// 防止编译器把基准测试中没有使用结果的计算优化掉
+template<typename T>
+inline void benchKeep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 打印一项测试结果：名称、参数、每次操作的耗时、吞吐量和平均分配次数
+inline void benchReport(const char* name, long long param, long long ops, long long elapsed_ns, long long allocs) {
+    double ns_per_op = ops > 0 ? (double)elapsed_ns / ops : 0;
+    double ops_per_sec = elapsed_ns > 0 ? ops * 1e9 / elapsed_ns : 0;
+    double allocs_per_op = ops > 0 ? (double)allocs / ops : 0;
+    if (bench_json) {
+        fprintf(bench_out, "{\"suite\":\"%s\",\"name\":\"%s\",\"param\":%lld,\"ops\":%lld,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f,\"allocs_per_op\":%.2f}\n",
+               bench_suite, name, param, ops, ns_per_op, ops_per_sec, allocs_per_op);
+    }
+    else {
+        printf("%-32s %10lld %12.1f ns/op %14.0f ops/s %8.2f a/op\n", name, param, ns_per_op, ops_per_sec, allocs_per_op);
+    }
+}
+
+// 打印一项测试的延迟分位数（纳秒）
+inline void benchLatency(const char* name, long long param, long long p50_ns, long long p99_ns) {
+    if (bench_json) {
+        fprintf(bench_out, "{\"suite\":\"%s\",\"name\":\"%s\",\"param\":%lld,\"p50_ns\":%lld,\"p99_ns\":%lld}\n",
+               bench_suite, name, param, p50_ns, p99_ns);
+    }
+    else {
+        printf("%-32s %10lld %12lld ns p50 %12lld ns p99\n", "", param, p50_ns, p99_ns);
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "bench.h"
+
+/*
+    替换全局的 operator new / delete，统计分配次数
+    - 只统计次数不统计字节数，计数器使用 relaxed 原子操作，对被测代码的开销只有一次原子加
+    - 链接到每个基准测试程序中，基准测试在测试前后读取 benchAllocs() 相减得到分配次数
+*/
+
+static std::atomic<long long> alloc_count(0);
+
+long long benchAllocs() {
+    return alloc_count.load(std::memory_order_relaxed);
+}
+
+static void* countedAlloc(size_t size) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+// 按缓存行对齐的类型（例如无锁队列的槽位）走对齐版本
+void* operator new(size_t size, std::align_val_t align) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, (size_t)align, size ? size : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string>
+#include "bench.h"
+#include "../include/http_connection.h"
+
+/*
+    HTTP 请求处理微基准测试：不经过网络，直接调用 io_uring 后端使用的 HttpConnection 接口
+    - appendInput() 放入一批流水线请求，prepareResponses() 解析请求（processRead() / parseLineData()）并生成响应，
+      按照 nextSend() 返回的数据块推进发送队列，finishWrite() 归还发送队列，和 io_uring 后端处理一批请求的流程一致
+    - 200 / 304 / 206: 命中文件缓存，耗时是请求解析加上 addResponse() 拼接响应头，三者对比可以看出不同响应头的开销
+    - 404: 文件不存在，响应是预先生成的完整报文，但不存在的文件不会进入文件缓存，每个请求都要 stat() 一次
+    - 请求头使用浏览器的典型请求头，参数是一批流水线请求的数量
+*/
+
+#define REQUESTS_PER_CASE 200000
+
+static const char* headers =
+    "Host: 127.0.0.1:9090\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cache-Control: max-age=0\r\n";
+
+struct BenchCase {
+    const char* name;
+    const char* url;
+    const char* extra;      // 额外的请求头
+    const char* status;     // 期望的响应状态行
+};
+
+static const BenchCase cases[] = {
+    { "parse + 404", "/missing.html", "", "HTTP/1.1 404" },
+    { "parse + 200 file", "/szu.html", "", "HTTP/1.1 200" },
+    { "parse + 304 If-None-Match", "/szu.html", "If-None-Match: *\r\n", "HTTP/1.1 304" },
+    { "parse + 206 Range", "/szu.html", "Range: bytes=0-99\r\n", "HTTP/1.1 206" },
+};
+
+// 把发送队列中的数据全部当作已经发送，first 不为空时返回第一个内存块的内容用于检查响应
+static void drain(HttpConnection* conn, std::string* first) {
+    while (conn->hasPendingOutput()) {
+        int fd = -1;
+        off_t offset = 0;
+        off_t count = 0;
+        const struct msghdr* msg = conn->nextSend(&fd, &offset, &count);
+        off_t bytes = 0;
+        if (msg != NULL) {
+            for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+                if ((first != NULL) && first->empty()) {
+                    first->assign((const char*)msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+                }
+                bytes += msg->msg_iov[i].iov_len;
+            }
+        }
+        if (fd != -1) {
+            bytes += count;
+        }
+        conn->consumeChunks(bytes);
+    }
+}
+
+static void benchCase(const BenchCase& c, int pipeline) {
+    std::string request = std::string("GET ") + c.url + " HTTP/1.1\r\n" + headers + c.extra + "\r\n";
+    std::string batch;
+    for (int i = 0; i < pipeline; ++i) {
+        batch += request;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    HttpConnection* conn = new HttpConnection;
+    conn->init(fds[0], addr, -1);
+
+    // 预热一批，同时检查响应是否符合预期（文件第一次请求时加入缓存）
+    conn->appendInput(batch.data(), (int)batch.size());
+    conn->prepareResponses();
+    std::string first;
+    drain(conn, &first);
+    conn->finishWrite();
+    if (first.compare(0, strlen(c.status), c.status) != 0) {
+        printf("%s: unexpected response %.*s\n", c.name, (int)first.find('\r'), first.c_str());
+        exit(1);
+    }
+
+    int rounds = REQUESTS_PER_CASE / pipeline;
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    for (int round = 0; round < rounds; ++round) {
+        conn->appendInput(batch.data(), (int)batch.size());
+        do {
+            conn->prepareResponses();
+            drain(conn, NULL);
+            conn->finishWrite();
+        } while (conn->hasBufferedRequest());
+    }
+    long long elapsed = benchNowNs() - start;
+    benchReport(c.name, pipeline, (long long)rounds * pipeline, elapsed, benchAllocs() - allocs);
+
+    conn->closeConnection();
+    delete conn;
+    close(fds[1]);
+}
+
+int main(int argc, char* argv[]) {
+    int pipelines[] = { 1, 16 };
+    benchInit(argc, argv, "http_bench", "pipeline");
+    for (size_t i = 0; i < sizeof(pipelines) / sizeof(pipelines[0]); ++i) {
+        for (size_t j = 0; j < sizeof(cases) / sizeof(cases[0]); ++j) {
+            benchCase(cases[j], pipelines[i]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "../include/http_scanner.h"
+
+/*
+    请求解析微基准测试：对比逐字节查找行结束符 + strpbrk() 的旧解析方式和 HttpScanner 的各个实现
+    - 语料是浏览器、curl 和压测工具发出的真实请求，拼接成流水线请求流
+    - 请求流按照 piece 字节一次到达（0 表示一次全部到达），没有完整的行时记录扫描位置，下次从这里继续，和 parseLineData() 一致
+    - 每解析完一行都把 \r\n 换成 '\0'，请求行拆分出方法、URL 和版本，统计每个请求的平均耗时
+*/
+
+#define ROUNDS 2000
+
+static const char* corpus[] = {
+    // Chrome
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9090\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1712345678; session=5f2b8c3e9a1d4e6f8b7c0a9d2e4f6a8b; theme=dark\r\n"
+    "\r\n",
+    // Firefox，带 Referer 请求页面中的图片
+    "GET /images/webserver.jpg HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9090\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,zh-TW;q=0.7,zh-HK;q=0.5,en-US;q=0.3,en;q=0.2\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.10:9090/index.html\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+    // curl
+    "GET /szu.html HTTP/1.1\r\n"
+    "Host: localhost:9090\r\n"
+    "User-Agent: curl/7.81.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // webbench / wrk 这类压测工具
+    "GET / HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9090\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+    // 手机浏览器，带较长的 Cookie
+    "GET /szu.html?from=share&utm_source=wechat HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9090\r\n"
+    "User-Agent: Mozilla/5.0 (iPhone; CPU iPhone OS 17_4 like Mac OS X) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4 Mobile/15E148 Safari/604.1\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: uid=8d3f1a2b4c5d6e7f; sid=0123456789abcdef0123456789abcdef; prefs=lang%3Dzh%26font%3Dlarge%26layout%3Dcompact; "
+    "track=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ\r\n"
+    "\r\n",
+};
+
+// 查找行结束符和请求行分隔符的方式
+struct Finder {
+    const char* (*line_end)(const char* begin, const char* end);
+    char* (*delimiter)(char* text, char* end);
+};
+
+// 旧的解析方式：逐字节查找 '\r' / '\n'，请求行通过 strpbrk() 再扫描一遍
+static const char* byteLineEnd(const char* begin, const char* end) {
+    for (const char* p = begin; p < end; ++p) {
+        if ((*p == '\r') || (*p == '\n')) {
+            return p;
+        }
+    }
+    return NULL;
+}
+static char* strpbrkDelimiter(char* text, char*) {     // strpbrk() 扫描到 '\0' 为止，不需要结束位置
+    return strpbrk(text, " \t");
+}
+
+static const char* scannerLineEnd(const char* begin, const char* end) {
+    return HttpScanner::findLineEnd(begin, end);
+}
+static char* scannerDelimiter(char* text, char* end) {
+    return (char*)HttpScanner::findDelimiter(text, end);
+}
+
+// 拆分请求行，返回是否是合法的 GET 请求
+static bool parseRequestLine(const Finder& finder, char* text, char* end) {
+    char* url = finder.delimiter(text, end);
+    if (url == NULL) {
+        return false;
+    }
+    *url++ = '\0';
+    if (strcasecmp(text, "GET") != 0) {
+        return false;
+    }
+    char* version = finder.delimiter(url, end);
+    if (version == NULL) {
+        return false;
+    }
+    *version++ = '\0';
+    return strcasecmp(version, "HTTP/1.1") == 0;
+}
+
+/*
+    解析 data 中的流水线请求流，每次到达 piece 字节，返回解析出的请求数量
+    和服务器一样记录 checked（已经扫描的位置）和 start_line（当前行的起始位置）
+*/
+static int parseStream(const Finder& finder, char* data, int size, int piece) {
+    int read_index = 0;
+    int checked = 0;
+    int start_line = 0;
+    bool request_line = true;
+    int requests = 0;
+
+    while (read_index < size) {
+        read_index += (piece > 0) ? piece : size;
+        if (read_index > size) {
+            read_index = size;
+        }
+
+        while (checked < read_index) {
+            const char* found = finder.line_end(data + checked, data + read_index);
+            if (found == NULL) {
+                checked = read_index;   // 行不完整，等待更多的数据
+                break;
+            }
+            checked = found - data;
+            if (checked + 1 == read_index) {
+                break;                  // 数据末尾的 '\r'，等待 '\n'
+            }
+            if ((*found != '\r') || (data[checked + 1] != '\n')) {
+                return -1;              // 单独的 '\r' 或 '\n'
+            }
+            data[checked++] = '\0';
+            data[checked++] = '\0';
+
+            char* text = data + start_line;
+            char* end = data + checked - 2;
+            start_line = checked;
+            if (request_line) {
+                if (!parseRequestLine(finder, text, end)) {
+                    return -1;
+                }
+                request_line = false;
+            }
+            else if (text == end) {
+                ++requests;             // 空行，一个请求解析完毕
+                request_line = true;
+            }
+        }
+    }
+    return requests;
+}
+
+static void benchParser(const char* name, const Finder& finder, const std::string& stream, int expected, int piece) {
+    std::vector<char> data(stream.size());
+    int total = 0;
+
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    for (int round = 0; round < ROUNDS; ++round) {
+        memcpy(&data[0], stream.data(), stream.size());     // 解析会修改数据，每一轮重新拷贝
+        int requests = parseStream(finder, &data[0], (int)data.size(), piece);
+        if (requests != expected) {
+            printf("%s: parsed %d requests, expected %d\n", name, requests, expected);
+            return;
+        }
+        total += requests;
+    }
+    long long elapsed = benchNowNs() - start;
+    benchKeep(total);
+    benchReport(name, piece, total, elapsed, benchAllocs() - allocs);
+}
+
+int main(int argc, char* argv[]) {
+    // 每种请求重复若干次，拼接成一个流水线请求流
+    std::string stream;
+    int expected = 0;
+    for (int repeat = 0; repeat < 8; ++repeat) {
+        for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i) {
+            stream += corpus[i];
+            ++expected;
+        }
+    }
+    benchInit(argc, argv, "parser_bench", "piece");
+    printf("corpus: %d requests, %zu bytes, %.1f bytes/request\n", expected, stream.size(), (double)stream.size() / expected);
+
+    Finder old_finder = { byteLineEnd, strpbrkDelimiter };
+    Finder scanner_finder = { scannerLineEnd, scannerDelimiter };
+    int pieces[] = { 0, 1460, 333 };     // 一次全部到达、按照以太网 MSS 到达、按照很小的片段到达
+
+    for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); ++i) {
+        benchParser("byte loop + strpbrk", old_finder, stream, expected, pieces[i]);
+        for (int impl = HttpScanner::SCALAR; impl < HttpScanner::IMPL_COUNT; ++impl) {
+            if (!HttpScanner::setImpl((HttpScanner::IMPL)impl)) {
+                continue;       // CPU 不支持
+            }
+            std::string name = std::string("scanner ") + HttpScanner::implName((HttpScanner::IMPL)impl);
+            benchParser(name.c_str(), scanner_finder, stream, expected, pieces[i]);
+        }
+    }
+    return 0;
+}
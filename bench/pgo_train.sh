@@ -0,0 +1,51 @@
+#!/bin/sh
+# PGO 训练负载，由 CMake 的 pgo 目标调用：sh pgo_train.sh <插桩的构建目录> <网站根目录>
+# - 先运行基准测试，覆盖请求解析、响应生成和定时器
+# - 再依次以线程池、工作窃取线程池、多 reactor 和 io_uring 模式启动插桩的服务器，
+#   在回环地址上用 loadgen 压测保持连接、流水线、短连接、图片、404 和 /__stats，
+#   最后发送 SIGTERM，服务器正常退出时写出剖析数据
+# 端口和每轮压测的时长可以用环境变量 PGO_PORT、PGO_DURATION 修改
+set -e
+
+BUILD=$1
+DOCROOT=$2
+PORT=${PGO_PORT:-18090}
+DURATION=${PGO_DURATION:-2}
+URL=http://127.0.0.1:$PORT
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+for bench in timer_bench parser_bench http_bench; do
+    "$BUILD/$bench" > /dev/null
+done
+
+load() {
+    "$BUILD/loadgen" "$@" > /dev/null
+}
+
+train() {
+    echo "pgo: training webserver $*"
+    "$BUILD/webserver" -d "$DOCROOT" -l "$TMP/access.log" "$@" "$PORT" > "$TMP/server.log" 2>&1 &
+    pid=$!
+    sleep 1
+    if ! kill -0 "$pid" 2> /dev/null; then
+        cat "$TMP/server.log"
+        exit 1
+    fi
+
+    load -t 2 -c 64 -d "$DURATION" "$URL/szu.html"
+    load -t 2 -c 16 -p 16 -d "$DURATION" "$URL/szu.html"
+    load -t 2 -c 16 -C -d 1 "$URL/szu.html"
+    load -t 2 -c 16 -d 1 "$URL/imgs/1.png"
+    load -t 1 -c 8 -d 1 "$URL/missing.html"
+    load -t 1 -c 2 -d 1 "$URL/__stats"
+
+    kill -TERM "$pid"
+    wait "$pid"
+}
+
+train
+train -w
+train -r 2
+train -u
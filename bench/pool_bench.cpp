@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "bench.h"
+#include "../include/thread_pool.h"
+#include "../include/work_stealing_pool.h"
+
+/*
+    线程池微基准测试：对比全局请求队列的 ThreadPool 和工作窃取的 WorkStealingPool
+    - 主线程相当于 reactor，不断把空闲的连接交给线程池，一个连接同一时间只有一个任务（和 EPOLLONESHOT 一致）
+    - 任务读写连接自己的缓冲区，模拟解析请求和填充响应，同一个连接留在同一个线程时缓冲区还在缓存中
+    - 统计任务从交给线程池到处理完毕的延迟（p50、p99）和总吞吐量
+*/
+
+#define CONNECTIONS 256
+#define TASKS 200000
+#define CONN_BUFFER_SIZE 4096
+
+static std::atomic<long long> done(0);
+static std::vector<long long> latency(TASKS);
+
+class BenchConn {
+public:
+    std::atomic<bool> busy;
+    long long submit_ns;
+    int worker;
+    char buffer[CONN_BUFFER_SIZE];
+
+    BenchConn() : busy(false), submit_ns(0), worker(-1) {}
+
+    int getWorker() const { return this->worker; }
+    void setWorker(int worker) { this->worker = worker; }
+
+    void process() {
+        unsigned sum = 0;
+        for (int i = 0; i < CONN_BUFFER_SIZE; i += 16) {
+            sum += this->buffer[i];
+            this->buffer[i] = (char)sum;
+        }
+        benchKeep(sum);
+
+        long long index = done.fetch_add(1);
+        latency[index] = benchNowNs() - this->submit_ns;
+        this->busy.store(false, std::memory_order_release);
+    }
+};
+
+// ThreadPool 的工作线程是分离的，没有办法结束，不释放它
+static void releasePool(ThreadPool<BenchConn>* pool) {
+    benchKeep(pool);
+}
+
+// WorkStealingPool 析构时通知工作线程退出并等待它们结束
+static void releasePool(WorkStealingPool<BenchConn>* pool) {
+    delete pool;
+}
+
+template<typename Pool>
+static void benchPool(const char* name, int threads) {
+    Pool* pool = new Pool(threads, CONNECTIONS);
+    std::vector<BenchConn> conns(CONNECTIONS);
+    done = 0;
+
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    int submitted = 0;
+    while (submitted < TASKS) {
+        bool found = false;
+        for (int i = 0; i < CONNECTIONS && submitted < TASKS; ++i) {
+            BenchConn* conn = &conns[i];
+            if (conn->busy.load(std::memory_order_acquire)) {
+                continue;
+            }
+            conn->busy.store(true, std::memory_order_relaxed);
+            conn->submit_ns = benchNowNs();
+            while (!pool->append(conn)) {
+                sched_yield();
+            }
+            ++submitted;
+            found = true;
+        }
+        if (!found) {
+            sched_yield();
+        }
+    }
+    while (done.load() < TASKS) {
+        sched_yield();
+    }
+    long long elapsed = benchNowNs() - start;
+    allocs = benchAllocs() - allocs;
+
+    std::sort(latency.begin(), latency.end());
+    benchReport(name, threads, TASKS, elapsed, allocs);
+    benchLatency(name, threads, latency[TASKS / 2], latency[TASKS * 99 / 100]);
+
+    releasePool(pool);
+}
+
+int main(int argc, char* argv[]) {
+    int threads[] = { 4, 8, 16 };
+    benchInit(argc, argv, "pool_bench", "threads");
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        benchPool<ThreadPool<BenchConn> >("thread pool (global queue)", threads[i]);
+        benchPool<WorkStealingPool<BenchConn> >("work-stealing pool", threads[i]);
+    }
+    return 0;
+}
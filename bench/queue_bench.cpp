@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <list>
+#include <vector>
+#include "bench.h"
+#include "../include/locker.h"
+#include "../include/mpmc_queue.h"
+
+/*
+    线程池请求队列微基准测试：对比原来的互斥锁 + std::list 队列和无锁的 MPMC 环形队列
+    - 一半线程是生产者（相当于 reactor 线程调用 append()），另一半线程是消费者（相当于工作线程）
+    - 两种队列都和线程池一样配合信号量使用：生产者入队后 post()，消费者 wait() 后出队
+    - 每个生产者入队 ITEMS_PER_PRODUCER 个任务，统计所有任务从开始入队到全部出队的吞吐量
+*/
+
+#define QUEUE_CAPACITY 65536
+#define ITEMS_PER_PRODUCER 200000
+
+// 原来线程池中的请求队列
+class LockedQueue {
+private:
+    std::list<int*> m_workqueue;
+    locker m_queuelocker;
+
+public:
+    bool enqueue(int* request) {
+        this->m_queuelocker.lock();
+        if (this->m_workqueue.size() > QUEUE_CAPACITY) {
+            this->m_queuelocker.unlock();
+            return false;
+        }
+        this->m_workqueue.push_back(request);
+        this->m_queuelocker.unlock();
+        return true;
+    }
+
+    bool dequeue(int*& request) {
+        this->m_queuelocker.lock();
+        if (this->m_workqueue.empty()) {
+            this->m_queuelocker.unlock();
+            return false;
+        }
+        request = this->m_workqueue.front();
+        this->m_workqueue.pop_front();
+        this->m_queuelocker.unlock();
+        return true;
+    }
+};
+
+template<typename Queue>
+struct BenchContext {
+    Queue* queue;
+    semaphore sem;
+    int consume;                // 每个消费者需要取出的任务数量
+};
+
+template<typename Queue>
+static void* producer(void* arg) {
+    BenchContext<Queue>* ctx = (BenchContext<Queue>*)arg;
+    static int task;
+    for (int i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        while (!ctx->queue->enqueue(&task)) {
+            sched_yield();
+        }
+        ctx->sem.post();
+    }
+    return NULL;
+}
+
+template<typename Queue>
+static void* consumer(void* arg) {
+    BenchContext<Queue>* ctx = (BenchContext<Queue>*)arg;
+    int* request = NULL;
+    for (int i = 0; i < ctx->consume; ++i) {
+        ctx->sem.wait();
+        while (!ctx->queue->dequeue(request)) {
+            sched_yield();
+        }
+        benchKeep(request);
+    }
+    return NULL;
+}
+
+template<typename Queue>
+static void benchQueue(const char* name, Queue* queue, int threads) {
+    int producers = threads / 2;
+    int consumers = threads - producers;
+    long long total = (long long)producers * ITEMS_PER_PRODUCER;
+
+    BenchContext<Queue> ctx;
+    ctx.queue = queue;
+    ctx.consume = total / consumers;
+
+    std::vector<pthread_t> tids(threads);
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    for (int i = 0; i < producers; ++i) {
+        pthread_create(&tids[i], NULL, producer<Queue>, &ctx);
+    }
+    for (int i = 0; i < consumers; ++i) {
+        pthread_create(&tids[producers + i], NULL, consumer<Queue>, &ctx);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    benchReport(name, threads, total, benchNowNs() - start, benchAllocs() - allocs);
+}
+
+int main(int argc, char* argv[]) {
+    int threads[] = { 4, 8, 16, 32 };
+    benchInit(argc, argv, "queue_bench", "threads");
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        LockedQueue* locked = new LockedQueue;
+        benchQueue("locker + std::list", locked, threads[i]);
+        delete locked;
+
+        MPMCQueue<int*>* ring = new MPMCQueue<int*>(QUEUE_CAPACITY);
+        benchQueue("mpmc ring", ring, threads[i]);
+        delete ring;
+    }
+    return 0;
+}
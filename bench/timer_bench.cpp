@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <vector>
+#include "bench.h"
+#include "../include/lst_timer.h"
+
+/*
+    定时器微基准测试：对比升序链表 SortTimerLst 和时间轮 TimeWheel
+    - add: 依次添加 n 个定时器，超时时间递增（和服务器不断接受新连接的情况一致）
+    - adjust: 随机选择定时器把超时时间延长到最晚（和连接收到新请求时重新计时的情况一致）
+    - tick: 所有定时器都到期，处理到期的定时器
+*/
+
+static long long expired = 0;
+
+static void cbCount(ClientData* user_data) {
+    ++expired;
+    benchKeep(user_data);
+}
+
+static void benchList(int n, int adjusts) {
+    std::vector<ClientData> users(n);
+    SortTimerLst* lst = new SortTimerLst;
+    long long base = getCurrentMs() + 60 * 1000;
+
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    for (int i = 0; i < n; ++i) {
+        UtilTimer* timer = &users[i].timer;
+        timer->user_data = &users[i];
+        timer->cb_func = cbCount;
+        timer->expire = base + i;
+        lst->addTimer(timer);
+    }
+    benchReport("list add", n, n, benchNowNs() - start, benchAllocs() - allocs);
+
+    srand(1);
+    allocs = benchAllocs();
+    start = benchNowNs();
+    for (int i = 0; i < adjusts; ++i) {
+        UtilTimer* timer = &users[rand() % n].timer;
+        timer->expire = base + n + i;
+        lst->adjustTimer(timer);
+    }
+    benchReport("list adjust", n, adjusts, benchNowNs() - start, benchAllocs() - allocs);
+
+    // 把所有定时器的超时时间改成已经过去的时间，链表依然有序
+    long long past = getCurrentMs() - 60 * 1000;
+    for (int i = 0; i < n; ++i) {
+        users[i].timer.expire -= base - past + n + adjusts;
+    }
+    expired = 0;
+    allocs = benchAllocs();
+    start = benchNowNs();
+    lst->tick();
+    benchReport("list tick (expire all)", n, expired, benchNowNs() - start, benchAllocs() - allocs);
+
+    delete lst;
+}
+
+static void benchWheel(int n, int adjusts) {
+    std::vector<ClientData> users(n);
+    TimeWheel* wheel = new TimeWheel;
+    long long base = getCurrentMs() + 15 * 1000;
+
+    long long allocs = benchAllocs();
+    long long start = benchNowNs();
+    for (int i = 0; i < n; ++i) {
+        UtilTimer* timer = &users[i].timer;
+        timer->user_data = &users[i];
+        timer->cb_func = cbCount;
+        timer->expire = base + i % 1000;
+        wheel->addTimer(timer);
+    }
+    benchReport("wheel add", n, n, benchNowNs() - start, benchAllocs() - allocs);
+
+    srand(1);
+    allocs = benchAllocs();
+    start = benchNowNs();
+    for (int i = 0; i < adjusts; ++i) {
+        UtilTimer* timer = &users[rand() % n].timer;
+        timer->expire = base + 1000 + i % 1000;
+        wheel->adjustTimer(timer);
+    }
+    benchReport("wheel adjust", n, adjusts, benchNowNs() - start, benchAllocs() - allocs);
+
+    expired = 0;
+    allocs = benchAllocs();
+    start = benchNowNs();
+    wheel->tick(base + 60 * 1000);
+    benchReport("wheel tick (expire all)", n, expired, benchNowNs() - start, benchAllocs() - allocs);
+
+    delete wheel;
+}
+
+int main(int argc, char* argv[]) {
+    int sizes[] = { 1000, 10000, 100000 };
+    benchInit(argc, argv, "timer_bench", "timers");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        benchList(sizes[i], 10000);
+        benchWheel(sizes[i], 1000000);
+    }
+    return 0;
+}
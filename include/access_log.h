@@ -0,0 +1,97 @@
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+
+/*
+    进程级的异步访问日志
+    - 每个产生日志的线程（reactor 线程、工作线程）第一次写日志时注册一个自己的 SPSC 环形队列，
+      请求处理线程只把定长的二进制记录拷贝进队列，不格式化、不加锁、不进行系统调用
+    - 队列满时丢弃记录并计入运行指标（webserver_access_log_drops_total），请求处理线程从不等待日志线程
+    - 后台线程轮询所有队列，把记录格式化成 Common Log Format 的一行，攒成一批通过一次 write() 写入 O_APPEND 打开的文件，
+      文件超过设定的大小时重命名为 path.1（覆盖上一个），重新创建日志文件
+*/
+class AccessLog {
+public:
+    static const int RING_SIZE = 4096;          // 每个线程的队列容量（记录数），必须是 2 的整数次幂
+    static const int MAX_RINGS = 512;           // 最多的队列（线程）数量，超过之后的线程不写日志
+    static const int URL_LEN = 102;             // 记录中保存的 URL 的最大长度，更长的 URL 被截断
+    static const size_t BATCH_BYTES = 64 * 1024;    // 日志线程一次 write() 最多写入的字节数
+    static const size_t MAX_LINE = 512;         // 格式化后一行的最大长度（URL 中的不可打印字符转义成 \xHH）
+    static const int IDLE_SLEEP_US = 5000;      // 所有队列都为空时日志线程的睡眠时间（微秒）
+    static const size_t DEFAULT_ROTATE_BYTES = 64 * 1024 * 1024;   // 默认日志文件超过 64 MB 时轮转
+
+private:
+    // 定长的二进制日志记录，正好两个缓存行
+    struct Record {
+        time_t time;            // 请求完成的时间（秒）
+        uint32_t addr;          // 客户端 IPv4 地址（网络字节序）
+        uint16_t port;          // 客户端端口（网络字节序）
+        uint16_t status;        // 响应状态码
+        int64_t bytes;          // 响应的字节数（响应头和响应体）
+        uint16_t url_len;
+        char url[URL_LEN];
+    };
+    static_assert(sizeof(Record) == 128, "Record must be two cache lines");
+
+    // 单生产者单消费者环形队列，读写位置分别在自己的缓存行中
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head;     // 生产者写入的位置
+        uint64_t cached_tail;                       // 生产者缓存的消费者读取位置，只在队列看起来满时重新读取 tail
+        alignas(64) std::atomic<uint64_t> tail;     // 消费者读取的位置
+        alignas(64) Record records[RING_SIZE];
+    };
+
+    Ring* m_rings[MAX_RINGS];
+    std::atomic<int> m_ring_count;
+    std::atomic<bool> m_enabled;        // 是否打开了日志文件
+    std::atomic<bool> m_stop;           // 通知日志线程写完剩余的记录后退出
+    std::string m_path;                 // 日志文件路径
+    size_t m_rotate_bytes;              // 日志文件的大小上限
+    int m_fd;                           // 日志文件，只有日志线程使用
+    size_t m_file_bytes;                // 当前日志文件的大小
+    pthread_t m_thread;
+
+    static inline thread_local Ring* m_local = NULL;    // 当前线程的队列，在头文件中常量初始化，访问不需要包装函数
+    static inline thread_local bool m_full = false;     // 队列（线程）数量已满，当前线程不写日志
+
+    AccessLog();
+    ~AccessLog() {}
+
+public:
+    // 获取进程唯一的访问日志
+    static AccessLog* getInstance();
+
+    // 打开日志文件并启动日志线程，rotate_bytes 为 0 表示不轮转，需要在请求处理线程启动之前调用
+    bool open(const char* path, size_t rotate_bytes);
+
+    // 通知日志线程写完所有已经入队的记录，等待它退出
+    void close();
+
+    bool enabled() const { return this->m_enabled.load(std::memory_order_relaxed); }
+
+    // 记录一个响应，由请求处理线程调用，没有打开日志时直接返回
+    void log(const sockaddr_in& client, std::string_view url, int status, int64_t bytes) {
+        if (this->enabled()) {
+            this->append(client, url, status, bytes);
+        }
+    }
+
+private:
+    void append(const sockaddr_in& client, std::string_view url, int status, int64_t bytes);
+    Ring* registerRing();               // 为当前线程申请并注册队列，队列数量已满时返回 NULL
+    static void* worker(void* arg);     // 日志线程
+    void run();
+    size_t drain(char* buf, size_t size);   // 从所有队列中取出记录并格式化到 buf 中，返回格式化的字节数
+    bool reopen();                      // 打开（或者轮转后重新创建）日志文件
+    void writeBatch(const char* buf, size_t len);   // 写入一批日志行，需要时先轮转
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include <atomic>
+
+/*
+    基于排队时间的准入控制（参考 CoDel），只用于单 reactor + 线程池模式
+    - 工作线程取出每个连接时报告它在线程池队列中等待的时间（observe()）
+    - 按照长度为 interval 的窗口统计最小排队时间：整个窗口内所有请求的排队时间都超过 target，
+      说明队列没有排空过，是持续的排队而不是突发，进入过载状态，有效期为下一个窗口
+    - 过载期间 reactor 在交给线程池之前检查最近一次的排队时间（admit()），超过 target 时不再排队，
+      直接返回 503，排队时间回落到 target 以下时恢复接收，请求的排队时间因此大致被限制在 target 附近
+    - 过载状态只由工作线程的观察刷新，所有请求都被拒绝、工作线程不再报告时，过载状态在有效期结束后自动解除
+*/
+class AdmissionControl {
+public:
+    static const int DEFAULT_TARGET_MS = 5;     // 默认的排队时间目标值（毫秒）
+    static const int INTERVAL_FACTOR = 20;      // 窗口长度是目标值的倍数（CoDel 建议目标值取窗口的 5% ~ 10%）
+
+private:
+    long long m_target;                         // 排队时间目标值（纳秒），0 表示关闭准入控制
+    long long m_interval;                       // 窗口长度（纳秒）
+    std::atomic<long long> m_window_end;        // 当前窗口的结束时间
+    std::atomic<long long> m_window_min;        // 当前窗口内的最小排队时间
+    std::atomic<long long> m_last_sojourn;      // 最近取出的请求的排队时间
+    std::atomic<long long> m_overload_until;    // 过载状态的结束时间，0 表示没有过载
+
+    AdmissionControl();
+
+public:
+    // 获取进程唯一的准入控制器
+    static AdmissionControl* getInstance();
+
+    // 设置排队时间目标值（毫秒），0 表示关闭，需要在创建线程池之前调用
+    void setTarget(int target_ms);
+
+    // 由工作线程调用，报告一个请求在队列中等待的时间，now 是取出时的时间（纳秒）
+    void observe(long long sojourn, long long now);
+
+    // 由 reactor 线程在交给线程池之前调用，返回 false 表示应该拒绝这个请求
+    bool admit(long long now) const {
+        long long until = this->m_overload_until.load(std::memory_order_relaxed);
+        if ((until == 0) || (now >= until)) {
+            return true;
+        }
+        return this->m_last_sojourn.load(std::memory_order_relaxed) <= this->m_target;
+    }
+};
+
+#endif
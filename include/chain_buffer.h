@@ -0,0 +1,81 @@
+#ifndef CHAINBUFFER_H
+#define CHAINBUFFER_H
+
+#include <sys/types.h>
+#include <vector>
+#include "slice_pool.h"
+
+/*
+    由固定大小的分片组成的读缓冲区
+    - 分片从分片池中按需申请，没有数据时不持有任何分片，空闲的 keep-alive 连接不占用缓冲区内存
+    - 数据按照顺序写满一个分片之后再写下一个分片，逻辑位置 pos 位于第 pos / SLICE_SIZE 个分片中
+    - 最后一个分片写满之后，通过 readv() 一次读入多个新的分片
+    - 跨越分片边界的一行数据被拷贝到一个单独的行分片中，解析器总是得到连续的一行；
+      超过一个分片的长行（例如很大的 Cookie）拷贝到从堆上申请的内存中，行的长度只受缓冲区的数据量上限限制
+*/
+class ChainBuffer {
+private:
+    std::vector<char*> m_slices;        // 按顺序排列的分片
+    int m_tail_len;                     // 最后一个分片中的数据字节数
+    std::vector<char*> m_lines;         // 跨越分片边界的行被拷贝到的分片，当前请求处理完毕后归还
+    std::vector<char*> m_long_lines;    // 超过一个分片的行被拷贝到的堆内存，和行分片一起释放
+
+public:
+    static const int SLICE_SIZE = SlicePool::SLICE_SIZE;
+    static const int SLICE_MASK = SLICE_SIZE - 1;
+    static const int READV_SLICES = 2;  // 一次 readv() 最多读入的新分片数量
+
+    ChainBuffer();
+    ~ChainBuffer();
+
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    // 缓冲区中的数据字节数（包括已经处理但还没有丢弃的数据）
+    int size() const {
+        return this->m_slices.empty() ? 0 : (int)((this->m_slices.size() - 1) * SLICE_SIZE) + this->m_tail_len;
+    }
+
+    // 访问逻辑位置 pos 处的字节，pos 必须小于 size()
+    char& at(int pos) { return this->m_slices[pos >> SlicePool::SLICE_SHIFT][pos & SLICE_MASK]; }
+
+    // 逻辑位置 pos 开始、位于同一个分片中的连续数据的起始地址，len 返回连续的字节数，pos 必须小于 size()
+    char* span(int pos, int* len) {
+        size_t index = pos >> SlicePool::SLICE_SHIFT;
+        int limit = (index + 1 == this->m_slices.size()) ? this->m_tail_len : SLICE_SIZE;
+        *len = limit - (pos & SLICE_MASK);
+        return this->m_slices[index] + (pos & SLICE_MASK);
+    }
+
+    /*
+        从 fd 中读取最多 max_bytes 字节追加到缓冲区末尾，返回值和 read() 相同
+        最后一个分片还有空间时只读入该分片，已满时申请 READV_SLICES 个新分片通过 readv() 一次读入（缓冲区为空时只申请一个），
+        没有用到的分片立即归还
+    */
+    ssize_t readFrom(int fd, int max_bytes);
+
+    // 把 len 字节的数据追加到缓冲区末尾（io_uring 后端从提供缓冲区中拷贝），内存不足时返回 false，已经追加的部分保留
+    bool append(const char* data, int len);
+
+    /*
+        获取 [start, end) 之间的一行数据的连续地址，没有跨越分片时直接返回分片中的地址，
+        否则拷贝到一个行分片中（行长度超过分片大小时拷贝到堆内存中），内存不足时返回 NULL
+    */
+    char* line(int start, int end);
+
+    // 归还所有的行分片和长行的堆内存，之前通过 line() 得到的地址失效
+    void releaseLines();
+
+    /*
+        丢弃 pos 之前已经处理完毕的数据，返回所有逻辑位置需要减去的值
+        只剩一个分片时把剩余的数据移动到分片开头，moved 返回该分片的地址，moved_offset 返回数据向前移动的字节数（没有移动时为 0），
+        调用者据此同步移动指向该分片的地址；所有数据都处理完毕时归还所有的分片
+    */
+    int consume(int pos, const char** moved, int* moved_offset);
+
+    // 清空缓冲区，归还所有从分片池申请的分片
+    void clear();
+
+};
+
+#endif
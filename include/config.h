@@ -0,0 +1,39 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// 服务器的启动配置，由命令行参数解析得到
+class Config {
+public:
+    int port;                   // 监听的端口号
+    size_t cache_max_bytes;     // 文件缓存最多映射的字节数
+    int cache_max_files;        // 文件缓存最多缓存的文件数量
+    long long map_limit;        // 超过该大小的文件不建立内存映射，使用 sendfile() 发送
+    int reactors;               // reactor 的数量，0 表示单 reactor + 线程池模式
+    int idle_timeout;           // 连接空闲超时时间（毫秒）
+    bool work_stealing;         // 单 reactor 模式下是否使用工作窃取线程池
+    int read_limit;             // 每个连接最多缓存的请求数据字节数
+    size_t gzip_max_bytes;      // gzip 压缩结果最多缓存的字节数，0 表示关闭 gzip
+    std::vector<std::string> cache_policies;    // 按扩展名的缓存策略，例如 .css=86400
+    bool io_uring;              // 使用 io_uring 后端（多 reactor 模式），内核不支持时退回到 epoll
+    std::string access_log;     // 访问日志文件路径，空表示不记录访问日志
+    size_t access_log_rotate;   // 访问日志文件的大小上限，0 表示不轮转
+    int queue_target_ms;        // 线程池排队时间的准入控制目标值（毫秒），0 表示关闭准入控制
+    int threads;                // 线程池的线程数量，0 表示使用可用的 CPU 数量
+    std::vector<int> cpus;      // 绑定的 CPU 列表，依次分配给 reactor 和工作线程，为空时不绑定
+    std::string doc_root;       // 网站的根目录，空表示使用编译时指定的目录
+
+public:
+    Config();
+
+    // 解析命令行参数，参数错误时返回 false
+    bool parse(int argc, char* argv[]);
+
+    // 打印使用方法
+    static void usage(const char* name);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+/*
+    CPU 数量和线程绑定
+    - 可用的 CPU 数量是进程的 CPU 亲和性集合（taskset、cpuset cgroup）中的 CPU 数，再受 cgroup 的 CPU 配额
+      （v2 的 cpu.max，v1 的 cpu.cfs_quota_us / cpu.cfs_period_us）限制，容器中不会创建比配额多的线程
+    - 绑定的 CPU 列表可以显式指定（"0-3,8"），也可以按照拓扑自动排列（"auto"）：同一个 CPU 插槽（NUMA 结点）的 CPU 排在一起，
+      每个插槽内先排每个物理核的第一个超线程，再排兄弟超线程，依次分配的线程先占满一个插槽的物理核
+    - 线程在创建时（pthread_attr_setaffinity_np）就绑定到 CPU 上，之后第一次写入的线程局部缓冲区
+      （运行指标分片、分片池的线程缓存、访问日志队列）按照 Linux 的首次访问策略分配在该 CPU 所在的 NUMA 结点上
+*/
+class CpuAffinity {
+public:
+    // 可用的 CPU 数量，至少为 1
+    static int usableCpus();
+
+    // 解析 CPU 列表（"0-3,8,10-11" 或者 "auto"），只保留进程亲和性集合中的 CPU，列表为空或者格式错误时返回 false
+    static bool parseList(const char* spec, std::vector<int>* cpus);
+
+    // 设置线程属性，使用它创建的线程绑定到 cpu 上，cpu 为 -1 时不绑定
+    static bool setAttr(pthread_attr_t* attr, int cpu);
+
+    // 把当前线程绑定到 cpu 上，old 不为 NULL 时返回原来的亲和性集合，用于之后恢复
+    static bool pinSelf(int cpu, cpu_set_t* old = NULL);
+
+    // 恢复当前线程的亲和性集合
+    static void restoreSelf(const cpu_set_t& old);
+
+private:
+    static void topologyOrder(std::vector<int>* cpus);  // 按照插槽、超线程、物理核排列进程亲和性集合中的 CPU
+    static int cgroupLimit();                           // cgroup 配额对应的 CPU 数量（向上取整），没有限制时返回 0
+};
+
+#endif
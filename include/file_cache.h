@@ -0,0 +1,121 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "locker.h"
+
+/*
+    文件缓存项，一个资源文件对应一个缓存项，被所有连接共享
+    - 缓存项持有只读打开的 fd、stat 结果以及整个文件的只读内存映射
+    - 实体标签和 Last-Modified 在加载文件时生成一次，每个响应直接拷贝
+    - 连接通过 FileCache::acquire() 借用缓存项，响应发送完毕后通过 FileCache::release() 归还
+    - 缓存项被淘汰或者失效时只是从索引中摘除，引用计数归零时才真正 munmap() 和 close()
+*/
+struct FileEntry {
+    std::string path;           // 缓存键，文件的完整路径（doc_root + url）
+    int fd;                     // 只读打开的文件描述符，只有验证器的缓存项（FileCache::statOnly()）为 -1
+    struct stat st;             // 文件的状态信息
+    char* address;              // 文件被 mmap 到内存中的起始地址，空文件和超过映射上限的大文件为 NULL（通过 fd 用 sendfile() 发送）
+    char etag[64];              // 强实体标签（带双引号），由 inode、大小和纳秒精度的修改时间生成
+    char last_modified[32];     // 修改时间的 HTTP 日期
+    int refcount;               // 正在使用该缓存项的连接数量
+    int wd;                     // 文件对应的 inotify watch 描述符，-1 表示未被监视
+    bool cached;                // 是否还在缓存索引中
+    std::list<FileEntry*>::iterator lru_pos;    // 在 LRU 链表中的位置
+};
+
+/*
+    进程级的文件缓存，所有线程共享，操作内部数据结构时需要加锁
+    - 以文件完整路径为键，缓存 fd、stat 结果和引用计数管理的内存映射，避免每个请求都 stat() + open() + mmap() + munmap()
+    - 通过 inotify 监视被缓存的文件，文件被修改、删除、移动或者权限改变时，对应的缓存项失效
+    - 缓存的总字节数和文件数量有上限，超出时按照 LRU 淘汰
+*/
+class FileCache {
+private:
+    // 一个 inotify watch 对应的信息，硬链接等情况下多个缓存项可能对应同一个 watch
+    struct Watch {
+        unsigned generation;            // 每收到一次该 watch 的事件就加一，用于发现加载文件期间发生的修改
+        int users;                      // 正在使用该 watch 的缓存项（以及正在加载的请求）的数量
+        std::vector<FileEntry*> entries;    // 使用该 watch 的缓存项
+    };
+
+    std::unordered_map<std::string_view, FileEntry*> m_index;  // 路径到缓存项的索引，键指向缓存项中的 path
+    std::list<FileEntry*> m_lru;        // LRU 链表，表头是最近被使用的缓存项
+    std::unordered_map<int, Watch> m_watches;   // inotify watch 描述符到 watch 信息的映射
+    locker m_lock;                      // 互斥锁，保护上面所有的数据结构
+
+    int m_notify_fd;                    // inotify 文件描述符（非阻塞），由主线程注册到 epoll 对象中
+    size_t m_max_bytes;                 // 缓存最多映射的字节数
+    int m_max_files;                    // 缓存最多缓存的文件数量（即最多保持打开的 fd 数量）
+    size_t m_bytes;                     // 当前缓存映射的字节数
+    off_t m_map_limit;                  // 超过该大小的文件不建立内存映射，只缓存 fd 和 stat 结果
+
+    FileCache();
+    ~FileCache();
+
+public:
+    static const size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;  // 默认最多缓存 64 MB
+    static const int DEFAULT_MAX_FILES = 1024;                  // 默认最多缓存 1024 个文件
+    static const off_t DEFAULT_MAP_LIMIT = 1024 * 1024;         // 默认超过 1 MB 的文件使用 sendfile() 发送
+
+    // 获取进程唯一的文件缓存对象
+    static FileCache* getInstance();
+
+    // 设置缓存的容量，需要在工作线程启动之前调用
+    void setCapacity(size_t max_bytes, int max_files);
+
+    // 设置建立内存映射的文件大小上限，需要在工作线程启动之前调用
+    void setMapLimit(off_t map_limit) { this->m_map_limit = map_limit; }
+
+    /*
+        借用 path 对应的缓存项，没有命中时打开文件并建立内存映射
+        - 成功返回缓存项，使用完毕后必须调用 release() 归还
+        - 失败返回 NULL，并设置 errno：ENOENT 文件不存在，EACCES 没有读权限，EISDIR 是目录，其它为打开或映射失败
+    */
+    FileEntry* acquire(const char* path);
+
+    // 只查找缓存，命中时和 acquire() 一样借用缓存项，没有命中时返回 NULL，不加载文件
+    FileEntry* find(const char* path);
+
+    /*
+        只获取文件的状态信息和验证器，不打开文件也不建立内存映射（fd 为 -1，address 为 NULL），也不放入缓存
+        用于没有命中缓存的条件请求判断能否直接返回 304，同样通过 release() 归还，失败时 errno 和 acquire() 相同
+    */
+    static FileEntry* statOnly(const char* path);
+
+    // 归还借用的缓存项
+    void release(FileEntry* entry);
+
+    // 为已经借用的缓存项再增加一个引用（例如交给后台线程使用），同样需要通过 release() 归还
+    void retain(FileEntry* entry);
+
+    // 根据缓存项的状态信息生成实体标签和 Last-Modified，suffix 非空时追加到实体标签中区分同一文件的不同编码
+    static void setValidators(FileEntry* entry, const char* suffix);
+
+    // 获取 inotify 文件描述符
+    int getNotifyFd() const { return this->m_notify_fd; }
+
+    // inotify 文件描述符可读时由主线程调用，读取事件并使对应的缓存项失效
+    void handleNotify();
+
+    // 使所有缓存项失效（收到 SIGHUP 时调用），正在被使用的缓存项在归还时释放
+    void clear();
+
+private:
+    FileEntry* load(const char* path);          // 打开文件并建立内存映射，不加锁
+    static bool statFile(const char* path, struct stat* st);   // 获取状态信息并检查读权限，目录返回 EISDIR
+    static void destroy(FileEntry* entry);      // 释放缓存项持有的映射和 fd
+    static size_t mappedBytes(const FileEntry* entry) { return entry->address ? entry->st.st_size : 0; }
+    void unlink(FileEntry* entry);              // 将缓存项从索引和 LRU 链表中摘除，调用者需持有锁
+    void dropWatch(int wd, FileEntry* entry);   // 减少 watch 的使用者，没有使用者时移除 watch，调用者需持有锁
+    void evict(std::vector<FileEntry*>& garbage);   // 按 LRU 淘汰缓存项直到满足容量限制，调用者需持有锁
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef GZIPCACHE_H
+#define GZIPCACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <deque>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "locker.h"
+#include "file_cache.h"
+
+/*
+    进程级的 gzip 变体缓存，所有线程共享
+    - 缓存键是原始文件的路径，每个变体记录生成它时原始文件的 mtime 和大小，不一致时视为过期重新准备（目前只有 gzip 一种编码）
+    - 资源目录中存在比原始文件新的 file.gz 时直接发送它（通过文件缓存借用），否则由后台线程用 zlib 压缩一次，
+      压缩结果写入 memfd 并建立只读内存映射，包装成 FileEntry，和普通文件一样通过 FileCache::release() 归还
+    - 请求线程从不压缩：变体还没有准备好时返回 NULL，本次响应发送未压缩的原始文件
+    - 压缩结果的总字节数和变体数量有上限，超出时按照 LRU 淘汰
+*/
+class GzipCache {
+public:
+    static const size_t DEFAULT_MAX_BYTES = 16 * 1024 * 1024;  // 默认最多缓存 16 MB 压缩结果
+    static const int MAX_VARIANTS = 1024;       // 最多缓存的变体数量（包括不值得压缩的文件的记录）
+    static const int MAX_PENDING = 64;          // 最多排队等待压缩的文件数量，队列满时本次不压缩
+    static const off_t MIN_SIZE = 256;          // 小于该大小的文件不压缩，压缩节省的字节抵不过响应头的开销
+    static const off_t MAX_SIZE = 8 * 1024 * 1024;     // 大于该大小的文件不在内存中压缩，只使用预压缩的 .gz 文件
+    static const int COMPRESS_LEVEL = 6;        // zlib 压缩级别
+
+private:
+    /*
+        变体的状态
+        - PENDING: 已经交给后台线程，还没有结果
+        - READY: 压缩结果在内存中
+        - SIDECAR: 使用资源目录中预压缩的 .gz 文件
+        - IDENTITY: 没有 .gz 文件，压缩后也没有明显变小，发送原始文件
+    */
+    enum STATE {
+        PENDING = 0,
+        READY,
+        SIDECAR,
+        IDENTITY
+    };
+
+    struct Variant {
+        std::string path;                   // 原始文件的完整路径
+        struct timespec mtime;              // 生成变体时原始文件的修改时间
+        off_t size;                         // 生成变体时原始文件的大小
+        STATE state;
+        FileEntry* data;                    // READY 状态下的压缩结果，缓存持有一个引用
+        std::list<Variant*>::iterator lru_pos;  // 在 LRU 链表中的位置
+    };
+
+    // 后台线程的压缩任务
+    struct Job {
+        FileEntry* original;                // 原始文件的缓存项，任务持有一个引用
+        struct timespec mtime;
+        off_t size;
+    };
+
+    std::unordered_map<std::string_view, Variant*> m_index;    // 路径到变体的索引，键指向变体中的 path
+    std::list<Variant*> m_lru;          // LRU 链表，表头是最近被使用的变体
+    size_t m_bytes;                     // READY 状态的变体占用的字节数
+    size_t m_max_bytes;                 // 压缩结果最多占用的字节数，0 表示关闭 gzip
+    locker m_lock;                      // 互斥锁，保护上面的数据结构
+
+    std::deque<Job> m_jobs;             // 等待压缩的任务
+    locker m_jobs_lock;                 // 保护任务队列
+    semaphore m_jobs_stat;              // 任务数量
+    bool m_started;                     // 后台线程是否已经启动
+
+    GzipCache();
+    ~GzipCache() {}
+
+public:
+    // 获取进程唯一的 gzip 变体缓存
+    static GzipCache* getInstance();
+
+    // 设置压缩结果的缓存容量并启动后台压缩线程，0 表示关闭 gzip，需要在工作线程启动之前调用
+    bool setCapacity(size_t max_bytes);
+
+    // 是否开启了 gzip
+    bool enabled() const { return this->m_max_bytes > 0; }
+
+    // 根据文件名判断文件是否适合压缩（文本类的资源）
+    static bool compressible(std::string_view path, off_t size);
+
+    /*
+        借用 original 的 gzip 变体，使用完毕后通过 FileCache::release() 归还
+        变体不存在或者还没有准备好时返回 NULL（第一次请求时交给后台线程准备），调用者发送原始文件
+    */
+    FileEntry* acquire(FileEntry* original);
+
+    /*
+        只获取 original 的 gzip 变体的验证器，不压缩、不打开文件，用于没有命中文件缓存的条件请求
+        只有变体索引中存在和 original 版本相同的 READY 或 SIDECAR 变体时才返回（READY 时是压缩结果本身，
+        SIDECAR 时是 .gz 文件的状态信息），和 acquire() 得到的变体的实体标签相同，通过 FileCache::release() 归还；
+        变体不存在、还在准备或者不值得压缩时返回 NULL，这时 acquire() 发送的也是原始文件
+    */
+    FileEntry* validators(const FileEntry* original);
+
+    // 清空所有变体（收到 SIGHUP 时调用）
+    void clear();
+
+private:
+    static void* worker(void* arg);     // 后台压缩线程
+    void run();
+    bool submit(FileEntry* original);   // 提交压缩任务，队列满时返回 false，调用者需持有 m_lock
+    void process(const Job& job);       // 处理一个压缩任务
+    static FileEntry* compress(FileEntry* original);    // 压缩原始文件，结果不值得缓存或者失败时返回 NULL
+    static bool sidecarFresh(const std::string& path, const struct timespec& mtime);  // 是否存在比原始文件新的 .gz 文件
+    static bool sameVersion(const Variant* variant, const struct stat& st);
+    void unlink(Variant* variant, std::vector<FileEntry*>& garbage);    // 摘除并释放变体，调用者需持有锁
+    void evict(std::vector<FileEntry*>& garbage);   // 按 LRU 淘汰变体直到满足容量限制，调用者需持有锁
+};
+
+#endif
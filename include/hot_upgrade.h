@@ -0,0 +1,42 @@
+#ifndef HOTUPGRADE_H
+#define HOTUPGRADE_H
+
+#include <sys/types.h>
+#include <sched.h>
+#include <string>
+
+#define UPGRADE_ENV "WEBSERVER_UPGRADE_FD"      // 新进程通过这个环境变量找到和旧进程通信的 Unix socket
+
+/*
+    不停机升级：旧进程把监听 socket 交给新启动的可执行文件，监听队列从不关闭，升级期间不会拒绝连接
+    - 旧进程收到 SIGUSR2 后 fork() 并 exec() 启动时的可执行文件路径（此时可以已经被替换成新版本），参数和原来相同；
+      子进程在 exec() 之前关闭除了标准输入输出和通信 socket 之外的所有文件描述符，不会继承客户端连接
+    - 旧进程通过 socketpair 以 SCM_RIGHTS 发送所有 reactor 的监听 socket，新进程启动时接收它们代替新建监听 socket
+    - 新进程创建好 reactor 后回复一个字节，旧进程收到后停止 accept，让剩余的连接在处理完当前请求后关闭，
+      连接全部关闭或者超过截止时间后退出；新进程没有回复就退出时升级失败，旧进程继续正常服务
+*/
+class HotUpgrade {
+public:
+    static const int MAX_LISTENERS = 128;       // 一次最多传递的监听 socket 数量
+
+private:
+    static std::string m_exe;                   // 启动时的可执行文件路径
+    static char** m_argv;                       // 启动参数，新进程使用相同的参数
+    static int m_channel;                       // 新进程中和旧进程通信的 socket，回复之后关闭
+    static cpu_set_t m_affinity;                // 启动时的 CPU 亲和性集合，主线程绑定 CPU 之后新进程仍然使用它
+
+public:
+    // 记录可执行文件路径、启动参数和 CPU 亲和性集合，在 main() 开始时调用
+    static void init(char* argv[]);
+
+    // 新进程接收旧进程传来的监听 socket，返回数量，不是由旧进程启动时返回 0，出错时返回 -1
+    static int inherit(int* fds, int max);
+
+    // 新进程已经开始监听，通知旧进程停止 accept，不是由旧进程启动时什么也不做
+    static void ready();
+
+    // 旧进程启动新进程并发送 count 个监听 socket，返回等待回复的 socket，失败时返回 -1，pid 返回新进程的进程号
+    static int spawn(const int* fds, int count, pid_t* pid);
+};
+
+#endif
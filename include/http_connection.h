@@ -19,17 +19,43 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <atomic>
+#include <string>
 #include "locker.h"
+#include "file_cache.h"
+#include "chain_buffer.h"
+#include "http_scanner.h"
+#include "http_request.h"
+#include "gzip_cache.h"
+#include "http_date.h"
+#include "http_response.h"
+#include "server_stats.h"
+#include "access_log.h"
+#include "admission_control.h"
+
+// 默认的网站根目录，编译时可以通过 -DDOC_ROOT 指定（CMake 构建时为源码中的 resources 目录），运行时可以用 -d 参数覆盖
+#ifndef DOC_ROOT
+#define DOC_ROOT "/home/utopianyouth/webserver/resources"
+#endif
 
 // 任务类，每一个对象处理客户端的一个 HTTP 请求
 class HttpConnection {
 public:
-    static int m_epoll_fd;      // 所有客户端通信对应 socket 上的事件都被注册到同一个 epoll 对象中，所以设置成静态的
-    static int m_user_count;    // 统计客户端的数量
+    static std::atomic<int> m_user_count;   // 统计客户端的数量，reactor 线程和工作线程（关闭连接时）都会修改
+    static std::atomic<bool> m_draining;    // 升级时旧进程正在排空连接，之后的响应都不保持连接
+    static int m_read_limit;    // 每个连接最多缓存的请求数据字节数（请求头和请求体），超过时关闭连接
+    static std::string m_doc_root;  // 网站的根目录，不以 '/' 结尾
 
-    static const int READ_BUFFER_SIZE = 4096;   // 读缓冲区大小
+    static const int DEFAULT_READ_LIMIT = 64 * 1024;    // 默认每个连接最多缓存的请求数据字节数
     static const int WRITE_BUFFER_SIZE = 2048;  // 写缓冲区大小
     static const int FILENAME_LEN = 200;        // 文件名的最大长度
+    static const size_t MAX_SENDFILE_CHUNK = 0x7ffff000;    // 单次 sendfile() 最多发送的字节数（内核的上限）
+    static const int MAX_PIPELINE = 16;         // 流水线请求一批最多排队的响应数量
+    static const int RESPONSE_RESERVE = 512;    // 生成一个响应至少需要的写缓冲区剩余空间
+    static const int MAX_RANGES = 8;            // 一个范围请求最多的范围数量，超过时忽略 Range 发送整个文件
+    static const int PART_HEADER_RESERVE = 160; // multipart/byteranges 响应中每个部分的分隔行和部分头部需要的写缓冲区空间
+    static const int MAX_CACHE_POLICIES = 16;   // 最多配置的按扩展名的缓存策略数量
 
     // HTTP 请求方法，目前只支持 GET
     enum METHOD {
@@ -64,6 +90,10 @@ public:
         - NO_RESOURCE: 表示服务器没有资源
         - FORBIDDEN_REQUEST: 表示客户端对资源没有足够的访问权限
         - FILE_REQUEST: 文件请求，获取文件成功
+        - NOT_MODIFIED: 条件请求，客户端缓存的副本仍然有效
+        - RANGE_NOT_SATISFIABLE: 范围请求中没有一个范围落在文件内
+        - STATS_REQUEST: 请求的是保留的 STATS_URL，输出服务器运行指标，不访问网站根目录
+        - NOT_IMPLEMENTED: 请求使用了服务器不支持的 Transfer-Encoding，无法确定请求体的边界
         - INTERNAL_ERROR: 表示服务器内部错误
         - CLOSED_CONNECTION: 表示客户端已经关闭连接了
     */
@@ -74,6 +104,10 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        NOT_MODIFIED,
+        RANGE_NOT_SATISFIABLE,
+        STATS_REQUEST,
+        NOT_IMPLEMENTED,
         INTERNAL_ERROR,
         CLOSED_CONNECTION
     };
@@ -91,9 +125,20 @@ public:
     };
 
 private:
+    // 按扩展名配置的缓存策略
+    struct CachePolicy {
+        char suffix[16];        // 扩展名，包括 '.'
+        char header[48];        // 生成好的 Cache-Control 响应头，max-age 为 0 时是 no-cache（每次都需要验证）
+        int header_len;         // 响应头的长度，0 表示不发送 Cache-Control
+    };
+    static CachePolicy m_cache_policies[MAX_CACHE_POLICIES];
+    static int m_cache_policy_count;
+    static CachePolicy m_default_policy;    // 没有匹配的扩展名时使用的策略
+
+    int m_epoll_fd;             // 客户端通信对应 socket 上的事件注册到的 epoll 对象（接受该连接的 reactor 的 epoll 对象）
     int m_sockfd;               // 客户端 HTTP 连接对应的文件描述符
     struct sockaddr_in m_client_addr;   // 客户端通信的 socket 地址
-    char m_read_buf[READ_BUFFER_SIZE];  // 读缓冲区
+    ChainBuffer m_read_buf;     // 读缓冲区，由分片池中的分片组成，没有待处理的数据时不持有分片
     int m_read_index;           // 记录从读缓冲区已经读取的数据字节的下一个位置
     int m_checked_index;        // 当前正在分析的字符，在读缓冲区的位置
     int m_start_line;           // 当前正在解析的行的起始位置
@@ -101,55 +146,144 @@ private:
     CHECK_STATE m_check_state;  // 主状态机当前所处的状态
     METHOD m_method;            // 请求方法
 
-    char m_real_file[FILENAME_LEN];     // 客户端请求目标文件的完整路径，其内容等于 doc_root + m_url, doc_root 是网站的根目录
-    char* m_url;                // 请求目标文件的文件名
-    char* m_version;            // HTTP 协议版本，只支持 HTTP1.1
-    char* m_host;               // 主机名
+    HttpRequest m_request;      // 当前请求的请求行和请求头，指向读缓冲区，不拷贝数据
     long long m_content_length; // HTTP 请求体对应的总长度
     bool m_keep_alive;          // HTTP 请求是否要求保持连接
+    bool m_gzip;                // 响应体是 gzip 压缩的变体
+    bool m_vary;                // 响应随 Accept-Encoding 变化（可以压缩的资源），需要添加 Vary 响应头
+
+    // 范围请求中的一个范围，first 和 last 都包含在内
+    struct ByteRange {
+        off_t first;
+        off_t last;
+    };
+    ByteRange m_ranges[MAX_RANGES];     // 当前请求要求的范围，按照请求中的顺序
+    int m_range_count;          // 范围的数量，0 表示发送整个文件
+    bool m_deferred;            // 发送队列放不下当前请求的响应，已经解析完毕的请求推迟到队列发送完毕后再生成响应
 
-    char m_write_buf[WRITE_BUFFER_SIZE];    // 写缓冲区
-    int m_write_index;          // 写缓冲区中待发送的字节数
-    char* m_file_address;       // 客户请求的目标文件被 mmap 到内存中的起始位置
-    struct stat m_file_stat;    // 目标文件的状态，通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];       // 我们将采用 writev 来执行写操作，所以定义下面两个成员，其中 m_iv_count 表示被写内存块的数量
-    int m_iv_count;
+    int m_request_start;        // 当前正在解析的请求在读缓冲区中的起始位置，之前的数据都已经处理完毕
 
-    int bytes_to_send;          // 将要发送的数据的字节数
-    int bytes_have_send;        // 已经发送的字节数
+    FileEntry* m_file_entry;    // 当前请求从文件缓存中借用的目标文件缓存项（包含文件的状态信息和内存映射），生成响应后转交给发送队列
+
+    /*
+        排队等待发送的响应数据块，流水线上的多个响应按照请求的顺序排列
+        - 内存块：写缓冲区中的响应头或者文件缓存中的内存映射，相邻的内存块合并成一次 sendmsg() 发送
+        - 文件区间：没有内存映射的大文件，通过 sendfile() 从文件描述符直接发送
+    */
+    struct OutChunk {
+        const char* base;       // 内存块的起始地址，文件区间为 NULL
+        int fd;                 // 文件区间对应的文件描述符
+        off_t offset;           // 已经发送到的位置（内存块为相对 base 的偏移，文件区间为文件偏移）
+        off_t end;              // 结束位置
+    };
+
+    /*
+        发送队列和写缓冲区，只在有响应等待发送时从分片池中申请，全部发送完毕后归还
+        空闲的 keep-alive 连接只保留下面这些很小的状态
+    */
+    struct OutQueue {
+        OutChunk chunks[MAX_PIPELINE * 2];      // 一个响应最多两个数据块（响应头 + 响应体）
+        FileEntry* entries[MAX_PIPELINE];       // 排队的响应借用的文件缓存项，全部发送完毕后归还
+        char write_buf[WRITE_BUFFER_SIZE];      // 写缓冲区，依次存放排队的响应的状态行和响应头
+        struct iovec iov[MAX_PIPELINE * 2];     // io_uring 后端提交的 sendmsg() 的内存块，内核完成发送之前不能修改
+        struct msghdr msg;
+    };
+    static_assert(sizeof(OutQueue) <= SlicePool::SLICE_SIZE, "OutQueue must fit in one slice");
+    static_assert(2 * MAX_RANGES + 2 <= MAX_PIPELINE * 2, "an empty queue must hold a multipart response");
+    static_assert(RESPONSE_RESERVE + (MAX_RANGES + 1) * PART_HEADER_RESERVE <= WRITE_BUFFER_SIZE, "an empty write buffer must hold a multipart response");
+
+    OutQueue* m_out;            // 发送队列，没有待发送的响应时为 NULL
+    int m_write_index;          // 写缓冲区中已经写入的字节数
+    int m_chunk_count;          // 排队的数据块数量
+    int m_chunk_index;          // 第一个没有发送完毕的数据块
+    int m_entry_count;          // 排队的文件缓存项数量
+    bool m_close_after;         // 排队的最后一个响应不保持连接，发送完毕后关闭连接
+    bool m_more_requests;       // 因为响应队列已满而停止解析，发送完毕后还需要处理读缓冲区中剩余的请求
+    std::string m_stats_body;   // 排队的运行指标响应的响应体，一批响应中最多一个，发送完毕后释放
+    long long m_write_start;    // 这一批响应中第一个响应放入发送队列的时间（纳秒），0 表示没有被抽中计时
+    long long m_dispatch_ns;    // 交给线程池的时间（纳秒），用来统计排队等待的时间和准入控制
+
+    off_t bytes_to_send;        // 将要发送的数据的字节数，文件可能超过 2 GB，使用 64 位
+    off_t m_response_start;     // 当前响应放入发送队列之前的 bytes_to_send，用来计算访问日志中响应的字节数
+
+    int m_worker;               // 上一次处理该连接的工作线程编号（工作窃取线程池使用），-1 表示还没有被处理过
 
 public:
     HttpConnection();
     ~HttpConnection();
-    void init(int sockfd, const sockaddr_in& client_addr);      // 初始化新接收的客户端连接
+    static void setReadLimit(int limit) { m_read_limit = limit; }   // 设置每个连接最多缓存的请求数据字节数，需要在启动 reactor 之前调用
+    static bool setDocRoot(const char* path);       // 设置网站的根目录，不存在、不是目录或者路径过长时返回 false，需要在启动 reactor 之前调用
+    static bool addCachePolicy(const char* spec);   // 添加缓存策略 ".css=86400"，"*=60" 表示其它文件，需要在启动 reactor 之前调用
+    void init(int sockfd, const sockaddr_in& client_addr, int epoll_fd);    // 初始化新接收的客户端连接
     void closeConnection();     // 关闭客户端的连接
     void process();             // 响应并且处理客户端的请求
+    bool processInline();       // 在 reactor 线程中处理客户端的请求并立即发送响应，返回 false 表示需要关闭连接
     bool read();                // 非阻塞读
-    bool write();               // 非阻塞写
-    void clearBuffer();         // 线程池工作队列满，丢弃 HttpConnection 对象
+    bool write();               // 非阻塞写，排队的响应全部发送完毕且不需要保持连接时返回 false
+    bool hasBufferedRequest() const { return this->m_more_requests && (this->m_chunk_count == 0); }  // 响应发送完毕后读缓冲区中是否还有待处理的请求
+    int getWorker() const { return this->m_worker; }        // 获取上一次处理该连接的工作线程
+    void setWorker(int worker) { this->m_worker = worker; } // 记录处理该连接的工作线程
+    void markDispatched(long long now) { this->m_dispatch_ns = now; }  // 交给线程池之前调用，记录开始排队的时间
+    void rejectOverloaded();    // 线程池过载，不处理读缓冲区中的请求，直接发送 503 响应（之后由调用者关闭连接）
+    const HttpRequest& getRequest() const { return this->m_request; }  // 当前正在处理的请求
+
+    /*
+        io_uring 后端使用的接口，请求在 reactor 线程中处理，socket 不注册到 epoll 对象中（init() 的 epoll_fd 为 -1）
+        - 接收：recv 完成时通过 appendInput() 把数据追加到读缓冲区，再调用 prepareResponses() 生成响应
+        - 发送：nextSend() 给出下一批要提交的数据，完成后用 consumeChunks() 推进发送队列，全部发送完毕后调用 finishWrite()
+    */
+    bool appendInput(const char* data, int len);    // 追加收到的数据，缓存的数据已经达到上限或者内存不足时返回 false
+    bool prepareResponses();                        // 解析读缓冲区中所有完整的请求，并把它们的响应依次放入发送队列
+    bool hasPendingOutput() const { return this->m_chunk_index < this->m_chunk_count; }    // 发送队列中是否还有没有发送的数据
+    const struct msghdr* nextSend(int* fd, off_t* offset, off_t* count);  // 当前位置开始的连续内存块（没有时返回 NULL），fd 返回紧随其后的文件区间（没有时为 -1）
+    void consumeChunks(off_t bytes);                // 根据发送的字节数推进发送队列
+    bool finishWrite();                             // 排队的响应全部发送完毕，归还发送队列，不需要保持连接时返回 false
 
 private:
     void init();                                    // 初始化其余的数据
+    void initRequest();                             // 一个请求处理完毕，初始化解析下一个请求需要的数据
+    void compactReadBuffer();                       // 丢弃读缓冲区中已经处理完毕的请求数据
+    bool canQueueResponse() const;                  // 发送队列和写缓冲区是否还能容纳一个响应
+    bool canQueueFile() const;                      // 发送队列和写缓冲区是否能容纳当前文件请求的响应（包括多段范围响应）
+    void releaseEntries();                          // 归还发送队列借用的文件缓存项
+    bool acquireOutQueue();                         // 从分片池中申请发送队列，内存不足时返回 false
+    void releaseOutQueue();                         // 归还发送队列
+    void queueChunk(const char* base, int fd, off_t offset, off_t end);   // 把一个数据块放入发送队列
     HTTP_CODE processRead();                        // 解析 HTTP 请求
     bool processWrite(HTTP_CODE ret);               // 写 HTTP 响应
+    bool processRangeWrite();                       // 写 206 范围响应
+    bool processStatsWrite();                       // 写运行指标响应
+    void queueFileRange(off_t offset, off_t end);   // 把当前文件的 [offset, end) 放入发送队列
+    void logResponse(int status);                   // 响应已经放入发送队列，记录状态码计数和访问日志
 
     // 下面这一组函数被 process_read 调用以分析 HTTP 请求
-    HTTP_CODE parseRequestLine(char* text);       // 解析请求首行
-    HTTP_CODE parseRequestHeaders(char* text);    // 解析请求头
-    HTTP_CODE parseRequestContent(char* text);    // 解析请求体    
-    HTTP_CODE GetRequestFile();                   // 解析成功 HTTP 请求，将对应的请求资源映射到内存中
-    char* getLine() { return this->m_read_buf + this->m_start_line; }  // 获取一行数据
+    HTTP_CODE parseRequestLine(char* text, int len);    // 解析请求首行，len 为请求行的长度
+    HTTP_CODE parseRequestHeaders(char* text, int len); // 解析一个请求头，len 为请求头的长度
+    HTTP_CODE finishHeaders();                    // 请求头解析完毕，确定是否保持连接和请求体的长度
+    bool ifRangeMatches() const;                  // If-Range 条件是否满足（没有 If-Range 时满足）
+    bool notModified() const;                     // If-None-Match / If-Modified-Since 条件是否表示客户端的副本仍然有效
+    int parseRanges(off_t size);                  // 解析 Range，返回范围数量，0 表示忽略 Range，-1 表示没有可以满足的范围
+    HTTP_CODE parseRequestContent();              // 解析请求体（只判断是否被完整读入）
+    HTTP_CODE finishRequest(long long parse_start);   // 一个请求解析完毕，记录解析耗时，处理运行指标请求或者查找文件
+    HTTP_CODE GetRequestFile();                   // 解析成功 HTTP 请求，从文件缓存中借用对应请求资源的内存映射
+    HTTP_CODE checkNotModified(const char* path); // 没有命中文件缓存的条件请求只用 stat() 的结果判断是否返回 304
+    char* getLine() { return this->m_read_buf.line(this->m_start_line, this->m_checked_index); }  // 获取一行数据（跨越分片时拷贝成连续的一行）
     LINE_STATUS parseLineData();                       // 获取 HTTP 请求的一行数据   
 
     // 填充 HTTP 响应
-    void unmap();                                           // 释放内存映射 
-    bool addResponse(const char* format, ...);              // 添加响应内容（通用函数）
-    bool addContent(const char* content);                   // 添加响应体
-    bool addContentType();                                  // 添加响应类型
-    bool addStatusLine(int status_num, const char* status_content);   // 添加响应状态行
-    void addHeaders(int content_length);                    // 添加响应头
-    bool addContentLength(int content_length);              // 添加响应体长度
+    void unmap();                                           // 归还当前请求和发送队列借用的所有文件缓存项
+    bool addResponse(std::string_view text);                // 添加响应内容（通用函数），直接拷贝预先生成的片段
+    bool addNumber(long long value);                        // 添加十进制整数
+    bool addContent(std::string_view content);              // 添加响应体
+    bool addContentType(std::string_view content_type);     // 添加响应类型（完整的 Content-Type 响应头）
+    bool addStatusLine(std::string_view status_line);       // 添加响应状态行
+    bool addHeaders(off_t content_length, std::string_view content_type);   // 添加响应头
+    bool addContentLength(off_t content_length);            // 添加响应体长度
+    bool addContentRange(off_t first, off_t last, off_t size);  // 添加 Content-Range，first 为 -1 时表示 bytes */size
     bool addKeepAlive();                                    // 添加是否保持连接
+    bool addContentEncoding();                              // 添加内容编码和 Vary
+    bool addValidators();                                   // 添加 ETag、Last-Modified 和 Cache-Control
+    std::string_view originalPath() const;                  // 当前文件的原始路径（gzip 变体去掉 .gz）
     bool addBlankLine();                                    // 添加响应空白行
 };
 
@@ -0,0 +1,20 @@
+#ifndef HTTPDATE_H
+#define HTTPDATE_H
+
+#include <time.h>
+#include <string_view>
+
+/*
+    HTTP 日期（RFC 7231 7.1.1.1），只处理 IMF-fixdate 格式，例如 Sun, 06 Nov 1994 08:49:37 GMT
+    RFC 850 和 asctime() 两种过时的格式不再被现代客户端发送，解析失败时调用者按照日期不匹配处理
+*/
+
+const int HTTP_DATE_LEN = 29;       // IMF-fixdate 的长度，不包括 '\0'
+
+// 解析 HTTP 日期，成功时把对应的 UTC 时间写入 t
+bool parseHttpDate(std::string_view text, time_t* t);
+
+// 把 UTC 时间格式化成 HTTP 日期，buf 至少 HTTP_DATE_LEN + 1 字节，不受 locale 影响
+void formatHttpDate(time_t t, char* buf);
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef HTTPREQUEST_H
+#define HTTPREQUEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+/*
+    常用的请求头，解析时通过编译期生成的完美哈希表把头部字段名映射到编号
+    - 增加新的请求头时在 HEADER_ID 和 HEADER_NAMES 中按照相同的顺序添加（名称使用小写）
+    - 编号同时是 HttpRequest::m_present 中的位，最多 32 个
+*/
+enum HEADER_ID {
+    HDR_HOST = 0,
+    HDR_CONNECTION,
+    HDR_PROXY_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_TRANSFER_ENCODING,
+    HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_USER_AGENT,
+    HDR_REFERER,
+    HDR_COOKIE,
+    HDR_CACHE_CONTROL,
+    HDR_PRAGMA,
+    HDR_IF_MATCH,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_UNMODIFIED_SINCE,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_EXPECT,
+    HDR_UPGRADE,
+    HDR_ORIGIN,
+    HDR_AUTHORIZATION,
+    HDR_X_FORWARDED_FOR,
+    HDR_COUNT,
+    HDR_UNKNOWN = HDR_COUNT
+};
+
+constexpr std::string_view HEADER_NAMES[HDR_COUNT] = {
+    "host",
+    "connection",
+    "proxy-connection",
+    "content-length",
+    "content-type",
+    "transfer-encoding",
+    "accept",
+    "accept-encoding",
+    "accept-language",
+    "user-agent",
+    "referer",
+    "cookie",
+    "cache-control",
+    "pragma",
+    "if-match",
+    "if-none-match",
+    "if-modified-since",
+    "if-unmodified-since",
+    "range",
+    "if-range",
+    "expect",
+    "upgrade",
+    "origin",
+    "authorization",
+    "x-forwarded-for"
+};
+
+static_assert(HDR_COUNT <= 32, "header ids must fit in the presence mask");
+
+constexpr int HEADER_HASH_SIZE = 128;   // 完美哈希表的大小，必须是 2 的幂
+
+/*
+    头部字段名的哈希值，FNV-1a，大写字母按照小写计算
+    头部字段名只包含字母、数字和 '-'，c | 0x20 就能把大写字母变成小写，其它字符不变
+*/
+constexpr uint32_t headerHash(std::string_view name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < name.size(); ++i) {
+        hash ^= (unsigned char)(name[i] | 0x20);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+// 完美哈希表：槽位中是请求头编号，-1 表示空槽位
+struct HeaderHashTable {
+    uint32_t seed;
+    signed char slots[HEADER_HASH_SIZE];
+};
+
+// 编译期从 1 开始依次尝试种子，直到所有常用请求头落在不同的槽位中
+constexpr HeaderHashTable buildHeaderHashTable() {
+    HeaderHashTable table = {};
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        bool perfect = true;
+        for (int i = 0; i < HEADER_HASH_SIZE; ++i) {
+            table.slots[i] = -1;
+        }
+        for (int id = 0; id < HDR_COUNT; ++id) {
+            uint32_t slot = headerHash(HEADER_NAMES[id], seed) & (HEADER_HASH_SIZE - 1);
+            if (table.slots[slot] != -1) {
+                perfect = false;
+                break;
+            }
+            table.slots[slot] = (signed char)id;
+        }
+        if (perfect) {
+            table.seed = seed;
+            return table;
+        }
+    }
+    table.seed = 0;
+    return table;
+}
+
+constexpr HeaderHashTable HEADER_HASH_TABLE = buildHeaderHashTable();
+static_assert(HEADER_HASH_TABLE.seed != 0, "no perfect hash seed found for the header names");
+
+/*
+    解析出的 HTTP 请求，所有字段都是指向读缓冲区的 string_view，不拷贝数据，也不申请内存
+    - 请求行：方法、请求目标和版本
+    - 常用的请求头按照编号存放，O(1) 查找；其它请求头按照出现的顺序存放在内嵌的小数组中，放满之后忽略
+    - 同一个常用请求头出现多次时保留第一次出现的值，值不同时记录下来，
+      影响请求边界的请求头（Content-Length）出现不同的值时由调用者拒绝请求，防止请求走私
+    - string_view 在当前请求处理完毕（HttpConnection::initRequest()）之前有效，读缓冲区移动数据时通过 relocate() 同步移动
+*/
+class HttpRequest {
+public:
+    static const int MAX_EXTRA_HEADERS = 8;     // 最多保存的其它请求头数量
+
+    // 一个请求头
+    struct Header {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    HttpRequest() { this->clear(); }
+
+    // 清空上一个请求的内容
+    void clear() {
+        this->m_method = std::string_view();
+        this->m_target = std::string_view();
+        this->m_version = std::string_view();
+        this->m_present = 0;
+        this->m_conflicts = 0;
+        this->m_extra_count = 0;
+    }
+
+    void setRequestLine(std::string_view method, std::string_view target, std::string_view version) {
+        this->m_method = method;
+        this->m_target = target;
+        this->m_version = version;
+    }
+    void setTarget(std::string_view target) { this->m_target = target; }
+    std::string_view method() const { return this->m_method; }
+    std::string_view target() const { return this->m_target; }
+    std::string_view version() const { return this->m_version; }
+
+    // 添加一个请求头，name 和 value 已经去掉了两端的空白字符
+    void addHeader(std::string_view name, std::string_view value);
+
+    // 请求中是否有该请求头
+    bool hasHeader(HEADER_ID id) const { return (this->m_present >> id) & 1; }
+
+    // 该请求头是否出现了多次并且值不同
+    bool conflicting(HEADER_ID id) const { return (this->m_conflicts >> id) & 1; }
+
+    // 常用请求头的值，没有该请求头时返回空的 string_view
+    std::string_view header(HEADER_ID id) const {
+        return this->hasHeader(id) ? this->m_known[id] : std::string_view();
+    }
+
+    // 按照名称查找请求头（不区分大小写），常用请求头 O(1)，其它请求头遍历内嵌的小数组
+    std::string_view header(std::string_view name) const;
+
+    // 其它请求头
+    int extraCount() const { return this->m_extra_count; }
+    const Header& extraHeader(int index) const { return this->m_extra[index]; }
+
+    // 读缓冲区把 [begin, end) 之间的数据向前移动了 offset 字节，指向这段数据的 string_view 同步移动
+    void relocate(const char* begin, const char* end, size_t offset);
+
+    // 头部字段名对应的编号（不区分大小写），不是常用请求头时返回 HDR_UNKNOWN
+    static HEADER_ID lookupHeader(std::string_view name) {
+        int slot = HEADER_HASH_TABLE.slots[headerHash(name, HEADER_HASH_TABLE.seed) & (HEADER_HASH_SIZE - 1)];
+        if ((slot >= 0) && equalsLower(name, HEADER_NAMES[slot])) {
+            return (HEADER_ID)slot;
+        }
+        return HDR_UNKNOWN;
+    }
+
+    // 两个字符串是否相等，不区分大小写，lower 必须是小写
+    static bool equalsLower(std::string_view text, std::string_view lower) {
+        if (text.size() != lower.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < text.size(); ++i) {
+            char c = text[i];
+            if ((c >= 'A') && (c <= 'Z')) {
+                c += 'a' - 'A';
+            }
+            if (c != lower[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::string_view m_method;              // 请求方法
+    std::string_view m_target;              // 请求目标（去掉了 http://host 前缀）
+    std::string_view m_version;             // HTTP 协议版本
+    uint32_t m_present;                     // 出现过的常用请求头，第 id 位表示 HEADER_ID 为 id 的请求头
+    uint32_t m_conflicts;                   // 重复出现并且值和第一次不同的常用请求头，按位表示
+    std::string_view m_known[HDR_COUNT];    // 常用请求头的值，只有 m_present 中对应的位为 1 时有效
+    Header m_extra[MAX_EXTRA_HEADERS];      // 其它请求头
+    int m_extra_count;
+};
+
+#endif
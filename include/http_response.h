@@ -0,0 +1,92 @@
+#ifndef HTTPRESPONSE_H
+#define HTTPRESPONSE_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <string_view>
+
+/*
+    预先生成的响应片段，生成响应时只需要 memcpy，不再逐行调用 vsnprintf()
+    - 状态行和固定的响应头是编译期常量
+    - Content-Type 响应头按照扩展名从编译期的 MIME 类型表中选择
+    - 400、403、404、500、501、503 这类不依赖请求的错误响应整个预先生成，直接作为只读数据块放入发送队列
+*/
+
+// 状态行
+constexpr std::string_view STATUS_200 = "HTTP/1.1 200 OK\r\n";
+constexpr std::string_view STATUS_206 = "HTTP/1.1 206 Partial Content\r\n";
+constexpr std::string_view STATUS_304 = "HTTP/1.1 304 Not Modified\r\n";
+constexpr std::string_view STATUS_416 = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+
+// 固定的响应头
+constexpr std::string_view HEADER_KEEP_ALIVE = "Connection: keep-alive\r\n";
+constexpr std::string_view HEADER_CLOSE = "Connection: close\r\n";
+constexpr std::string_view HEADER_ACCEPT_RANGES = "Accept-Ranges: bytes\r\n";
+constexpr std::string_view HEADER_GZIP = "Content-Encoding: gzip\r\n";
+constexpr std::string_view HEADER_VARY = "Vary: Accept-Encoding\r\n";
+constexpr std::string_view HEADER_CRLF = "\r\n";
+constexpr std::string_view HEADER_NO_STORE = "Cache-Control: no-store\r\n";
+constexpr std::string_view HEADER_METRICS_TYPE = "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";     // Prometheus 文本格式
+
+constexpr std::string_view ERROR_416_FORM = "The requested range is not satisfiable.\n";
+
+constexpr int RETRY_AFTER_SECONDS = 1;      // 过载时 503 响应建议客户端重试的等待时间（秒）
+
+// 扩展名对应的 Content-Type 响应头
+struct MimeType {
+    std::string_view extension;     // 扩展名（小写，不包括 '.'）
+    std::string_view header;        // 完整的 Content-Type 响应头，也用作 multipart/byteranges 的部分头部
+};
+
+#define MIME_TYPE(extension, type) { extension, "Content-Type: " type "\r\n" }
+
+constexpr MimeType MIME_TYPES[] = {
+    MIME_TYPE("html", "text/html; charset=utf-8"),
+    MIME_TYPE("htm", "text/html; charset=utf-8"),
+    MIME_TYPE("css", "text/css; charset=utf-8"),
+    MIME_TYPE("js", "text/javascript; charset=utf-8"),
+    MIME_TYPE("mjs", "text/javascript; charset=utf-8"),
+    MIME_TYPE("json", "application/json"),
+    MIME_TYPE("txt", "text/plain; charset=utf-8"),
+    MIME_TYPE("md", "text/markdown; charset=utf-8"),
+    MIME_TYPE("csv", "text/csv; charset=utf-8"),
+    MIME_TYPE("xml", "application/xml"),
+    MIME_TYPE("png", "image/png"),
+    MIME_TYPE("jpg", "image/jpeg"),
+    MIME_TYPE("jpeg", "image/jpeg"),
+    MIME_TYPE("gif", "image/gif"),
+    MIME_TYPE("webp", "image/webp"),
+    MIME_TYPE("avif", "image/avif"),
+    MIME_TYPE("svg", "image/svg+xml"),
+    MIME_TYPE("ico", "image/x-icon"),
+    MIME_TYPE("bmp", "image/bmp"),
+    MIME_TYPE("woff", "font/woff"),
+    MIME_TYPE("woff2", "font/woff2"),
+    MIME_TYPE("ttf", "font/ttf"),
+    MIME_TYPE("otf", "font/otf"),
+    MIME_TYPE("mp3", "audio/mpeg"),
+    MIME_TYPE("wav", "audio/wav"),
+    MIME_TYPE("ogg", "audio/ogg"),
+    MIME_TYPE("mp4", "video/mp4"),
+    MIME_TYPE("webm", "video/webm"),
+    MIME_TYPE("pdf", "application/pdf"),
+    MIME_TYPE("zip", "application/zip"),
+    MIME_TYPE("gz", "application/gzip"),
+    MIME_TYPE("wasm", "application/wasm")
+};
+
+constexpr MimeType MIME_HTML = MIME_TYPES[0];
+constexpr MimeType MIME_DEFAULT = MIME_TYPE("", "application/octet-stream");
+
+#undef MIME_TYPE
+
+// 按照路径的扩展名（不区分大小写）查找 MIME 类型，没有扩展名或者不认识的扩展名返回 MIME_DEFAULT
+const MimeType& mimeType(std::string_view path);
+
+// 把非负整数格式化成十进制写入 buf（至少 20 字节，不写 '\0'），返回长度
+int formatDecimal(unsigned long long value, char* buf);
+
+// 预先生成的完整错误响应，status 是 400、403、404、500、501 或 503（带 Retry-After），其它状态返回 500 的响应；返回的数据在进程退出之前有效且只读
+const struct iovec& errorResponse(int status, bool keep_alive);
+
+#endif
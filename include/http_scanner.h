@@ -0,0 +1,39 @@
+#ifndef HTTPSCANNER_H
+#define HTTPSCANNER_H
+
+/*
+    HTTP 请求的向量化字符扫描，在一段连续的数据中查找两个字符中任意一个第一次出现的位置
+    - 行结束符 '\r' / '\n' 和请求行中的分隔符 ' ' / '\t' 都通过它查找，一次比较 16 字节（SSE4.2）或 32 字节（AVX2）
+    - 启动时根据 CPU 支持的指令集选择最快的实现，都不支持（或者不是 x86 平台）时使用逐字节比较的标量实现
+    - 只读取 [begin, end) 之间的数据，不足一个向量的尾部逐字节比较，不会越过数据末尾读取
+    - 没有找到时返回 NULL，调用者记录已经扫描过的位置，数据分多次到达时从上次停止的位置继续扫描
+*/
+class HttpScanner {
+public:
+    // 扫描的实现，按照速度从慢到快排列
+    enum IMPL {
+        SCALAR = 0,
+        SSE42,
+        AVX2,
+        IMPL_COUNT
+    };
+
+    typedef const char* (*FindFunc)(const char* begin, const char* end, char a, char b);
+
+    // 查找行结束符 '\r' 或 '\n'
+    static const char* findLineEnd(const char* begin, const char* end) { return m_find(begin, end, '\r', '\n'); }
+
+    // 查找请求行中的分隔符 ' ' 或 '\t'
+    static const char* findDelimiter(const char* begin, const char* end) { return m_find(begin, end, ' ', '\t'); }
+
+    static IMPL impl() { return m_impl; }           // 当前使用的实现
+    static bool supported(IMPL impl);               // CPU 是否支持该实现需要的指令集
+    static bool setImpl(IMPL impl);                 // 切换实现（基准测试使用），CPU 不支持时返回 false
+    static const char* implName(IMPL impl);         // 实现的名称
+
+private:
+    static FindFunc m_find;     // 当前使用的扫描函数
+    static IMPL m_impl;
+};
+
+#endif
@@ -7,15 +7,14 @@
 #include<arpa/inet.h>
 
 #define BUFFER_SIZE 64
-class UtilTimer;        // 前向声明
-
-// 用户数据结构
-typedef struct ClientData {
-    struct sockaddr_in address;     // 客户端 socket 地址
-    int sockfd;                     // socket 文件描述符
-    UtilTimer* timer;               // 每一个客户端连接对应一个定时器
-}ClientData;
+struct ClientData;      // 前向声明
 
+// 获取单调时钟的当前时间（毫秒），定时器的超时时间都以它为基准，不受系统时间被修改的影响
+inline long long getCurrentMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
 /*
     为不活跃的客户端连接创建定时器类
@@ -27,15 +26,27 @@ class UtilTimer {
 public:
     UtilTimer* prev;    // 指向前一个定时器
     UtilTimer* next;    // 指向后一个定时器
-    time_t expire;      // 任务超时时间，这里使用绝对时间
+    long long expire;   // 任务超时时间，这里使用绝对时间（getCurrentMs() 的毫秒数）
+    int rotation;       // 时间轮：定时器在时间轮转多少圈之后到期
+    int slot;           // 时间轮：定时器所在的槽，-1 表示不在时间轮中
     ClientData* user_data;  // 客户端连接信息
 public:
-    UtilTimer() : prev(NULL), next(NULL) {}
+    UtilTimer() : prev(NULL), next(NULL), expire(0), rotation(0), slot(-1), user_data(NULL), cb_func(NULL) {}
 public:
     void(*cb_func)(ClientData*);    // 函数指针，任务回调函数，回调函数处理的客户数据，由定时器的执行者传递给回调函数
 };
 
-// 定时器链表，它是一个带有头尾节点的升序、双向链表
+// 用户数据结构
+typedef struct ClientData {
+    struct sockaddr_in address;     // 客户端 socket 地址
+    int sockfd;                     // socket 文件描述符
+    UtilTimer timer;                // 每一个客户端连接对应一个定时器，定时器结点直接内嵌在用户数据中，不需要动态申请
+}ClientData;
+
+/*
+    定时器链表，它是一个带有头尾节点的升序、双向链表（插入和调整定时器都是 O(n)，服务器已经改用 TimeWheel，保留用于性能对比）
+    和时间轮一样不负责定时器结点的内存，删除和到期只把结点从链表中摘下
+*/
 class SortTimerLst {
 private:
     UtilTimer* head;     // 头节点指针
@@ -44,7 +55,7 @@ private:
 public:
     SortTimerLst();
 
-    // 链表被销毁时，删除其中所有的定时器
+    // 链表被销毁时，摘下其中所有的定时器
     ~SortTimerLst();
 
     // 将目标定时器 Timer 添加到链表中
@@ -72,4 +83,49 @@ private:
     void addTimer(UtilTimer* timer, UtilTimer* head);
 };
 
-#endif 
\ No newline at end of file
+/*
+    时间轮（哈希时间轮），添加、删除和调整定时器都是 O(1)
+    - 时间轮有 SLOTS 个槽，每个槽是一个无序的双向链表，指针每隔 m_slot_ms 毫秒转动一个槽
+    - 超时时间在 n 个槽之后的定时器被放入 (当前槽 + n) % SLOTS 号槽，并记录需要再转多少圈（rotation）
+    - 指针转到某个槽时，遍历该槽的链表，rotation 为 0 的定时器到期，其余的 rotation 减一
+    - 时间轮不负责定时器结点的内存，结点内嵌在 ClientData 中
+*/
+class TimeWheel {
+private:
+    static const int SLOT_BITS = 9;
+    static const int SLOTS = 1 << SLOT_BITS;    // 时间轮上槽的数目
+    UtilTimer* m_slots[SLOTS];  // 每个槽的链表头结点
+    int m_cur_slot;             // 时间轮当前指向的槽
+    long long m_cur_time;       // 当前槽对应的时间（毫秒）
+    int m_slot_ms;              // 槽间隔（毫秒），即定时器的精度
+    int m_count;                // 时间轮中定时器的数量
+
+public:
+    explicit TimeWheel(int slot_ms = 100);
+
+    // 将目标定时器添加到时间轮中，定时器已经在时间轮中时先将其删除
+    void addTimer(UtilTimer* timer);
+
+    // 定时器的超时时间改变后，重新放入对应的槽中
+    void adjustTimer(UtilTimer* timer);
+
+    // 将目标定时器从时间轮中删除，定时器不在时间轮中时什么都不做
+    void delTimer(UtilTimer* timer);
+
+    // 时间轮转动到 now（毫秒），执行所有到期的定时器的回调函数
+    void tick(long long now);
+
+    // 时间轮转动到当前时间
+    void tick() { this->tick(getCurrentMs()); }
+
+    /*
+        下一次需要转动到的时间（毫秒），即下一个有定时器的槽对应的时间，时间轮为空时返回 -1
+        槽中的定时器可能还需要再转几圈，此时到了这个时间只是减少 rotation，调用者重新获取即可
+    */
+    long long nextExpire() const;
+
+    // 时间轮中定时器的数量
+    int size() const { return this->m_count; }
+};
+
+#endif
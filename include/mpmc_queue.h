@@ -0,0 +1,141 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+
+#define CACHE_LINE_SIZE 64          // CPU 缓存行大小
+
+/*
+    有界、无锁的多生产者多消费者环形队列（Dmitry Vyukov 的算法）
+    - 容量是 2 的整数次幂，构造时一次性申请所有的槽，入队和出队都不申请内存
+    - 每个槽有一个序号：序号等于入队位置时槽可写，等于入队位置 + 1 时槽中有数据可读
+    - 生产者和消费者分别通过 CAS 抢占入队位置和出队位置，两个位置放在不同的缓存行中，避免伪共享
+    - 入队时队列满返回 false，出队时队列空（或者槽已被抢占但数据还没有写入）返回 false
+*/
+template<typename T>
+class MPMCQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;   // 槽的序号
+        T data;                         // 槽中的数据
+    };
+
+    Cell* m_buffer;                     // 环形缓冲区
+    size_t m_mask;                      // 容量减一，用于取模
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_enqueue_pos;    // 下一个入队位置
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_dequeue_pos;    // 下一个出队位置
+    char m_pad[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];     // 防止出队位置和后面的数据共享缓存行
+
+public:
+    // capacity 会被向上取整为 2 的整数次幂
+    explicit MPMCQueue(size_t capacity);
+    ~MPMCQueue();
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    // 入队，队列满时返回 false
+    bool enqueue(const T& data);
+
+    // 出队，队列空时返回 false
+    bool dequeue(T& data);
+
+    // 队列的容量
+    size_t capacity() const { return this->m_mask + 1; }
+
+    // 队列是否为空（并发修改时只是一个近似值）
+    bool empty() const {
+        return this->m_enqueue_pos.load(std::memory_order_acquire) == this->m_dequeue_pos.load(std::memory_order_acquire);
+    }
+};
+
+
+template<typename T>
+MPMCQueue<T>::MPMCQueue(size_t capacity) : m_enqueue_pos(0), m_dequeue_pos(0) {
+    if (capacity == 0) {
+        throw std::exception();
+    }
+
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    this->m_mask = size - 1;
+    this->m_buffer = new Cell[size];
+
+    // 初始时第 i 个槽的序号是 i，表示可以被第 i 次入队使用
+    for (size_t i = 0; i < size; ++i) {
+        this->m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+MPMCQueue<T>::~MPMCQueue() {
+    delete[] this->m_buffer;
+}
+
+template<typename T>
+bool MPMCQueue<T>::enqueue(const T& data) {
+    Cell* cell;
+    size_t pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &this->m_buffer[pos & this->m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // 槽可写，抢占入队位置，失败时 pos 被更新为最新的入队位置
+            if (this->m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // 槽中的数据还没有被取走，队列满
+            return false;
+        }
+        else {
+            // 入队位置已经被其它生产者抢占
+            pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // 写入数据后发布序号，消费者看到序号变化时一定能看到数据
+    cell->data = data;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MPMCQueue<T>::dequeue(T& data) {
+    Cell* cell;
+    size_t pos = this->m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &this->m_buffer[pos & this->m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // 槽中有数据，抢占出队位置
+            if (this->m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // 槽中没有数据，队列空
+            return false;
+        }
+        else {
+            // 出队位置已经被其它消费者抢占
+            pos = this->m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // 取出数据后把槽的序号设置为下一圈的入队位置，槽重新变为可写
+    data = cell->data;
+    cell->sequence.store(pos + this->m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <atomic>
+#include "thread_pool.h"
+#include "work_stealing_pool.h"
+#include "http_connection.h"
+#include "lst_timer.h"
+
+class Uring;
+
+#define MAX_FD 65535                // 支持最大的文件描述符个数（最大的连接客户端数）
+#define MAX_EVENT_NUMBER 65535      // epoll 监听的最大的 IO 事件数量
+#define IDLE_TIMEOUT_MS 15000       // 默认的连接空闲超时时间（毫秒）
+#define DRAIN_TIMEOUT_MS 30000      // 升级时旧进程等待剩余连接关闭的最长时间（毫秒），超过之后直接退出
+#define DRAIN_CHECK_MS 100          // 旧进程检查连接是否已经全部关闭的间隔（毫秒）
+
+/*
+    reactor 事件循环，每个 reactor 拥有自己的 epoll 对象、监听 socket 和时间轮
+    - 单 reactor 模式（默认）：只有一个运行在主线程中的 reactor，读写 socket，请求的解析交给线程池
+    - 多 reactor 模式：每个 reactor 运行在自己的线程中，通过 SO_REUSEPORT 各自拥有一个监听 socket，
+      一个连接的读取、解析和发送都在接受它的 reactor 线程中完成，快速路径上没有任何锁
+    - 连接对象数组以文件描述符为下标，被所有 reactor 共享，一个文件描述符在同一时间只属于一个 reactor
+    - 定时不再依赖 SIGALRM：每个 reactor 有一个 timerfd，总是设置为时间轮中最早到期的时间，注册在 epoll 对象中
+    - 所有线程都屏蔽了 SIGTERM、SIGINT、SIGHUP 和 SIGUSR2，只有主 reactor 通过 signalfd 在事件循环中读取它们，信号不会中断任何线程的系统调用
+    - SIGUSR2 触发不停机升级（include/hot_upgrade.h）：新进程接管监听 socket 后，所有 reactor 进入排空状态，
+      不再 accept，之后的响应都带 Connection: close，连接全部关闭或者超过 DRAIN_TIMEOUT_MS 后事件循环结束
+    - 每个 reactor 有一个 eventfd，其它线程通过它唤醒该 reactor（通知退出）
+    - io_uring 后端（多 reactor 模式下可选）：不使用 epoll，accept 和 recv 都是多路（multishot）的，recv 由内核从提供缓冲区环中挑选缓冲区，
+      响应通过 sendmsg 和链接的 splice（文件 -> 管道 -> socket）发送，timerfd 等通过多路 poll 监听，
+      一轮事件循环中准备的所有提交队列项在下一次等待完成事件的同一个系统调用中提交
+*/
+class Reactor {
+private:
+    int m_epoll_fd;             // 当前 reactor 的 epoll 对象
+    int m_listen_fd;            // 当前 reactor 的监听 socket
+    int m_timer_fd;             // 时间轮的 timerfd，设置为下一个定时器到期的时间
+    int m_event_fd;             // 唤醒当前 reactor 的 eventfd
+    int m_signal_fd;            // 读取信号的 signalfd，只有主 reactor 创建
+    int m_notify_fd;            // 文件缓存的 inotify 文件描述符，只有主 reactor 监听
+    bool m_main;                // 是否是主 reactor（运行在主线程中，处理信号）
+    std::atomic<bool> m_stop;   // 是否结束事件循环，可能被主 reactor 设置
+    long long m_timer_armed;    // timerfd 当前设置的到期时间（毫秒），-1 表示没有设置
+    epoll_event* m_events;      // epoll_wait() 返回的 IO 事件数组
+    TimeWheel m_time_wheel;     // 时间轮，一个 TCP 连接对应一个定时器
+    ThreadPool<HttpConnection>* m_pool;     // 线程池，和 m_ws_pool 都为 NULL 时在当前 reactor 线程中直接处理请求
+    WorkStealingPool<HttpConnection>* m_ws_pool;    // 工作窃取线程池，和 m_pool 最多只有一个不为 NULL
+    Reactor** m_peers;          // 所有 reactor（主 reactor 用来通知它们退出）
+    int m_peer_count;           // reactor 的数量
+    pthread_t m_thread;         // 运行事件循环的线程
+    bool m_io_uring;            // 是否使用 io_uring 后端
+    Uring* m_uring;             // io_uring 后端运行期间使用的 io_uring（在 reactor 线程中创建）
+    int m_upgrade_fd;           // 主 reactor 等待新进程回复的 socket，-1 表示没有正在进行的升级
+    pid_t m_upgrade_pid;        // 正在启动的新进程
+    std::atomic<bool> m_drain;  // 新进程已经接管监听 socket，通知 reactor 进入排空状态，可能被主 reactor 设置
+    bool m_draining;            // 已经进入排空状态（停止 accept）
+    long long m_drain_deadline; // 排空的截止时间（毫秒）
+    UtilTimer m_drain_timer;    // 排空期间定期唤醒事件循环，检查连接是否已经全部关闭
+
+    static HttpConnection* m_users;     // 客户端的 TCP 连接任务类对象数组
+    static ClientData* m_lst_users;     // 定时器客户端信息类对象数组
+    static int m_idle_timeout;          // 连接空闲超时时间（毫秒）
+
+public:
+    /*
+        listen_fd 是当前 reactor 的监听 socket（由 reactor 负责关闭），main 表示是否是主 reactor
+        pool 和 ws_pool 是处理请求的线程池，最多指定一个，都为 NULL 表示在 reactor 线程中处理请求
+        io_uring 表示使用 io_uring 后端，只能和 reactor 线程中处理请求一起使用
+    */
+    Reactor(int listen_fd, bool main, ThreadPool<HttpConnection>* pool, WorkStealingPool<HttpConnection>* ws_pool = NULL, bool io_uring = false);
+    ~Reactor();
+
+    // 在当前线程中屏蔽由主 reactor 处理的信号，需要在创建任何线程之前由主线程调用，新线程会继承信号屏蔽字
+    static void blockSignals();
+
+    // 设置被所有 reactor 共享的连接对象数组，需要在启动 reactor 之前调用
+    static void setConnections(HttpConnection* users, ClientData* lst_users);
+
+    // 设置连接空闲超时时间（毫秒），需要在启动 reactor 之前调用
+    static void setIdleTimeout(int timeout_ms) { m_idle_timeout = timeout_ms; }
+
+    // 设置所有的 reactor，主 reactor 退出时通知它们
+    void setPeers(Reactor** peers, int count);
+
+    // 在当前线程中运行事件循环，直到收到退出通知
+    void run();
+
+    // 在新的线程中运行事件循环，cpu 不为 -1 时线程绑定到该 CPU 上
+    bool start(int cpu = -1);
+
+    // 等待新线程中的事件循环结束
+    void join();
+
+    // 通知事件循环退出，可以在其它线程中调用
+    void stop();
+
+    // 通知事件循环停止 accept，剩余的连接全部关闭后退出，可以在其它线程中调用
+    void drain();
+
+private:
+    static void* worker(void* arg);         // 线程的逻辑函数，运行事件循环
+
+    void registerEpoll();                   // 把监听 socket、timerfd 等注册到 epoll 对象中
+    void handleAccept();                    // 接受新的客户端连接
+    bool addConnection(int sockfd, const sockaddr_in& client_addr, int epoll_fd);   // 初始化新连接和它的定时器，连接数已满时关闭并返回 false
+    void handleSignal();                    // 处理 signalfd 中的信号
+    void startUpgrade();                    // 启动新进程并把所有监听 socket 交给它
+    void finishUpgrade();                   // 新进程回复或者退出，成功时通知所有 reactor 排空
+    void startDrain();                      // 停止 accept，进入排空状态
+    void checkDrain();                      // 连接全部关闭或者超过截止时间时结束事件循环，否则继续等待
+    void handleRead(int sockfd);            // 处理客户端的读事件
+    void handleWrite(int sockfd);           // 处理客户端的写事件
+    void handleRequest(int sockfd);         // 处理读缓冲区中的请求（交给线程池或者在当前线程中处理）
+    bool dispatch(HttpConnection* user, long long now);    // 把读取完数据的连接交给线程池处理，now 是开始排队的时间，队列满时返回 false
+    void closeConnection(int sockfd);       // 删除连接的定时器并关闭连接
+    void timerHandler();                    // 处理到期的定时器
+    void armTimer();                        // 把 timerfd 设置为时间轮中下一个定时器到期的时间
+
+    // io_uring 后端
+    bool runUring();                        // 运行 io_uring 事件循环，创建 io_uring 失败时返回 false
+    void handleUringEvent(int type, int fd, int res, unsigned flags);   // 处理一个完成事件
+    void armPoll(int type, int fd);         // 多路 poll 监听 timerfd 等
+    void armRecv(int sockfd);               // 多路 recv 接收客户端数据
+    void serveUring(int sockfd);            // 处理读缓冲区中的请求，有响应时开始发送
+    void sendUring(int sockfd);             // 提交发送队列中的下一批数据
+    void continueUring(int sockfd);         // 一批数据发送完成，继续发送或者处理剩余的请求
+    void closeUring(int sockfd, bool del_timer);    // 关闭连接，还有未完成的操作时推迟到它们都完成之后
+    void finishClose(int sockfd);           // 所有操作都已完成，真正关闭连接
+
+    static void cbFunc(ClientData* user_data);  // 定时器回调函数，关闭超时的连接
+    static void drainFunc(ClientData*) {}       // 排空定时器的回调函数，只用来唤醒事件循环，检查在事件循环中进行
+};
+
+#endif
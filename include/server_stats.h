@@ -0,0 +1,123 @@
+#ifndef SERVERSTATS_H
+#define SERVERSTATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+
+/*
+    服务器运行指标，通过保留的 URL STATS_URL 以 Prometheus 文本格式输出
+    - 每个线程（reactor 线程、工作线程）第一次记录时注册一个自己的分片，分片按照缓存行对齐，
+      只有所属的线程写入，计数是 relaxed 的 load + store，没有原子读改写，也不会和其它线程争用缓存行
+    - 延迟直方图按照 2 的幂分桶（第一个桶的上界是 1.024 微秒），记录时只需要一次 clz；
+      读取时钟的开销比计数大得多，每个线程每 SAMPLE_RATE 次操作才计时一次，直方图的计数是抽样的结果；
+      线程池的排队时间例外，准入控制需要每个请求的排队时间，这个直方图记录所有请求
+    - 读取时才遍历所有分片求和，读取期间可能看到某个分片中计数和直方图不完全一致的中间状态，对监控没有影响
+*/
+
+#define STATS_URL "/__stats"
+
+class ServerStats {
+public:
+    // 计数器
+    enum COUNTER {
+        ACCEPTS = 0,            // 接受的连接数
+        QUEUE_FULL,             // 线程池队列满被拒绝的请求批次
+        OVERLOAD_SHED,          // 排队时间超过准入控制目标值被拒绝的请求批次
+        TIMER_EXPIRIES,         // 空闲超时被关闭的连接数
+        BYTES_OUT,              // 发送的字节数（响应头和响应体）
+        ACCESS_LOG_DROPS,       // 访问日志队列满被丢弃的记录数
+        REQ_200,                // 各个状态码的响应数
+        REQ_206,
+        REQ_304,
+        REQ_400,
+        REQ_403,
+        REQ_404,
+        REQ_416,
+        REQ_500,
+        REQ_501,
+        REQ_503,
+        COUNTER_COUNT
+    };
+
+    // 延迟直方图
+    enum HISTOGRAM {
+        QUEUE_WAIT = 0,         // 连接交给线程池到工作线程开始处理
+        PARSE,                  // 解析完一个请求的请求行和请求头
+        FILE_LOOKUP,            // 查找文件缓存、协商压缩和条件请求
+        WRITE,                  // 第一个响应放入发送队列到整批响应发送完毕
+        HISTOGRAM_COUNT
+    };
+
+    static const int MAX_SHARDS = 512;          // 最多的分片（线程）数量，超过之后的线程不再记录
+    static const int BUCKET_SHIFT = 10;         // 第一个桶的上界是 2^10 纳秒
+    static const int BUCKETS = 26;              // 有上界的桶的数量，最后一个桶的上界约 34 秒，更大的值只计入 +Inf
+    static const unsigned SAMPLE_RATE = 16;     // 延迟的抽样间隔，必须是 2 的整数次幂
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counters[COUNTER_COUNT];
+        std::atomic<uint64_t> buckets[HISTOGRAM_COUNT][BUCKETS + 1];    // 最后一个是 +Inf 桶
+        std::atomic<uint64_t> sums[HISTOGRAM_COUNT];                    // 纳秒
+    };
+
+    static Shard* m_shards[MAX_SHARDS];
+    static std::atomic<int> m_shard_count;
+    static Shard m_discard;                     // 分片用完之后的线程写入这里，不会被读取
+
+    // 在头文件中定义并且常量初始化，其它编译单元可以直接访问线程局部存储，不需要经过初始化包装函数
+    static inline thread_local Shard* m_local = NULL;
+    static inline thread_local unsigned m_sample_tick = 0;
+
+    static Shard* registerShard();              // 为当前线程申请并注册分片
+
+    static Shard* shard() {
+        Shard* local = m_local;
+        return local ? local : registerShard();
+    }
+
+    // 只有所属线程写入，load + store 即可，读取线程看到的是某个时刻的值
+    static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    // 单调时钟的当前时间（纳秒），用于计算延迟
+    static long long now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    // 需要计时的操作开始时调用，被抽中时返回当前时间，否则返回 0（不计时）
+    static long long sampleStart() {
+        return ((++m_sample_tick & (SAMPLE_RATE - 1)) == 0) ? now() : 0;
+    }
+
+    static void add(COUNTER counter, uint64_t n = 1) {
+        bump(shard()->counters[counter], n);
+    }
+
+    // 记录一个响应的状态码
+    static void request(int status);
+
+    // 记录一次延迟（纳秒），调用者只记录 sampleStart() 抽中的操作
+    static void observe(HISTOGRAM histogram, long long ns) {
+        if (ns < 0) {
+            ns = 0;
+        }
+        int bucket = (ns >> BUCKET_SHIFT) ? 64 - __builtin_clzll((uint64_t)ns >> BUCKET_SHIFT) : 0;
+        if (bucket > BUCKETS) {
+            bucket = BUCKETS;
+        }
+        Shard* local = shard();
+        bump(local->buckets[histogram][bucket], 1);
+        bump(local->sums[histogram], (uint64_t)ns);
+    }
+
+    // 汇总所有分片，以 Prometheus 文本格式（0.0.4）追加到 out 中，connections 是当前的连接数
+    static void render(std::string* out, int connections);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SLICEPOOL_H
+#define SLICEPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "locker.h"
+
+/*
+    进程级的缓冲区分片池，连接的读缓冲区和写缓冲区都从这里申请，只在请求处理期间持有
+    - 分片大小固定为 SLICE_SIZE，从 SLAB_SIZE 大小、按照 SLAB_SIZE 对齐的 slab 中切分，
+      slab 的第一个分片存放 slab 头，分片地址向下对齐即可找到所属的 slab
+    - 每个线程有一个本地缓存，申请和归还分片通常不需要加锁，本地缓存空或满时批量和全局池交换
+    - 全局池中所有分片都空闲的 slab，超过 KEEP_WARM_SLABS 个之后通过 MADV_DONTNEED 把物理内存还给内核，
+      进程的常驻内存随着正在处理的请求数量变化，而不是随着连接数量变化
+*/
+class SlicePool {
+public:
+    static const int SLICE_SIZE = 4096;         // 分片大小
+    static const int SLICE_SHIFT = 12;          // log2(SLICE_SIZE)
+    static const int SLAB_SLICES = 64;          // 每个 slab 的分片数量，第一个分片是 slab 头
+    static const size_t SLAB_SIZE = (size_t)SLICE_SIZE * SLAB_SLICES;   // 256 KB
+    static const int KEEP_WARM_SLABS = 4;       // 全局池最多保留的全部空闲且物理内存还在的 slab 数量
+    static const int LOCAL_CACHE_SIZE = 64;     // 线程本地缓存的最大分片数量
+    static const int LOCAL_BATCH = 16;          // 本地缓存和全局池一次交换的分片数量
+
+private:
+    // slab 头，位于 slab 的第一个分片中
+    struct Slab {
+        Slab* prev;                     // 所在链表中的前后 slab
+        Slab* next;
+        int free_count;                 // 空闲分片数量
+        bool cold;                      // 物理内存是否已经通过 MADV_DONTNEED 归还
+        unsigned char free[SLAB_SLICES];    // 空闲分片的下标
+    };
+
+    Slab* m_partial;                    // 有空闲分片、物理内存还在的 slab，有已分配分片的 slab 在前面
+    Slab* m_cold;                       // 物理内存已经归还的 slab
+    int m_empty_warm;                   // m_partial 中所有分片都空闲的 slab 数量
+    size_t m_slabs;                     // 申请的 slab 总数
+    locker m_lock;                      // 互斥锁，保护全局池的数据
+
+    SlicePool();
+    ~SlicePool() {}
+
+public:
+    // 获取进程唯一的分片池对象
+    static SlicePool* getInstance();
+
+    // 申请一个分片，内存不足时返回 NULL
+    char* acquire();
+
+    // 归还一个分片，可以在申请它的线程以外的线程中归还
+    void release(char* slice);
+
+    // 申请的 slab 总数（包括物理内存已经归还的 slab）
+    size_t slabCount();
+
+private:
+    // 线程本地的分片缓存，线程退出时把缓存的分片还给全局池
+    struct LocalCache {
+        char* slices[LOCAL_CACHE_SIZE];
+        int count;
+
+        LocalCache() : count(0) {}
+        ~LocalCache();
+    };
+    static LocalCache& localCache();
+
+    int acquireBatch(char** slices, int count);     // 从全局池中批量申请分片
+    void releaseBatch(char** slices, int count);    // 批量归还分片到全局池
+    Slab* newSlab();                                // 申请一个新的 slab，调用者需持有锁
+    static Slab* slabOf(char* slice) { return (Slab*)((uintptr_t)slice & ~(uintptr_t)(SLAB_SIZE - 1)); }
+    void unlinkSlab(Slab** list, Slab* slab);       // 从链表中摘除 slab，调用者需持有锁
+    void pushSlab(Slab** list, Slab* slab, bool front);     // 把 slab 放入链表，调用者需持有锁
+};
+
+#endif
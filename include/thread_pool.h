@@ -4,23 +4,29 @@
 #include<pthread.h>
 #include<exception>
 #include<cstdio>
-#include<list>
+#include<sched.h>
 #include"locker.h"
-
-// 线程池类，模板参数 T 是任务类
+#include"mpmc_queue.h"
+#include"cpu_affinity.h"
+
+/*
+    线程池类，模板参数 T 是任务类
+    - 请求队列是无锁的有界 MPMC 环形队列，reactor 线程入队和工作线程出队都不需要加锁
+    - 信号量只用来让没有任务的工作线程睡眠，它的计数等于已经发布到队列中的任务数量
+*/
 template<typename T>
 class ThreadPool {
 private:
     int m_thread_number;        // 线程池中线程的数量
     pthread_t* m_threads;       // 线程池数组，大小为 m_thread_number
     int m_max_requests;         // 请求队列中，最多允许等待处理的请求数量
-    std::list<T*>m_workqueue;   // 请求队列
-    locker m_queuelocker;       // 互斥锁（防止多个线程同时访问工作队列）
-    semaphore sem_queuestat;    // 信号量（和互斥锁一起管理临界资源工作队列，防止工作队列中没有任务导致cpu资源被浪费）
+    MPMCQueue<T*> m_workqueue;  // 请求队列，容量为不小于 m_max_requests 的 2 的整数次幂
+    semaphore sem_queuestat;    // 信号量（队列中没有任务时工作线程睡眠，防止 cpu 资源被浪费）
     bool m_stop;                // 是否结束线程
 public:
     // thread_number 是线程池中线程的数量， max_requests 是请求队列中最多允许的、等待处理的请求的数量 
-    ThreadPool(int thread_number = 4, int max_requests = 10000);
+    // cpus 不为 NULL 时第 i 个线程绑定到 cpus[i % cpu_count] 上
+    ThreadPool(int thread_number = 4, int max_requests = 10000, const int* cpus = NULL, int cpu_count = 0);
 
     // 释放线程池资源
     ~ThreadPool();
@@ -39,9 +45,9 @@ private:
 
 // 初始化线程池对象，创建指定数量的线程
 template<typename T>
-ThreadPool<T>::ThreadPool(int thread_number, int max_requests) :
+ThreadPool<T>::ThreadPool(int thread_number, int max_requests, const int* cpus, int cpu_count) :
     m_thread_number(thread_number), m_max_requests(max_requests),
-    m_stop(false) {
+    m_workqueue(max_requests > 0 ? max_requests : 1), m_stop(false) {
     if (thread_number <= 0 || max_requests <= 0) {
         throw std::exception();
     }
@@ -53,10 +59,15 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests) :
         throw std::exception();
     }
 
-    // 创建 thread_number 个线程，并将它们设置为线程脱离
+    // 创建 thread_number 个线程，并将它们设置为线程脱离，需要绑定时线程一开始就运行在指定的 CPU 上
     for (int i = 0;i < thread_number;++i) {
         printf("create the %d thread.\n", i + 1);
-        if (pthread_create(this->m_threads + i, NULL, worker, this)) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        CpuAffinity::setAttr(&attr, (cpus && cpu_count > 0) ? cpus[i % cpu_count] : -1);
+        int ret = pthread_create(this->m_threads + i, &attr, worker, this);
+        pthread_attr_destroy(&attr);
+        if (ret) {
             // 线程创建失败
             delete[] this->m_threads;
             throw std::exception();
@@ -80,14 +91,10 @@ ThreadPool<T>::~ThreadPool() {
 
 template<typename T>
 bool ThreadPool<T>::append(T* request) {
-    // 将任务类对象加入请求队列，操作工作队列时一定要加锁，因为它被所有线程共享
-    this->m_queuelocker.lock();
-    if (this->m_workqueue.size() > this->m_max_requests) {
-        this->m_queuelocker.unlock();
+    // 将任务类对象加入请求队列，队列满时返回 false；入队成功后再增加信号量，唤醒一个工作线程
+    if (!this->m_workqueue.enqueue(request)) {
         return false;
     }
-    this->m_workqueue.push_back(request);
-    this->m_queuelocker.unlock();
     this->sem_queuestat.post();
     return true;
 }
@@ -106,16 +113,15 @@ void ThreadPool<T>::run() {
     while (!this->m_stop) {
         // 线程从任务队列中取出一个任务运行
         this->sem_queuestat.wait();
-        this->m_queuelocker.lock();
-        if (this->m_workqueue.empty()) {
-            // 任务队列中没有需要处理的任务对象
-            this->m_queuelocker.unlock();
-            continue;
-        }
 
-        T* request = this->m_workqueue.front();
-        this->m_workqueue.pop_front();
-        this->m_queuelocker.unlock();
+        /*
+            信号量的计数保证队列中一定有一个属于当前线程的任务，但出队位置上的槽可能已被其它生产者抢占、
+            数据还没有写入（后面的槽先发布），此时出队失败，让出 CPU 后重试，很快就能取到
+        */
+        T* request = NULL;
+        while (!this->m_workqueue.dequeue(request)) {
+            sched_yield();
+        }
 
         if (!request) {
             continue;
@@ -0,0 +1,103 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/*
+    io_uring 的最小封装，直接使用 io_uring_setup / io_uring_enter / io_uring_register 系统调用，不依赖 liburing
+    - 提交队列和完成队列通过 mmap 共享，准备好的 SQE 在下一次 submitAndWait() 时一次系统调用批量提交，同时等待完成事件
+    - 提供缓冲区环（provided buffer ring）：多路 recv 由内核从环中挑选缓冲区，用户态处理完数据后把缓冲区放回环中
+    - 一个对象只能被一个线程使用（创建时尽量指定 SINGLE_ISSUER 和 DEFER_TASKRUN），需要在使用它的线程中调用 init()
+*/
+class Uring {
+public:
+    static const int BUFFER_GROUP = 0;      // 提供缓冲区环的组号
+
+    Uring();
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    /*
+        内核是否支持服务器用到的全部功能（多路 accept / recv、提供缓冲区环、splice 等），启动时调用一次，
+        不支持时服务器退回到 epoll
+    */
+    static bool supported();
+
+    // 创建 entries 个提交队列项的 io_uring，失败返回 false
+    bool init(unsigned entries);
+
+    // 注册 count 个 size 字节的提供缓冲区（count 必须是 2 的幂），失败返回 false
+    bool setupBuffers(unsigned count, unsigned size);
+
+    // 获取一个空闲的提交队列项（已经清零），队列满时先提交已经准备好的项
+    struct io_uring_sqe* getSqe();
+
+    // 提交队列剩余的空间不足 count 项时先提交已经准备好的项，保证随后一组链接的项在同一次提交中（链接不能跨越提交）
+    void reserve(unsigned count);
+
+    // 提交所有准备好的提交队列项，并等待至少 wait_nr 个完成事件，返回值和 io_uring_enter() 相同（失败时为 -errno）
+    int submitAndWait(unsigned wait_nr);
+
+    // 下一个完成事件，没有时返回 NULL，处理完之后调用 seen()
+    struct io_uring_cqe* peekCqe();
+    void seen();
+
+    // 提供缓冲区 bid 的地址
+    char* buffer(unsigned bid) const { return this->m_buffers + (size_t)bid * this->m_buffer_size; }
+
+    // 把处理完的缓冲区放回提供缓冲区环
+    void recycleBuffer(unsigned bid);
+
+    // 填写常用的提交队列项
+    static void prepAcceptMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data);
+    static void prepRecvMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data);
+    static void prepPollMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data);
+    static void prepSendMsg(struct io_uring_sqe* sqe, int fd, const struct msghdr* msg, unsigned flags, uint64_t user_data);
+    static void prepSplice(struct io_uring_sqe* sqe, int fd_in, int64_t off_in, int fd_out, unsigned len, uint64_t user_data);
+    static void prepCancel(struct io_uring_sqe* sqe, uint64_t target, uint64_t user_data);    // 取消 user_data 为 target 的操作（多路操作也会结束）
+
+private:
+    int m_ring_fd;                  // io_uring 的文件描述符
+
+    // 提交队列
+    void* m_sq_ptr;
+    size_t m_sq_size;
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned* m_sq_array;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+    unsigned m_sqe_tail;            // 本地的提交队列尾部，submitAndWait() 时发布给内核
+    unsigned m_to_submit;           // 准备好但还没有提交的项数
+
+    // 完成队列（IORING_FEAT_SINGLE_MMAP 时和提交队列共用一块映射）
+    void* m_cq_ptr;
+    size_t m_cq_size;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    // 提供缓冲区环
+    struct io_uring_buf_ring* m_buf_ring;
+    size_t m_buf_ring_size;
+    char* m_buffers;
+    unsigned m_buffer_count;
+    unsigned m_buffer_size;
+
+    void destroy();
+
+    /*
+        提供缓冲区环的第 index 项，环就是从头开始的 io_uring_buf 数组（尾部和第 0 项的 resv 重叠）
+        不使用 io_uring_buf_ring::bufs：内核头文件中的 __DECLARE_FLEX_ARRAY 在 C++ 中展开为非空的结构体，bufs 的偏移变成 8
+    */
+    struct io_uring_buf* ringEntry(unsigned index) const { return (struct io_uring_buf*)this->m_buf_ring + index; }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef WORKSTEALINGDEQUE_H
+#define WORKSTEALINGDEQUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+#include "mpmc_queue.h"
+
+/*
+    有界的 Chase-Lev 工作窃取双端队列（按照 Lê 等人给出的 C11 内存模型版本实现）
+    - 只有拥有者线程在底部 push() 和 pop()（后进先出，刚放入的任务的数据还在缓存中）
+    - 其它线程通过 steal() 从顶部窃取（先进先出，偷走最早放入的任务）
+    - 容量是 2 的整数次幂，不会扩容，队列满时 push() 返回 false
+*/
+template<typename T>
+class WorkStealingDeque {
+private:
+    std::atomic<T>* m_buffer;           // 环形缓冲区
+    long m_mask;                        // 容量减一，用于取模
+
+    alignas(CACHE_LINE_SIZE) std::atomic<long> m_top;      // 窃取者取数据的位置
+    alignas(CACHE_LINE_SIZE) std::atomic<long> m_bottom;   // 拥有者放数据的位置
+    char m_pad[CACHE_LINE_SIZE - sizeof(std::atomic<long>)];
+
+public:
+    // capacity 会被向上取整为 2 的整数次幂
+    explicit WorkStealingDeque(size_t capacity);
+    ~WorkStealingDeque();
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 拥有者在底部放入数据，队列满时返回 false
+    bool push(const T& data);
+
+    // 拥有者从底部取出数据，队列空时返回 false
+    bool pop(T& data);
+
+    // 其它线程从顶部窃取数据，队列空时返回 false
+    bool steal(T& data);
+
+    // 队列是否为空（其它线程调用时只是一个近似值）
+    bool empty() const {
+        return this->m_bottom.load(std::memory_order_acquire) <= this->m_top.load(std::memory_order_acquire);
+    }
+};
+
+
+template<typename T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity) : m_top(0), m_bottom(0) {
+    if (capacity == 0) {
+        throw std::exception();
+    }
+
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    this->m_mask = size - 1;
+    this->m_buffer = new std::atomic<T>[size];
+}
+
+template<typename T>
+WorkStealingDeque<T>::~WorkStealingDeque() {
+    delete[] this->m_buffer;
+}
+
+template<typename T>
+bool WorkStealingDeque<T>::push(const T& data) {
+    long b = this->m_bottom.load(std::memory_order_relaxed);
+    long t = this->m_top.load(std::memory_order_acquire);
+    if (b - t > this->m_mask) {
+        return false;
+    }
+    this->m_buffer[b & this->m_mask].store(data, std::memory_order_relaxed);
+    // 数据写入之后才能让窃取者看到新的 bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    this->m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+bool WorkStealingDeque<T>::pop(T& data) {
+    // 先占住底部的数据，再检查它是否已经被窃取者拿走
+    long b = this->m_bottom.load(std::memory_order_relaxed) - 1;
+    this->m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = this->m_top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // 队列空，恢复 bottom
+        this->m_bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    data = this->m_buffer[b & this->m_mask].load(std::memory_order_relaxed);
+    if (t == b) {
+        // 只剩最后一个数据，和窃取者竞争 top
+        bool won = this->m_top.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed);
+        this->m_bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template<typename T>
+bool WorkStealingDeque<T>::steal(T& data) {
+    long t = this->m_top.load(std::memory_order_acquire);
+    while (true) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = this->m_bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+
+        data = this->m_buffer[t & this->m_mask].load(std::memory_order_relaxed);
+        if (this->m_top.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return true;
+        }
+        // 和其它窃取者或者拥有者竞争失败，t 已被更新为最新的 top，重试
+    }
+}
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <pthread.h>
+#include <exception>
+#include <cstdio>
+#include <atomic>
+#include "locker.h"
+#include "mpmc_queue.h"
+#include "work_stealing_deque.h"
+#include "cpu_affinity.h"
+
+/*
+    工作窃取线程池，模板参数 T 是任务类，接口和 ThreadPool 相同，可以替换 ThreadPool 使用
+    - 每个工作线程有一个 Chase-Lev 双端队列和一个 MPMC 收件箱，reactor 线程通过 append() 把任务放入收件箱
+    - 任务优先交给上一次处理它的工作线程（T 需要提供 getWorker() 和 setWorker()），连接的后续请求留在同一个线程的缓存中
+    - 工作线程先处理自己双端队列中的任务，队列空时把收件箱中的一批任务搬到双端队列中，
+      自己的任务都处理完后随机选择其它线程，从它的双端队列顶部（或者收件箱）窃取任务
+    - 找不到任务的工作线程在自己的信号量上睡眠，append() 只唤醒目标线程，目标线程忙碌时再唤醒一个空闲线程来窃取
+    - 绑定 CPU 时，创建线程的线程临时迁移到目标 CPU 上构造该工作线程的数据，双端队列和收件箱按照首次访问分配在它的 NUMA 结点上
+*/
+template<typename T>
+class WorkStealingPool {
+private:
+    // 一个工作线程的数据，各自独占缓存行
+    struct Worker {
+        WorkStealingDeque<T*> deque;    // 只有该线程放入和取出，其它线程从顶部窃取
+        MPMCQueue<T*> inbox;            // 其它线程交给该线程的任务
+        semaphore sem;                  // 没有任务时在上面睡眠
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> parked;     // 是否正在（或者准备）睡眠
+        WorkStealingPool* pool;
+        int index;                      // 工作线程的编号
+        unsigned seed;                  // 随机选择窃取对象的种子
+        pthread_t thread;
+
+        Worker(size_t capacity) : deque(capacity), inbox(capacity), parked(false) {}
+    };
+
+    static const int DRAIN_BATCH = 32;  // 一次从收件箱搬到双端队列中的最大任务数量
+
+    int m_thread_number;                // 线程池中线程的数量
+    int m_max_requests;                 // 每个工作线程最多允许等待处理的请求数量
+    Worker** m_workers;                 // 工作线程数组，大小为 m_thread_number
+    std::atomic<unsigned> m_next;       // 新任务（没有处理过的连接）轮流交给各个工作线程
+    std::atomic<int> m_searching;       // 正在窃取任务的工作线程数量
+    std::atomic<bool> m_stop;           // 是否结束线程
+
+public:
+    // thread_number 是线程池中线程的数量，max_requests 是每个工作线程的队列中最多允许的、等待处理的请求的数量
+    // cpus 不为 NULL 时第 i 个线程绑定到 cpus[i % cpu_count] 上
+    WorkStealingPool(int thread_number = 4, int max_requests = 10000, const int* cpus = NULL, int cpu_count = 0);
+
+    // 通知所有工作线程退出并等待它们结束
+    ~WorkStealingPool();
+
+    // 向工作队列中添加任务，所有队列都满时返回 false
+    bool append(T* request);
+
+private:
+    static void* worker(void* arg);     // 工作线程运行函数
+    void run(Worker* self);             // 不断取出任务并执行，没有任务时睡眠
+    T* findTask(Worker* self);          // 按照 自己的双端队列 -> 自己的收件箱 -> 其它线程 的顺序寻找任务
+    T* stealTask(Worker* self);         // 随机选择其它线程窃取任务
+    bool hasWork();                     // 是否还有任何线程的队列中有任务
+    void park(Worker* self);            // 没有任务时睡眠，睡眠前再检查一次，防止丢失唤醒
+    bool unpark(Worker* target);        // 唤醒正在睡眠的线程，返回 false 表示它没有在睡眠
+};
+
+
+template<typename T>
+WorkStealingPool<T>::WorkStealingPool(int thread_number, int max_requests, const int* cpus, int cpu_count) :
+    m_thread_number(thread_number), m_max_requests(max_requests),
+    m_next(0), m_searching(0), m_stop(false) {
+    if (thread_number <= 0 || max_requests <= 0) {
+        throw std::exception();
+    }
+
+    bool pinned = (cpus != NULL) && (cpu_count > 0);
+    cpu_set_t old;
+    this->m_workers = new Worker*[this->m_thread_number];
+    for (int i = 0;i < thread_number;++i) {
+        if (pinned) {
+            CpuAffinity::pinSelf(cpus[i % cpu_count], i == 0 ? &old : NULL);
+        }
+        this->m_workers[i] = new Worker(max_requests);
+        this->m_workers[i]->pool = this;
+        this->m_workers[i]->index = i;
+        this->m_workers[i]->seed = 2654435761u * (i + 1);
+    }
+    if (pinned) {
+        CpuAffinity::restoreSelf(old);
+    }
+
+    // 所有工作线程的数据都准备好之后再创建线程，窃取时会访问其它线程的数据
+    for (int i = 0;i < thread_number;++i) {
+        printf("create the %d thread.\n", i + 1);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        CpuAffinity::setAttr(&attr, pinned ? cpus[i % cpu_count] : -1);
+        int ret = pthread_create(&this->m_workers[i]->thread, &attr, worker, this->m_workers[i]);
+        pthread_attr_destroy(&attr);
+        if (ret) {
+            // 线程创建失败，结束已经创建的线程
+            this->m_stop = true;
+            for (int j = 0;j < i;++j) {
+                this->m_workers[j]->sem.post();
+                pthread_join(this->m_workers[j]->thread, NULL);
+            }
+            for (int j = 0;j < thread_number;++j) {
+                delete this->m_workers[j];
+            }
+            delete[] this->m_workers;
+            throw std::exception();
+        }
+    }
+}
+
+template<typename T>
+WorkStealingPool<T>::~WorkStealingPool() {
+    this->m_stop = true;
+    for (int i = 0;i < this->m_thread_number;++i) {
+        this->m_workers[i]->sem.post();
+    }
+    for (int i = 0;i < this->m_thread_number;++i) {
+        pthread_join(this->m_workers[i]->thread, NULL);
+    }
+    for (int i = 0;i < this->m_thread_number;++i) {
+        delete this->m_workers[i];
+    }
+    delete[] this->m_workers;
+}
+
+template<typename T>
+bool WorkStealingPool<T>::append(T* request) {
+    // 优先交给上一次处理该任务的工作线程，没有处理过的任务轮流分配
+    int target = request->getWorker();
+    if (target < 0 || target >= this->m_thread_number) {
+        target = this->m_next.fetch_add(1, std::memory_order_relaxed) % this->m_thread_number;
+    }
+
+    // 目标线程的收件箱满时依次尝试其它线程
+    int i = 0;
+    for (;i < this->m_thread_number;++i) {
+        int index = (target + i) % this->m_thread_number;
+        if (this->m_workers[index]->inbox.enqueue(request)) {
+            target = index;
+            break;
+        }
+    }
+    if (i == this->m_thread_number) {
+        return false;
+    }
+
+    // 任务发布之后再检查睡眠标志，和 park() 中设置睡眠标志之后再检查队列配对，保证不会丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->unpark(this->m_workers[target])) {
+        return true;
+    }
+
+    // 目标线程正在忙碌，没有线程在窃取任务时唤醒一个空闲线程，避免任务在忙碌的线程中排队
+    if (this->m_searching.load(std::memory_order_relaxed) == 0) {
+        for (int j = 1;j < this->m_thread_number;++j) {
+            if (this->unpark(this->m_workers[(target + j) % this->m_thread_number])) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+template<typename T>
+void* WorkStealingPool<T>::worker(void* arg) {
+    Worker* self = (Worker*)arg;
+    self->pool->run(self);
+    return self->pool;
+}
+
+template<typename T>
+void WorkStealingPool<T>::run(Worker* self) {
+    while (!this->m_stop) {
+        T* request = this->findTask(self);
+        if (!request) {
+            this->park(self);
+            continue;
+        }
+
+        // 记录处理该任务的工作线程，它的后续任务会交给当前线程
+        request->setWorker(self->index);
+        request->process();
+    }
+}
+
+template<typename T>
+T* WorkStealingPool<T>::findTask(Worker* self) {
+    T* request = NULL;
+    if (self->deque.pop(request)) {
+        return request;
+    }
+
+    // 双端队列已空，把收件箱中的一批任务搬到双端队列中，空闲的线程可以从顶部窃取它们
+    if (self->inbox.dequeue(request)) {
+        T* more = NULL;
+        for (int i = 0;i < DRAIN_BATCH && self->inbox.dequeue(more);++i) {
+            // 双端队列此时为空，但是容量由 max_requests 决定，可能小于 DRAIN_BATCH；
+            // 放满时已经取出的任务不能丢失，由当前线程直接处理，剩下的留在收件箱中
+            if (!self->deque.push(more)) {
+                more->setWorker(self->index);
+                more->process();
+                break;
+            }
+        }
+        return request;
+    }
+
+    return this->stealTask(self);
+}
+
+template<typename T>
+T* WorkStealingPool<T>::stealTask(Worker* self) {
+    if (this->m_thread_number == 1) {
+        return NULL;
+    }
+
+    this->m_searching.fetch_add(1, std::memory_order_relaxed);
+    T* request = NULL;
+
+    // 从随机的位置开始依次检查其它线程，先窃取双端队列，再窃取收件箱中还没有被搬走的任务
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 17;
+    self->seed ^= self->seed << 5;
+    int start = self->seed % this->m_thread_number;
+    for (int i = 0;i < this->m_thread_number;++i) {
+        Worker* victim = this->m_workers[(start + i) % this->m_thread_number];
+        if (victim == self) {
+            continue;
+        }
+        if (victim->deque.steal(request) || victim->inbox.dequeue(request)) {
+            break;
+        }
+        request = NULL;
+    }
+
+    this->m_searching.fetch_sub(1, std::memory_order_relaxed);
+    return request;
+}
+
+template<typename T>
+bool WorkStealingPool<T>::hasWork() {
+    for (int i = 0;i < this->m_thread_number;++i) {
+        if (!this->m_workers[i]->inbox.empty() || !this->m_workers[i]->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void WorkStealingPool<T>::park(Worker* self) {
+    self->parked.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // 设置睡眠标志后再检查一次，在此之前发布的任务一定能被看到，在此之后发布的任务一定会看到睡眠标志
+    if (this->hasWork() || this->m_stop) {
+        if (self->parked.exchange(false)) {
+            // 取消睡眠
+            return;
+        }
+        // 已经被 append() 唤醒，消耗掉对应的信号量
+    }
+    self->sem.wait();
+}
+
+template<typename T>
+bool WorkStealingPool<T>::unpark(Worker* target) {
+    if (!target->parked.load(std::memory_order_relaxed) || !target->parked.exchange(false)) {
+        return false;
+    }
+    target->sem.post();
+    return true;
+}
+
+#endif
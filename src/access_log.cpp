@@ -0,0 +1,228 @@
+#include "../include/access_log.h"
+#include "../include/server_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+AccessLog::AccessLog() : m_ring_count(0), m_enabled(false), m_stop(false), m_rotate_bytes(0), m_fd(-1), m_file_bytes(0), m_thread(0) {
+    memset(this->m_rings, 0, sizeof(this->m_rings));
+}
+
+AccessLog* AccessLog::getInstance() {
+    static AccessLog log;
+    return &log;
+}
+
+bool AccessLog::open(const char* path, size_t rotate_bytes) {
+    this->m_path = path;
+    this->m_rotate_bytes = rotate_bytes;
+    if (!this->reopen()) {
+        return false;
+    }
+
+    // 日志线程需要在程序退出前写完剩余的记录，不分离，由 close() 等待
+    if (pthread_create(&this->m_thread, NULL, worker, this) != 0) {
+        ::close(this->m_fd);
+        this->m_fd = -1;
+        return false;
+    }
+    this->m_enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void AccessLog::close() {
+    if (!this->m_thread) {
+        return;
+    }
+    this->m_enabled.store(false, std::memory_order_relaxed);
+    this->m_stop.store(true, std::memory_order_release);
+    pthread_join(this->m_thread, NULL);
+    this->m_thread = 0;
+    ::close(this->m_fd);
+    this->m_fd = -1;
+}
+
+bool AccessLog::reopen() {
+    int fd = ::open(this->m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    this->m_file_bytes = (fstat(fd, &st) == 0) ? st.st_size : 0;
+    if (this->m_fd != -1) {
+        ::close(this->m_fd);
+    }
+    this->m_fd = fd;
+    return true;
+}
+
+/*
+    队列在线程第一次写日志时申请，线程退出后也不释放：线程数量在启动时就确定了，
+    日志线程可以一直读取已经注册的队列，不需要和生产者同步队列的生命周期
+*/
+AccessLog::Ring* AccessLog::registerRing() {
+    int index = this->m_ring_count.load(std::memory_order_relaxed);
+    while (index < MAX_RINGS) {
+        if (this->m_ring_count.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+            Ring* ring = new Ring;
+            ring->head.store(0, std::memory_order_relaxed);
+            ring->cached_tail = 0;
+            ring->tail.store(0, std::memory_order_relaxed);
+            // 日志线程看到指针时队列已经初始化完毕
+            __atomic_store_n(&this->m_rings[index], ring, __ATOMIC_RELEASE);
+            m_local = ring;
+            return ring;
+        }
+    }
+    m_full = true;
+    return NULL;
+}
+
+void AccessLog::append(const sockaddr_in& client, std::string_view url, int status, int64_t bytes) {
+    Ring* ring = m_local;
+    if (ring == NULL) {
+        if (m_full || ((ring = this->registerRing()) == NULL)) {
+            return;
+        }
+    }
+
+    // 只有当前线程写 head，缓存的 tail 说明队列已满时才读取日志线程的 tail
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->cached_tail >= (uint64_t)RING_SIZE) {
+        ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+        if (head - ring->cached_tail >= (uint64_t)RING_SIZE) {
+            ServerStats::add(ServerStats::ACCESS_LOG_DROPS);
+            return;
+        }
+    }
+
+    Record* record = &ring->records[head & (RING_SIZE - 1)];
+    record->time = time(NULL);
+    record->addr = client.sin_addr.s_addr;
+    record->port = client.sin_port;
+    record->status = (uint16_t)status;
+    record->bytes = bytes;
+    size_t len = (url.size() < (size_t)URL_LEN) ? url.size() : URL_LEN;
+    memcpy(record->url, url.data(), len);
+    record->url_len = (uint16_t)len;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void* AccessLog::worker(void* arg) {
+    AccessLog* log = (AccessLog*)arg;
+    log->run();
+    return log;
+}
+
+void AccessLog::run() {
+    char* buf = new char[BATCH_BYTES];
+    while (true) {
+        // 先读取退出标记，之后取出的记录包含了退出之前入队的所有记录
+        bool stop = this->m_stop.load(std::memory_order_acquire);
+        size_t len = this->drain(buf, BATCH_BYTES);
+        if (len > 0) {
+            this->writeBatch(buf, len);
+            continue;
+        }
+        if (stop) {
+            break;
+        }
+        usleep(IDLE_SLEEP_US);
+    }
+    delete[] buf;
+}
+
+// 格式化 [17/Oct/2026:08:49:37 +0000]，同一秒内的记录复用上一次的结果
+static int formatLogTime(time_t t, char* out) {
+    static const char* const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    static thread_local time_t cached_time = -1;
+    static thread_local char cached[32];
+    static thread_local int cached_len = 0;
+    if (t != cached_time) {
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        cached_len = snprintf(cached, sizeof(cached), "[%02d/%s/%04d:%02d:%02d:%02d +0000]",
+                              tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        cached_time = t;
+    }
+    memcpy(out, cached, cached_len);
+    return cached_len;
+}
+
+/*
+    依次从每个队列中取出记录，格式化成 Common Log Format：
+    127.0.0.1:52814 - - [17/Oct/2026:08:49:37 +0000] "GET /szu.html HTTP/1.1" 200 4564
+    URL 中的引号、反斜杠和不可打印字符转义成 \xHH，日志不会被客户端注入伪造的行
+*/
+size_t AccessLog::drain(char* buf, size_t size) {
+    size_t len = 0;
+    int count = this->m_ring_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i) {
+        Ring* ring = __atomic_load_n(&this->m_rings[i], __ATOMIC_ACQUIRE);
+        if (ring == NULL) {
+            continue;       // 编号已经被占用，队列还没有发布
+        }
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while ((tail != head) && (size - len >= MAX_LINE)) {
+            const Record* record = &ring->records[tail & (RING_SIZE - 1)];
+            char* out = buf + len;
+            char addr[INET_ADDRSTRLEN];
+            struct in_addr in;
+            in.s_addr = record->addr;
+            inet_ntop(AF_INET, &in, addr, sizeof(addr));
+            out += sprintf(out, "%s:%u - - ", addr, ntohs(record->port));
+            out += formatLogTime(record->time, out);
+            if (record->url_len == 0) {
+                // 没有解析请求就拒绝的连接（503），请求行记为 "-"
+                out += sprintf(out, " \"-\" %u %lld\n", record->status, (long long)record->bytes);
+            }
+            else {
+                memcpy(out, " \"GET ", 6);
+                out += 6;
+                for (int j = 0; j < record->url_len; ++j) {
+                    unsigned char c = (unsigned char)record->url[j];
+                    if ((c < 0x21) || (c > 0x7e) || (c == '"') || (c == '\\')) {
+                        out += sprintf(out, "\\x%02X", c);
+                    }
+                    else {
+                        *out++ = (char)c;
+                    }
+                }
+                out += sprintf(out, " HTTP/1.1\" %u %lld\n", record->status, (long long)record->bytes);
+            }
+            len = out - buf;
+            ++tail;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return len;
+}
+
+void AccessLog::writeBatch(const char* buf, size_t len) {
+    // 文件超过大小上限时轮转：当前文件重命名为 path.1，之后的日志写入新建的文件
+    if ((this->m_rotate_bytes > 0) && (this->m_file_bytes > 0) && (this->m_file_bytes + len > this->m_rotate_bytes)) {
+        std::string rotated = this->m_path + ".1";
+        if ((rename(this->m_path.c_str(), rotated.c_str()) == 0) && !this->reopen()) {
+            perror("access log");
+        }
+    }
+
+    while (len > 0) {
+        ssize_t written = write(this->m_fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 磁盘满等错误，丢弃这一批，日志线程继续运行
+            return;
+        }
+        buf += written;
+        len -= written;
+        this->m_file_bytes += written;
+    }
+}
@@ -0,0 +1,37 @@
+#include "../include/admission_control.h"
+#include "../include/server_stats.h"
+#include <limits.h>
+
+AdmissionControl::AdmissionControl() :
+    m_target(0), m_interval(0), m_window_end(0), m_window_min(LLONG_MAX), m_last_sojourn(0), m_overload_until(0) {
+
+}
+
+AdmissionControl* AdmissionControl::getInstance() {
+    static AdmissionControl control;
+    return &control;
+}
+
+void AdmissionControl::setTarget(int target_ms) {
+    this->m_target = (long long)target_ms * 1000000;
+    this->m_interval = this->m_target * INTERVAL_FACTOR;
+    this->m_window_end.store(ServerStats::now() + this->m_interval, std::memory_order_relaxed);
+}
+
+void AdmissionControl::observe(long long sojourn, long long now) {
+    if (this->m_target == 0) {
+        return;
+    }
+    this->m_last_sojourn.store(sojourn, std::memory_order_relaxed);
+
+    long long window_min = this->m_window_min.load(std::memory_order_relaxed);
+    while ((sojourn < window_min) && !this->m_window_min.compare_exchange_weak(window_min, sojourn, std::memory_order_relaxed)) {
+    }
+
+    // 窗口结束，由抢到的工作线程开启下一个窗口并根据上一个窗口的最小排队时间判断是否过载
+    long long window_end = this->m_window_end.load(std::memory_order_relaxed);
+    if ((now >= window_end) && this->m_window_end.compare_exchange_strong(window_end, now + this->m_interval, std::memory_order_relaxed)) {
+        window_min = this->m_window_min.exchange(LLONG_MAX, std::memory_order_relaxed);
+        this->m_overload_until.store((window_min > this->m_target) ? now + this->m_interval : 0, std::memory_order_relaxed);
+    }
+}
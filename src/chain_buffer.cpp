@@ -0,0 +1,200 @@
+#include "../include/chain_buffer.h"
+#include <string.h>
+#include <errno.h>
+#include <new>
+#include <sys/uio.h>
+
+ChainBuffer::ChainBuffer() : m_tail_len(0) {
+
+}
+
+ChainBuffer::~ChainBuffer() {
+    this->clear();
+}
+
+ssize_t ChainBuffer::readFrom(int fd, int max_bytes) {
+    struct iovec iov[1 + READV_SLICES];
+    char* fresh[READV_SLICES];
+    int iov_count = 0;
+    int fresh_count = 0;
+    int budget = max_bytes;
+
+    // 先填满最后一个分片的剩余空间
+    int tail_space = this->m_slices.empty() ? 0 : SLICE_SIZE - this->m_tail_len;
+    if (tail_space > 0) {
+        iov[iov_count].iov_base = this->m_slices.back() + this->m_tail_len;
+        iov[iov_count].iov_len = (tail_space < budget) ? tail_space : budget;
+        budget -= iov[iov_count].iov_len;
+        ++iov_count;
+    }
+
+    // 最后一个分片已满，追加新的分片一起读取，缓冲区为空时普通的请求一个分片就足够了
+    if (iov_count == 0) {
+        int want = this->m_slices.empty() ? 1 : READV_SLICES;
+        while ((fresh_count < want) && (budget > 0)) {
+            char* slice = SlicePool::getInstance()->acquire();
+            if (slice == NULL) {
+                break;
+            }
+            fresh[fresh_count++] = slice;
+            iov[iov_count].iov_base = slice;
+            iov[iov_count].iov_len = (SLICE_SIZE < budget) ? SLICE_SIZE : budget;
+            budget -= iov[iov_count].iov_len;
+            ++iov_count;
+        }
+    }
+
+    if (iov_count == 0) {
+        // 没有可以写入的空间
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t ret = readv(fd, iov, iov_count);
+
+    // readv() 按照顺序填充每个内存块，前一个分片写满之后才会写入下一个分片
+    ssize_t left = (ret > 0) ? ret : 0;
+    if (tail_space > 0) {
+        ssize_t take = ((size_t)left < iov[0].iov_len) ? left : iov[0].iov_len;
+        this->m_tail_len += take;
+        left -= take;
+    }
+    for (int i = 0; i < fresh_count; ++i) {
+        if (left > 0) {
+            this->m_slices.push_back(fresh[i]);
+            this->m_tail_len = (left < SLICE_SIZE) ? left : SLICE_SIZE;
+            left -= this->m_tail_len;
+        }
+        else {
+            // 没有用到的新分片立即归还
+            SlicePool::getInstance()->release(fresh[i]);
+        }
+    }
+    return ret;
+}
+
+bool ChainBuffer::append(const char* data, int len) {
+    while (len > 0) {
+        if (this->m_slices.empty() || (this->m_tail_len == SLICE_SIZE)) {
+            char* slice = SlicePool::getInstance()->acquire();
+            if (slice == NULL) {
+                return false;
+            }
+            this->m_slices.push_back(slice);
+            this->m_tail_len = 0;
+        }
+        int space = SLICE_SIZE - this->m_tail_len;
+        int take = (len < space) ? len : space;
+        memcpy(this->m_slices.back() + this->m_tail_len, data, take);
+        this->m_tail_len += take;
+        data += take;
+        len -= take;
+    }
+    return true;
+}
+
+char* ChainBuffer::line(int start, int end) {
+    if (start >= end) {
+        return NULL;
+    }
+
+    int first = start >> SlicePool::SLICE_SHIFT;
+    int last = (end - 1) >> SlicePool::SLICE_SHIFT;
+    if (first == last) {
+        return this->m_slices[first] + (start & SLICE_MASK);
+    }
+
+    // 行跨越了分片，放得下时拷贝到行分片中，更长的行（很少见）拷贝到堆内存中
+    int len = end - start;
+    char* dst = NULL;
+    if (len <= SLICE_SIZE) {
+        dst = SlicePool::getInstance()->acquire();
+        if (dst == NULL) {
+            return NULL;
+        }
+        this->m_lines.push_back(dst);
+    }
+    else {
+        dst = new (std::nothrow) char[len];
+        if (dst == NULL) {
+            return NULL;
+        }
+        this->m_long_lines.push_back(dst);
+    }
+
+    // 依次拷贝行所在的每个分片中的部分
+    int copied = 0;
+    while (copied < len) {
+        int chunk;
+        const char* src = this->span(start + copied, &chunk);
+        if (chunk > len - copied) {
+            chunk = len - copied;
+        }
+        memcpy(dst + copied, src, chunk);
+        copied += chunk;
+    }
+    return dst;
+}
+
+void ChainBuffer::releaseLines() {
+    for (size_t i = 0; i < this->m_lines.size(); ++i) {
+        SlicePool::getInstance()->release(this->m_lines[i]);
+    }
+    this->m_lines.clear();
+    for (size_t i = 0; i < this->m_long_lines.size(); ++i) {
+        delete[] this->m_long_lines[i];
+    }
+    this->m_long_lines.clear();
+}
+
+int ChainBuffer::consume(int pos, const char** moved, int* moved_offset) {
+    *moved = NULL;
+    *moved_offset = 0;
+    int total = this->size();
+    if (pos <= 0) {
+        return 0;
+    }
+    if (pos >= total) {
+        // 所有数据都已经处理完毕
+        for (size_t i = 0; i < this->m_slices.size(); ++i) {
+            SlicePool::getInstance()->release(this->m_slices[i]);
+        }
+        this->m_slices.clear();
+        this->m_tail_len = 0;
+        return total;
+    }
+
+    // 归还 pos 之前的整个分片，剩余分片中的数据不移动，指向它们的地址依然有效
+    int whole = pos >> SlicePool::SLICE_SHIFT;
+    for (int i = 0; i < whole; ++i) {
+        SlicePool::getInstance()->release(this->m_slices[i]);
+    }
+    this->m_slices.erase(this->m_slices.begin(), this->m_slices.begin() + whole);
+    int dropped = whole * SLICE_SIZE;
+
+    int offset = pos - dropped;
+    if (this->m_slices.size() != 1) {
+        return dropped;
+    }
+
+    // 只剩一个分片，把剩余的数据移动到分片开头
+    char* slice = this->m_slices[0];
+    if (offset == 0) {
+        return dropped;
+    }
+    memmove(slice, slice + offset, this->m_tail_len - offset);
+    this->m_tail_len -= offset;
+
+    *moved = slice;
+    *moved_offset = offset;
+    return dropped + offset;
+}
+
+void ChainBuffer::clear() {
+    for (size_t i = 0; i < this->m_slices.size(); ++i) {
+        SlicePool::getInstance()->release(this->m_slices[i]);
+    }
+    this->m_slices.clear();
+    this->m_tail_len = 0;
+    this->releaseLines();
+}
@@ -0,0 +1,144 @@
+#include "../include/config.h"
+#include "../include/file_cache.h"
+#include "../include/gzip_cache.h"
+#include "../include/reactor.h"
+#include "../include/http_connection.h"
+#include "../include/access_log.h"
+#include "../include/admission_control.h"
+#include "../include/cpu_affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+Config::Config() :
+    port(0), cache_max_bytes(FileCache::DEFAULT_MAX_BYTES),
+    cache_max_files(FileCache::DEFAULT_MAX_FILES), map_limit(FileCache::DEFAULT_MAP_LIMIT),
+    reactors(0), idle_timeout(IDLE_TIMEOUT_MS), work_stealing(false),
+    read_limit(HttpConnection::DEFAULT_READ_LIMIT), gzip_max_bytes(GzipCache::DEFAULT_MAX_BYTES), io_uring(false),
+    access_log_rotate(AccessLog::DEFAULT_ROTATE_BYTES), queue_target_ms(AdmissionControl::DEFAULT_TARGET_MS),
+    threads(0) {
+
+}
+
+bool Config::parse(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:f:s:r:i:wb:z:m:ul:L:q:t:a:d:")) != -1) {
+        switch (opt) {
+        case 'c':
+            // 文件缓存容量，单位 MB
+            this->cache_max_bytes = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'f':
+            this->cache_max_files = atoi(optarg);
+            break;
+        case 's':
+            // 使用 sendfile() 发送的文件大小阈值，单位 KB，0 表示所有文件都使用 sendfile()
+            this->map_limit = atoll(optarg) * 1024;
+            break;
+        case 'r':
+            // 多 reactor 模式，每个 reactor 一个线程
+            this->reactors = atoi(optarg);
+            if (this->reactors < 0) {
+                return false;
+            }
+            break;
+        case 'i':
+            this->idle_timeout = atoi(optarg);
+            if (this->idle_timeout <= 0) {
+                return false;
+            }
+            break;
+        case 'w':
+            // 使用工作窃取线程池代替全局请求队列的线程池
+            this->work_stealing = true;
+            break;
+        case 'b':
+            // 每个连接最多缓存的请求数据，单位 KB，至少一个分片
+            this->read_limit = atoi(optarg) * 1024;
+            if (this->read_limit < ChainBuffer::SLICE_SIZE) {
+                return false;
+            }
+            break;
+        case 'z':
+            // gzip 压缩结果的缓存容量，单位 MB，0 表示关闭 gzip
+            this->gzip_max_bytes = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'm':
+            // 缓存策略，可以多次指定，格式在启动时由 HttpConnection::addCachePolicy() 检查
+            this->cache_policies.push_back(optarg);
+            break;
+        case 'u':
+            // io_uring 后端只在 reactor 线程中处理请求，没有指定 -r 时使用一个 reactor
+            this->io_uring = true;
+            break;
+        case 'l':
+            this->access_log = optarg;
+            break;
+        case 'L':
+            // 访问日志轮转的大小，单位 MB，0 表示不轮转
+            if (atol(optarg) < 0) {
+                return false;
+            }
+            this->access_log_rotate = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'q':
+            // 准入控制的排队时间目标值，单位毫秒，0 表示关闭
+            this->queue_target_ms = atoi(optarg);
+            if (this->queue_target_ms < 0) {
+                return false;
+            }
+            break;
+        case 't':
+            this->threads = atoi(optarg);
+            if (this->threads <= 0) {
+                return false;
+            }
+            break;
+        case 'a':
+            // 绑定的 CPU 列表，"auto" 表示按照拓扑排列所有可用的 CPU
+            if (!CpuAffinity::parseList(optarg, &this->cpus)) {
+                return false;
+            }
+            break;
+        case 'd':
+            // 网站的根目录，在启动时由 HttpConnection::setDocRoot() 检查
+            this->doc_root = optarg;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    // 剩下的第一个参数是端口号
+    if (optind >= argc) {
+        return false;
+    }
+    this->port = atoi(argv[optind]);
+    if (this->io_uring && (this->reactors == 0)) {
+        this->reactors = 1;
+    }
+    if (this->threads == 0) {
+        this->threads = CpuAffinity::usableCpus();
+    }
+    return this->port > 0;
+}
+
+void Config::usage(const char* name) {
+    printf("Usage: %s [options] port_number\n", name);
+    printf("  -c <MB>       file cache capacity in MB (default %zu)\n", FileCache::DEFAULT_MAX_BYTES / (1024 * 1024));
+    printf("  -f <count>    max number of cached files (default %d)\n", FileCache::DEFAULT_MAX_FILES);
+    printf("  -s <KB>       send files larger than this with sendfile() (default %lld)\n", (long long)FileCache::DEFAULT_MAP_LIMIT / 1024);
+    printf("  -r <count>    run <count> reactors with SO_REUSEPORT listeners, 0 = one reactor + thread pool (default 0)\n");
+    printf("  -i <ms>       close connections idle for this many milliseconds (default %d)\n", IDLE_TIMEOUT_MS);
+    printf("  -w            use the work-stealing thread pool (single reactor mode only)\n");
+    printf("  -b <KB>       max buffered request bytes per connection (default %d)\n", HttpConnection::DEFAULT_READ_LIMIT / 1024);
+    printf("  -z <MB>       gzip variant cache capacity in MB, 0 = disable gzip (default %zu)\n", GzipCache::DEFAULT_MAX_BYTES / (1024 * 1024));
+    printf("  -m <ext>=<s>  Cache-Control max-age for files ending in <ext> (e.g. .css=86400), * = other files, 0 = no-cache; repeatable\n");
+    printf("  -u            use the io_uring backend (implies -r 1 unless -r is given), falls back to epoll if unsupported\n");
+    printf("  -l <path>     write an access log in Common Log Format to <path> (default off)\n");
+    printf("  -L <MB>       rotate the access log to <path>.1 when it exceeds this size, 0 = never (default %zu)\n", AccessLog::DEFAULT_ROTATE_BYTES / (1024 * 1024));
+    printf("  -q <ms>       answer 503 when the thread pool queue delay stays above this for %dx as long (CoDel), 0 = off (default %d)\n", AdmissionControl::INTERVAL_FACTOR, AdmissionControl::DEFAULT_TARGET_MS);
+    printf("  -t <count>    thread pool size (default: usable CPUs, honouring affinity and cgroup quota, currently %d)\n", CpuAffinity::usableCpus());
+    printf("  -a <cpus>     pin reactors, then pool workers, to these CPUs in order (e.g. 0-3,8), auto = all usable CPUs by socket and core (default off)\n");
+    printf("  -d <dir>      document root (default %s)\n", DOC_ROOT);
+}
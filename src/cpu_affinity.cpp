@@ -0,0 +1,189 @@
+#include "../include/cpu_affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <tuple>
+#include <string>
+
+// 读取 sysfs 或者 procfs 中的一个整数，失败时返回 def
+static long long readNumber(const char* path, long long def) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return def;
+    }
+    long long value = def;
+    if (fscanf(fp, "%lld", &value) != 1) {
+        value = def;
+    }
+    fclose(fp);
+    return value;
+}
+
+int CpuAffinity::usableCpus() {
+    cpu_set_t set;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        count = CPU_COUNT(&set);
+    }
+    if (count <= 0) {
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    int limit = cgroupLimit();
+    if ((limit > 0) && (limit < count)) {
+        count = limit;
+    }
+    return count > 0 ? count : 1;
+}
+
+int CpuAffinity::cgroupLimit() {
+    // cgroup v2：进程所在的 cgroup 的 cpu.max，内容是 "max 100000" 或者 "配额 周期"
+    std::string group;
+    FILE* fp = fopen("/proc/self/cgroup", "r");
+    if (fp != NULL) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (strncmp(line, "0::", 3) == 0) {
+                group = line + 3;
+                group.erase(group.find_last_not_of("\n") + 1);
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    const std::string paths[] = { "/sys/fs/cgroup" + group + "/cpu.max", "/sys/fs/cgroup/cpu.max" };
+    for (const std::string& path : paths) {
+        fp = fopen(path.c_str(), "r");
+        if (fp == NULL) {
+            continue;
+        }
+        char quota[32];
+        long long period = 0;
+        int n = fscanf(fp, "%31s %lld", quota, &period);
+        fclose(fp);
+        if ((n == 2) && (strcmp(quota, "max") != 0) && (period > 0)) {
+            return (int)((atoll(quota) + period - 1) / period);
+        }
+        return 0;
+    }
+
+    // cgroup v1：配额为 -1 表示没有限制
+    long long quota = readNumber("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", -1);
+    long long period = readNumber("/sys/fs/cgroup/cpu/cpu.cfs_period_us", 0);
+    if ((quota > 0) && (period > 0)) {
+        return (int)((quota + period - 1) / period);
+    }
+    return 0;
+}
+
+bool CpuAffinity::parseList(const char* spec, std::vector<int>* cpus) {
+    cpus->clear();
+    if (strcmp(spec, "auto") == 0) {
+        topologyOrder(cpus);
+        return !cpus->empty();
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return false;
+    }
+    const char* p = spec;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if ((end == p) || (first < 0)) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if ((end == p + 1) || (last < first)) {
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus->push_back((int)cpu);
+            }
+        }
+        if (*p == ',') {
+            ++p;
+        }
+        else if (*p != '\0') {
+            return false;
+        }
+    }
+    return !cpus->empty();
+}
+
+void CpuAffinity::topologyOrder(std::vector<int>* cpus) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+
+    // 排序的键：插槽，物理核中的第几个超线程，物理核，CPU 编号
+    struct Key {
+        long long package;
+        int rank;
+        long long core;
+        int cpu;
+        bool operator<(const Key& other) const {
+            return std::tie(package, rank, core, cpu) < std::tie(other.package, other.rank, other.core, other.cpu);
+        }
+    };
+    std::vector<Key> keys;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        char path[128];
+        Key key;
+        key.cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        key.package = readNumber(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        key.core = readNumber(path, cpu);
+
+        // 同一个物理核中编号更小的超线程的数量就是当前 CPU 的序号
+        key.rank = 0;
+        for (const Key& other : keys) {
+            if ((other.package == key.package) && (other.core == key.core)) {
+                ++key.rank;
+            }
+        }
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (const Key& key : keys) {
+        cpus->push_back(key.cpu);
+    }
+}
+
+bool CpuAffinity::setAttr(pthread_attr_t* attr, int cpu) {
+    if (cpu < 0) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0;
+}
+
+bool CpuAffinity::pinSelf(int cpu, cpu_set_t* old) {
+    if (old != NULL) {
+        pthread_getaffinity_np(pthread_self(), sizeof(*old), old);
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // 返回时当前线程已经迁移到 cpu 上运行
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+void CpuAffinity::restoreSelf(const cpu_set_t& old) {
+    pthread_setaffinity_np(pthread_self(), sizeof(old), &old);
+}
@@ -0,0 +1,371 @@
+#include "../include/file_cache.h"
+#include "../include/http_date.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+// 被缓存的文件发生这些事件时，对应的缓存项失效（IN_ATTRIB 同时覆盖了权限变化和文件被删除、被 rename 覆盖时链接数的变化）
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::FileCache() :
+    m_max_bytes(DEFAULT_MAX_BYTES), m_max_files(DEFAULT_MAX_FILES), m_bytes(0),
+    m_map_limit(DEFAULT_MAP_LIMIT) {
+    // inotify 创建失败时缓存依然可用，只是不再缓存任何文件（无法得知文件何时被修改）
+    this->m_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->m_notify_fd == -1) {
+        perror("inotify_init1");
+    }
+}
+
+FileCache::~FileCache() {
+    for (std::list<FileEntry*>::iterator it = this->m_lru.begin(); it != this->m_lru.end(); ++it) {
+        if ((*it)->refcount == 0) {
+            this->destroy(*it);
+        }
+    }
+    if (this->m_notify_fd != -1) {
+        close(this->m_notify_fd);
+    }
+}
+
+FileCache* FileCache::getInstance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::setCapacity(size_t max_bytes, int max_files) {
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    this->m_max_bytes = max_bytes;
+    this->m_max_files = max_files;
+    this->evict(garbage);
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        this->destroy(garbage[i]);
+    }
+}
+
+FileEntry* FileCache::find(const char* path) {
+    this->m_lock.lock();
+
+    // 命中缓存，增加引用计数并移动到 LRU 链表表头
+    std::unordered_map<std::string_view, FileEntry*>::iterator it = this->m_index.find(path);
+    if (it == this->m_index.end()) {
+        this->m_lock.unlock();
+        return NULL;
+    }
+    FileEntry* entry = it->second;
+    ++entry->refcount;
+    this->m_lru.splice(this->m_lru.begin(), this->m_lru, entry->lru_pos);
+    this->m_lock.unlock();
+    return entry;
+}
+
+FileEntry* FileCache::acquire(const char* path) {
+    FileEntry* hit = this->find(path);
+    if (hit != NULL) {
+        return hit;
+    }
+
+    /*
+        没有命中，先监视文件再加载文件，并记下 watch 当前的事件计数
+        如果加载期间文件被修改，插入缓存时会发现事件计数发生了变化，此时不缓存这次加载的结果
+    */
+    int wd = -1;
+    unsigned generation = 0;
+    this->m_lock.lock();
+    if (this->m_notify_fd != -1) {
+        wd = inotify_add_watch(this->m_notify_fd, path, WATCH_MASK);
+        if (wd != -1) {
+            Watch& watch = this->m_watches[wd];
+            ++watch.users;
+            generation = watch.generation;
+        }
+    }
+    this->m_lock.unlock();
+
+    // 打开文件和建立映射比较耗时，不持有锁
+    FileEntry* entry = this->load(path);
+
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    if (entry == NULL) {
+        int saved_errno = errno;
+        if (wd != -1) {
+            this->dropWatch(wd, NULL);
+        }
+        this->m_lock.unlock();
+        errno = saved_errno;
+        return NULL;
+    }
+
+    std::unordered_map<int, Watch>::iterator w = (wd == -1) ? this->m_watches.end() : this->m_watches.find(wd);
+    bool fresh = (w != this->m_watches.end()) && (w->second.generation == generation);
+    bool fits = (mappedBytes(entry) <= this->m_max_bytes) && (this->m_max_files > 0);
+
+    if (fresh && fits) {
+        std::unordered_map<std::string_view, FileEntry*>::iterator it = this->m_index.find(path);
+        if (it != this->m_index.end()) {
+            // 其它线程已经加载并缓存了同一个文件，使用已有的缓存项
+            FileEntry* existing = it->second;
+            ++existing->refcount;
+            this->m_lru.splice(this->m_lru.begin(), this->m_lru, existing->lru_pos);
+            this->dropWatch(wd, NULL);
+            this->m_lock.unlock();
+            this->destroy(entry);
+            return existing;
+        }
+
+        // 插入缓存，watch 的使用者由加载请求转交给缓存项
+        entry->cached = true;
+        entry->wd = wd;
+        w->second.entries.push_back(entry);
+        this->m_index[entry->path] = entry;
+        this->m_lru.push_front(entry);
+        entry->lru_pos = this->m_lru.begin();
+        this->m_bytes += mappedBytes(entry);
+        this->evict(garbage);
+    }
+    else if (wd != -1) {
+        // 不缓存本次加载的结果，缓存项只被当前请求使用，归还时释放
+        this->dropWatch(wd, NULL);
+    }
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        this->destroy(garbage[i]);
+    }
+    return entry;
+}
+
+void FileCache::release(FileEntry* entry) {
+    if (entry == NULL) {
+        return;
+    }
+
+    this->m_lock.lock();
+    bool dead = (--entry->refcount == 0) && !entry->cached;
+    this->m_lock.unlock();
+
+    if (dead) {
+        this->destroy(entry);
+    }
+}
+
+void FileCache::retain(FileEntry* entry) {
+    this->m_lock.lock();
+    ++entry->refcount;
+    this->m_lock.unlock();
+}
+
+void FileCache::handleNotify() {
+    // inotify 事件结构体需要按照 struct inotify_event 对齐
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    std::vector<FileEntry*> garbage;
+
+    while (true) {
+        ssize_t len = read(this->m_notify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            // EAGAIN 表示事件已经读完
+            break;
+        }
+
+        this->m_lock.lock();
+        for (char* ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            std::unordered_map<int, Watch>::iterator w = this->m_watches.find(event->wd);
+            if (w == this->m_watches.end()) {
+                continue;
+            }
+            ++w->second.generation;
+
+            // unlink() 会修改 watch 的缓存项列表，甚至移除 watch，所以先拷贝一份
+            std::vector<FileEntry*> entries = w->second.entries;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                this->unlink(entries[i]);
+                if (entries[i]->refcount == 0) {
+                    garbage.push_back(entries[i]);
+                }
+            }
+
+            if (event->mask & IN_IGNORED) {
+                // watch 已经被内核移除（文件被删除或者文件系统被卸载），正在加载的请求会发现 watch 不存在而不缓存
+                this->m_watches.erase(event->wd);
+            }
+        }
+        this->m_lock.unlock();
+    }
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        this->destroy(garbage[i]);
+    }
+}
+
+void FileCache::clear() {
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    while (!this->m_lru.empty()) {
+        FileEntry* entry = this->m_lru.back();
+        this->unlink(entry);
+        if (entry->refcount == 0) {
+            garbage.push_back(entry);
+        }
+    }
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        this->destroy(garbage[i]);
+    }
+}
+
+bool FileCache::statFile(const char* path, struct stat* st) {
+    // 获取文件相关的状态信息，-1 表示失败（文件不存在等），errno 由 stat() 设置
+    if (stat(path, st) < 0) {
+        return false;
+    }
+
+    // 判断访问权限
+    if (!(st->st_mode & S_IROTH)) {
+        errno = EACCES;
+        return false;
+    }
+
+    // 判断是否是目录
+    if (S_ISDIR(st->st_mode)) {
+        errno = EISDIR;
+        return false;
+    }
+    return true;
+}
+
+FileEntry* FileCache::statOnly(const char* path) {
+    struct stat st;
+    if (!statFile(path, &st)) {
+        return NULL;
+    }
+    FileEntry* entry = new FileEntry;
+    entry->path = path;
+    entry->fd = -1;
+    entry->st = st;
+    entry->address = NULL;
+    entry->refcount = 1;
+    entry->wd = -1;
+    entry->cached = false;
+    setValidators(entry, NULL);
+    return entry;
+}
+
+FileEntry* FileCache::load(const char* path) {
+    struct stat st;
+    if (!statFile(path, &st)) {
+        return NULL;
+    }
+
+    // 以只读方式打开文件，以打开的文件为准重新获取状态，防止 stat() 和 open() 之间文件被替换
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    // 对整个文件创建只读内存映射，空文件不能被映射，大文件直接通过 fd 用 sendfile() 发送
+    char* address = NULL;
+    if ((st.st_size > 0) && (st.st_size <= this->m_map_limit)) {
+        address = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            int saved_errno = errno;
+            close(fd);
+            errno = saved_errno;
+            return NULL;
+        }
+    }
+
+    FileEntry* entry = new FileEntry;
+    entry->path = path;
+    entry->fd = fd;
+    entry->st = st;
+    entry->address = address;
+    entry->refcount = 1;
+    entry->wd = -1;
+    entry->cached = false;
+    setValidators(entry, NULL);
+    return entry;
+}
+
+void FileCache::setValidators(FileEntry* entry, const char* suffix) {
+    // 文件被替换（inode 变化）或者被修改（大小或修改时间变化）时实体标签随之变化
+    unsigned long long mtime = (unsigned long long)entry->st.st_mtim.tv_sec * 1000000000ULL + entry->st.st_mtim.tv_nsec;
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx-%llx%s%s\"", (unsigned long long)entry->st.st_ino,
+        (unsigned long long)entry->st.st_size, mtime, suffix ? "-" : "", suffix ? suffix : "");
+    formatHttpDate(entry->st.st_mtime, entry->last_modified);
+}
+
+void FileCache::destroy(FileEntry* entry) {
+    if (entry->address) {
+        munmap(entry->address, entry->st.st_size);
+    }
+    if (entry->fd != -1) {
+        close(entry->fd);
+    }
+    delete entry;
+}
+
+void FileCache::unlink(FileEntry* entry) {
+    if (!entry->cached) {
+        return;
+    }
+    this->m_index.erase(std::string_view(entry->path));
+    this->m_lru.erase(entry->lru_pos);
+    this->m_bytes -= mappedBytes(entry);
+    entry->cached = false;
+
+    if (entry->wd != -1) {
+        this->dropWatch(entry->wd, entry);
+        entry->wd = -1;
+    }
+}
+
+void FileCache::dropWatch(int wd, FileEntry* entry) {
+    std::unordered_map<int, Watch>::iterator w = this->m_watches.find(wd);
+    if (w == this->m_watches.end()) {
+        // watch 已经被内核移除
+        return;
+    }
+
+    if (entry) {
+        std::vector<FileEntry*>& entries = w->second.entries;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i] == entry) {
+                entries[i] = entries.back();
+                entries.pop_back();
+                break;
+            }
+        }
+    }
+
+    if (--w->second.users == 0) {
+        inotify_rm_watch(this->m_notify_fd, wd);
+        this->m_watches.erase(w);
+    }
+}
+
+void FileCache::evict(std::vector<FileEntry*>& garbage) {
+    while (!this->m_lru.empty() &&
+        ((this->m_bytes > this->m_max_bytes) || (this->m_index.size() > (size_t)this->m_max_files))) {
+        FileEntry* victim = this->m_lru.back();
+        this->unlink(victim);
+        if (victim->refcount == 0) {
+            // 仍在被连接使用的缓存项，在最后一个使用者归还时释放
+            garbage.push_back(victim);
+        }
+    }
+}
@@ -0,0 +1,362 @@
+#include "../include/gzip_cache.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+// 适合压缩的文本类资源的扩展名
+static const char* COMPRESSIBLE_SUFFIXES[] = {
+    ".html", ".htm", ".css", ".js", ".json", ".txt", ".xml", ".svg", ".csv", ".md"
+};
+
+GzipCache::GzipCache() : m_bytes(0), m_max_bytes(0), m_started(false) {
+
+}
+
+GzipCache* GzipCache::getInstance() {
+    static GzipCache cache;
+    return &cache;
+}
+
+bool GzipCache::setCapacity(size_t max_bytes) {
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    this->m_max_bytes = max_bytes;
+    this->evict(garbage);
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        FileCache::getInstance()->release(garbage[i]);
+    }
+
+    // 后台线程只在开启 gzip 时启动，线程分离，随进程退出
+    if ((max_bytes > 0) && !this->m_started) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0) {
+            this->m_max_bytes = 0;
+            return false;
+        }
+        pthread_detach(tid);
+        this->m_started = true;
+    }
+    return true;
+}
+
+bool GzipCache::compressible(std::string_view path, off_t size) {
+    if (size < MIN_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(COMPRESSIBLE_SUFFIXES) / sizeof(COMPRESSIBLE_SUFFIXES[0]); ++i) {
+        std::string_view suffix = COMPRESSIBLE_SUFFIXES[i];
+        if ((path.size() > suffix.size()) && (path.substr(path.size() - suffix.size()) == suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GzipCache::sameVersion(const Variant* variant, const struct stat& st) {
+    return (variant->size == st.st_size) &&
+        (variant->mtime.tv_sec == st.st_mtim.tv_sec) && (variant->mtime.tv_nsec == st.st_mtim.tv_nsec);
+}
+
+FileEntry* GzipCache::acquire(FileEntry* original) {
+    if (!this->enabled()) {
+        return NULL;
+    }
+
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    std::unordered_map<std::string_view, Variant*>::iterator it = this->m_index.find(original->path);
+    if ((it != this->m_index.end()) && !sameVersion(it->second, original->st)) {
+        // 原始文件已经被修改，丢弃旧的变体，和第一次请求一样重新准备
+        this->unlink(it->second, garbage);
+        it = this->m_index.end();
+    }
+    if (it == this->m_index.end()) {
+        // 第一次请求该文件，交给后台线程准备变体
+        if (this->submit(original)) {
+            Variant* variant = new Variant;
+            variant->path = original->path;
+            variant->mtime = original->st.st_mtim;
+            variant->size = original->st.st_size;
+            variant->state = PENDING;
+            variant->data = NULL;
+            this->m_index[variant->path] = variant;
+            this->m_lru.push_front(variant);
+            variant->lru_pos = this->m_lru.begin();
+            this->evict(garbage);
+        }
+        this->m_lock.unlock();
+        for (size_t i = 0; i < garbage.size(); ++i) {
+            FileCache::getInstance()->release(garbage[i]);
+        }
+        return NULL;
+    }
+
+    Variant* variant = it->second;
+    this->m_lru.splice(this->m_lru.begin(), this->m_lru, variant->lru_pos);
+
+    FileEntry* entry = NULL;
+    STATE state = variant->state;
+    if (state == READY) {
+        entry = variant->data;
+        FileCache::getInstance()->retain(entry);
+    }
+    this->m_lock.unlock();
+
+    if (state == SIDECAR) {
+        // 预压缩的 .gz 文件和普通文件一样由文件缓存管理，被修改时通过 inotify 失效
+        std::string gz_path = original->path + ".gz";
+        entry = FileCache::getInstance()->acquire(gz_path.c_str());
+        if ((entry != NULL) && ((entry->st.st_mtim.tv_sec < original->st.st_mtim.tv_sec) ||
+            ((entry->st.st_mtim.tv_sec == original->st.st_mtim.tv_sec) && (entry->st.st_mtim.tv_nsec < original->st.st_mtim.tv_nsec)))) {
+            // .gz 文件比原始文件旧，不再使用
+            FileCache::getInstance()->release(entry);
+            entry = NULL;
+        }
+        if (entry == NULL) {
+            this->m_lock.lock();
+            it = this->m_index.find(original->path);
+            if ((it != this->m_index.end()) && (it->second->state == SIDECAR)) {
+                this->unlink(it->second, garbage);
+            }
+            this->m_lock.unlock();
+        }
+    }
+    return entry;
+}
+
+FileEntry* GzipCache::validators(const FileEntry* original) {
+    if (!this->enabled()) {
+        return NULL;
+    }
+
+    // 只查询变体的状态，不提交压缩任务，也不调整 LRU 顺序
+    FileEntry* entry = NULL;
+    STATE state = IDENTITY;
+    this->m_lock.lock();
+    std::unordered_map<std::string_view, Variant*>::iterator it = this->m_index.find(original->path);
+    if ((it != this->m_index.end()) && sameVersion(it->second, original->st)) {
+        state = it->second->state;
+        if (state == READY) {
+            entry = it->second->data;
+            FileCache::getInstance()->retain(entry);
+        }
+    }
+    this->m_lock.unlock();
+
+    if (state == SIDECAR) {
+        // 和 acquire() 一样，.gz 文件比原始文件旧时不再使用
+        std::string gz_path = original->path + ".gz";
+        entry = FileCache::statOnly(gz_path.c_str());
+        if ((entry != NULL) && ((entry->st.st_mtim.tv_sec < original->st.st_mtim.tv_sec) ||
+            ((entry->st.st_mtim.tv_sec == original->st.st_mtim.tv_sec) && (entry->st.st_mtim.tv_nsec < original->st.st_mtim.tv_nsec)))) {
+            FileCache::getInstance()->release(entry);
+            entry = NULL;
+        }
+    }
+    return entry;
+}
+
+void GzipCache::clear() {
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    while (!this->m_lru.empty()) {
+        this->unlink(this->m_lru.back(), garbage);
+    }
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        FileCache::getInstance()->release(garbage[i]);
+    }
+}
+
+bool GzipCache::submit(FileEntry* original) {
+    Job job;
+    job.original = original;
+    job.mtime = original->st.st_mtim;
+    job.size = original->st.st_size;
+
+    this->m_jobs_lock.lock();
+    if (this->m_jobs.size() >= (size_t)MAX_PENDING) {
+        this->m_jobs_lock.unlock();
+        return false;
+    }
+    FileCache::getInstance()->retain(original);     // 后台线程压缩期间原始文件的映射不能被释放
+    this->m_jobs.push_back(job);
+    this->m_jobs_lock.unlock();
+    this->m_jobs_stat.post();
+    return true;
+}
+
+void* GzipCache::worker(void* arg) {
+    GzipCache* cache = (GzipCache*)arg;
+    cache->run();
+    return cache;
+}
+
+void GzipCache::run() {
+    while (true) {
+        this->m_jobs_stat.wait();
+        this->m_jobs_lock.lock();
+        if (this->m_jobs.empty()) {
+            this->m_jobs_lock.unlock();
+            continue;
+        }
+        Job job = this->m_jobs.front();
+        this->m_jobs.pop_front();
+        this->m_jobs_lock.unlock();
+
+        this->process(job);
+        FileCache::getInstance()->release(job.original);
+    }
+}
+
+void GzipCache::process(const Job& job) {
+    // 优先使用预压缩的 .gz 文件，没有时才在内存中压缩
+    STATE state = IDENTITY;
+    FileEntry* data = NULL;
+    if (sidecarFresh(job.original->path, job.mtime)) {
+        state = SIDECAR;
+    }
+    else if (job.size <= MAX_SIZE) {
+        data = compress(job.original);
+        if (data) {
+            state = READY;
+        }
+    }
+
+    std::vector<FileEntry*> garbage;
+    this->m_lock.lock();
+    std::unordered_map<std::string_view, Variant*>::iterator it = this->m_index.find(job.original->path);
+    Variant* variant = (it == this->m_index.end()) ? NULL : it->second;
+    if ((variant != NULL) && (variant->state == PENDING) && (variant->size == job.size) &&
+        (variant->mtime.tv_sec == job.mtime.tv_sec) && (variant->mtime.tv_nsec == job.mtime.tv_nsec)) {
+        variant->state = state;
+        variant->data = data;
+        if (data) {
+            this->m_bytes += data->st.st_size;
+        }
+        this->evict(garbage);
+    }
+    else if (data) {
+        // 等待期间变体被淘汰或者原始文件被修改，丢弃压缩结果
+        garbage.push_back(data);
+    }
+    this->m_lock.unlock();
+
+    for (size_t i = 0; i < garbage.size(); ++i) {
+        FileCache::getInstance()->release(garbage[i]);
+    }
+}
+
+bool GzipCache::sidecarFresh(const std::string& path, const struct timespec& mtime) {
+    std::string gz_path = path + ".gz";
+    struct stat st;
+    if ((stat(gz_path.c_str(), &st) < 0) || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)) {
+        return false;
+    }
+    // gzip -k 保留原始文件的修改时间，所以相等也是新的
+    return (st.st_mtim.tv_sec > mtime.tv_sec) ||
+        ((st.st_mtim.tv_sec == mtime.tv_sec) && (st.st_mtim.tv_nsec >= mtime.tv_nsec));
+}
+
+FileEntry* GzipCache::compress(FileEntry* original) {
+    off_t size = original->st.st_size;
+
+    // 原始文件通常已经被映射，超过映射上限的文件从 fd 中读取
+    const unsigned char* input = (const unsigned char*)original->address;
+    unsigned char* buffer = NULL;
+    if (input == NULL) {
+        buffer = new unsigned char[size];
+        off_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(original->fd, buffer + done, size - done, done);
+            if (n <= 0) {
+                delete[] buffer;
+                return NULL;
+            }
+            done += n;
+        }
+        input = buffer;
+    }
+
+    // windowBits 加 16 表示输出 gzip 格式（带 gzip 头和 CRC32）
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, COMPRESS_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete[] buffer;
+        return NULL;
+    }
+    uLong bound = deflateBound(&stream, size);
+    unsigned char* output = new unsigned char[bound];
+    stream.next_in = (Bytef*)input;
+    stream.avail_in = size;
+    stream.next_out = output;
+    stream.avail_out = bound;
+    int ret = deflate(&stream, Z_FINISH);
+    off_t compressed = stream.total_out;
+    deflateEnd(&stream);
+    delete[] buffer;
+
+    // 压缩失败，或者压缩后节省不到 10%，不值得额外占用内存
+    if ((ret != Z_STREAM_END) || (compressed > size - size / 10)) {
+        delete[] output;
+        return NULL;
+    }
+
+    // 压缩结果写入 memfd 再建立只读映射，FileCache 释放缓存项时的 munmap() 和 close() 同样适用
+    int fd = memfd_create("gzip", MFD_CLOEXEC);
+    if (fd == -1) {
+        delete[] output;
+        return NULL;
+    }
+    off_t written = 0;
+    while (written < compressed) {
+        ssize_t n = write(fd, output + written, compressed - written);
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    delete[] output;
+    char* address = (written == compressed) ? (char*)mmap(NULL, compressed, PROT_READ, MAP_PRIVATE, fd, 0) : (char*)MAP_FAILED;
+    if (address == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    // 状态信息沿用原始文件的（修改时间等），只有大小是压缩后的大小，实体标签加上 gz 后缀和原始文件区分
+    FileEntry* entry = new FileEntry;
+    entry->path = original->path + ".gz";
+    entry->fd = fd;
+    entry->st = original->st;
+    entry->address = address;
+    FileCache::setValidators(entry, "gz");
+    entry->st.st_size = compressed;
+    entry->refcount = 1;
+    entry->wd = -1;
+    entry->cached = false;
+    return entry;
+}
+
+void GzipCache::unlink(Variant* variant, std::vector<FileEntry*>& garbage) {
+    this->m_index.erase(std::string_view(variant->path));
+    this->m_lru.erase(variant->lru_pos);
+    if (variant->data) {
+        this->m_bytes -= variant->data->st.st_size;
+        garbage.push_back(variant->data);
+    }
+    delete variant;
+}
+
+void GzipCache::evict(std::vector<FileEntry*>& garbage) {
+    while (!this->m_lru.empty() &&
+        ((this->m_bytes > this->m_max_bytes) || (this->m_index.size() > (size_t)MAX_VARIANTS))) {
+        this->unlink(this->m_lru.back(), garbage);
+    }
+}
@@ -0,0 +1,176 @@
+#include "../include/hot_upgrade.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <vector>
+
+extern char** environ;
+
+// 静态成员变量需要初始化
+std::string HotUpgrade::m_exe;
+char** HotUpgrade::m_argv = NULL;
+int HotUpgrade::m_channel = -1;
+cpu_set_t HotUpgrade::m_affinity;
+
+// 子进程中通信 socket 固定为 3 号文件描述符
+static const int CHANNEL_FD = 3;
+
+void HotUpgrade::init(char* argv[]) {
+    // 记录绝对路径，升级时可执行文件可能已经被替换，/proc/self/exe 仍然指向旧的文件
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+        path[len] = '\0';
+        m_exe = path;
+    }
+    m_argv = argv;
+    if (sched_getaffinity(0, sizeof(m_affinity), &m_affinity) != 0) {
+        CPU_ZERO(&m_affinity);
+    }
+}
+
+int HotUpgrade::inherit(int* fds, int max) {
+    const char* env = getenv(UPGRADE_ENV);
+    if (env == NULL) {
+        return 0;
+    }
+    int channel = atoi(env);
+    unsetenv(UPGRADE_ENV);
+
+    // 数据部分是监听 socket 的数量，控制消息中是文件描述符本身
+    int count = 0;
+    struct iovec iov = { &count, sizeof(count) };
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != sizeof(count)) {
+        close(channel);
+        return -1;
+    }
+
+    int received = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS)) {
+            continue;
+        }
+        int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = (const int*)CMSG_DATA(cmsg);
+        for (int i = 0; i < n; ++i) {
+            if (received < max) {
+                fds[received++] = data[i];
+            }
+            else {
+                close(data[i]);     // 新进程的 reactor 比旧进程少，多余的监听 socket 由旧进程关闭时释放
+            }
+        }
+    }
+    if ((received != count) && (received < max)) {
+        // 控制消息被截断，监听 socket 不完整
+        for (int i = 0; i < received; ++i) {
+            close(fds[i]);
+        }
+        close(channel);
+        return -1;
+    }
+    m_channel = channel;
+    return received;
+}
+
+void HotUpgrade::ready() {
+    if (m_channel == -1) {
+        return;
+    }
+    char ok = 1;
+    ssize_t ret = write(m_channel, &ok, 1);
+    (void)ret;
+    close(m_channel);
+    m_channel = -1;
+}
+
+int HotUpgrade::spawn(const int* fds, int count, pid_t* pid) {
+    if (m_exe.empty() || (count <= 0) || (count > MAX_LISTENERS)) {
+        return -1;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+        return -1;
+    }
+
+    // fork() 之后的子进程只能调用异步信号安全的函数，环境变量在 fork() 之前准备好
+    std::string channel_env = std::string(UPGRADE_ENV "=") + std::to_string(CHANNEL_FD);
+    std::vector<char*> envp;
+    for (char** env = environ; *env != NULL; ++env) {
+        if (strncmp(*env, UPGRADE_ENV "=", sizeof(UPGRADE_ENV)) != 0) {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back((char*)channel_env.c_str());
+    envp.push_back(NULL);
+
+    pid_t child = fork();
+    if (child == -1) {
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+    if (child == 0) {
+        // 通信 socket 放到 3 号，dup2() 得到的文件描述符没有 FD_CLOEXEC
+        if (pair[1] == CHANNEL_FD) {
+            fcntl(CHANNEL_FD, F_SETFD, 0);
+        }
+        else if (dup2(pair[1], CHANNEL_FD) == -1) {
+            _exit(127);
+        }
+        // 关闭其它所有文件描述符（客户端连接没有 FD_CLOEXEC），新进程只通过 SCM_RIGHTS 得到监听 socket
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, CHANNEL_FD + 1, ~0U, 0) != 0)
+#endif
+        {
+            long max_fd = sysconf(_SC_OPEN_MAX);
+            for (long fd = CHANNEL_FD + 1; fd < max_fd; ++fd) {
+                close((int)fd);
+            }
+        }
+        // 子进程继承的是主 reactor 线程的绑定，恢复成启动时的亲和性集合
+        if (CPU_COUNT(&m_affinity) > 0) {
+            sched_setaffinity(0, sizeof(m_affinity), &m_affinity);
+        }
+        execve(m_exe.c_str(), m_argv, envp.data());
+        _exit(127);
+    }
+    close(pair[1]);
+
+    // 发送监听 socket，数据在 socket 缓冲区中等待新进程启动后接收
+    struct iovec iov = { &count, sizeof(count) };
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    if (sendmsg(pair[0], &msg, MSG_NOSIGNAL) != sizeof(count)) {
+        // 新进程收不到监听 socket，接收失败后会自行退出
+        close(pair[0]);
+        return -1;
+    }
+
+    *pid = child;
+    return pair[0];
+}
@@ -1,22 +1,92 @@
 #include"../include/http_connection.h"
+#include <limits.h>
+#include <time.h>
+#include <sys/random.h>
 
-// 定义 HTTP 响应的一些状态信息
-const char* ok_200_title = "OK";
-const char* error_400_title = "Bad Request";
-const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* error_403_title = "Forbidden";
-const char* error_403_form = "You do not have permission to get file from this server.\n";
-const char* error_404_title = "Not Found";
-const char* error_404_form = "The requested file was not found on this server.\n";
-const char* error_500_title = "Internal Error";
-const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+// 静态成员变量需要初始化
+std::atomic<int> HttpConnection::m_user_count(0);
+std::atomic<bool> HttpConnection::m_draining(false);
+int HttpConnection::m_read_limit = HttpConnection::DEFAULT_READ_LIMIT;
+std::string HttpConnection::m_doc_root = DOC_ROOT;
+HttpConnection::CachePolicy HttpConnection::m_cache_policies[HttpConnection::MAX_CACHE_POLICIES];
+int HttpConnection::m_cache_policy_count = 0;
+HttpConnection::CachePolicy HttpConnection::m_default_policy;
+
+// 进程启动时从内核取得的随机种子，getrandom() 失败时退回到时间和进程号
+static unsigned long long randomSeed() {
+    unsigned long long seed = 0;
+    if (getrandom(&seed, sizeof(seed), 0) != (ssize_t)sizeof(seed)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        seed = ((unsigned long long)ts.tv_sec << 32) ^ (unsigned long long)ts.tv_nsec ^ ((unsigned long long)getpid() << 16);
+    }
+    return seed;
+}
 
-// 初始化网站的根目录
-const char* doc_root = "/home/utopianyouth/webserver/resources";
+static const unsigned long long boundary_seed = randomSeed();
+static std::atomic<unsigned long long> boundary_counter(0);
 
-// 静态成员变量需要初始化
-int HttpConnection::m_epoll_fd = -1;        // 主线程会创建 epoll 对象并且对其赋值
-int HttpConnection::m_user_count = 0;
+/*
+    多段范围响应的分隔符：随机种子加计数器，经过 splitmix64 混合，每个响应都不同；
+    不使用对象地址、inode 等信息，分隔符不会泄露服务器的内存布局
+*/
+static unsigned long long nextBoundary() {
+    unsigned long long x = boundary_seed + boundary_counter.fetch_add(1, std::memory_order_relaxed) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+    客户端是否接受 gzip 编码，Accept-Encoding: gzip, deflate, br
+    - 编码名称不区分大小写，q=0 表示明确拒绝
+    - "*" 表示接受任何没有单独列出的编码
+*/
+static bool acceptsGzip(std::string_view accept) {
+    bool gzip = false;
+    bool any = false;
+    bool gzip_listed = false;
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = (comma == std::string_view::npos) ? std::string_view() : accept.substr(comma + 1);
+
+        // 编码名称和可选的 ;q= 参数
+        size_t semicolon = item.find(';');
+        std::string_view coding = item.substr(0, semicolon);
+        while (!coding.empty() && ((coding.front() == ' ') || (coding.front() == '\t'))) {
+            coding.remove_prefix(1);
+        }
+        while (!coding.empty() && ((coding.back() == ' ') || (coding.back() == '\t'))) {
+            coding.remove_suffix(1);
+        }
+        bool allowed = true;
+        if (semicolon != std::string_view::npos) {
+            std::string_view params = item.substr(semicolon + 1);
+            size_t q = params.find("q=");
+            if (q != std::string_view::npos) {
+                // q=0、q=0.0、q=0.000 都表示拒绝
+                std::string_view value = params.substr(q + 2);
+                allowed = false;
+                for (size_t i = 0; (i < value.size()) && (value[i] != ' ') && (value[i] != ';'); ++i) {
+                    if ((value[i] >= '1') && (value[i] <= '9')) {
+                        allowed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (HttpRequest::equalsLower(coding, "gzip") || HttpRequest::equalsLower(coding, "x-gzip")) {
+            gzip_listed = true;
+            gzip = allowed;
+        }
+        else if (coding == "*") {
+            any = allowed;
+        }
+    }
+    return gzip_listed ? gzip : any;
+}
 
 // 设置文件描述符非阻塞
 int setNonBlocking(int fd) {
@@ -69,24 +139,36 @@ void modifyFDEpoll(int epoll_fd, int fd, int event_num) {
 
 // 关闭客户端连接
 void HttpConnection::closeConnection() {
+    this->unmap();      // 连接超时或者出错时，响应可能还没有发送完毕
+    this->releaseOutQueue();
+    this->m_read_buf.clear();   // 归还从分片池申请的分片
     if (this->m_sockfd != -1) {
-        removeFDEpoll(this->m_epoll_fd, this->m_sockfd);
+        if (this->m_epoll_fd != -1) {
+            removeFDEpoll(this->m_epoll_fd, this->m_sockfd);
+        }
+        else {
+            close(this->m_sockfd);
+        }
         this->m_sockfd = -1;
         --this->m_user_count;       // 连接的客户端总数量减一
     }
 }
 
-// 初始化新接收的客户端连接，主线程中调用初始化 socket 地址
-void HttpConnection::init(int sockfd, const sockaddr_in& client_addr) {
+// 初始化新接收的客户端连接，reactor 线程中调用初始化 socket 地址，epoll_fd 是接受该连接的 reactor 的 epoll 对象（io_uring 后端为 -1）
+void HttpConnection::init(int sockfd, const sockaddr_in& client_addr, int epoll_fd) {
+    this->m_epoll_fd = epoll_fd;
     this->m_sockfd = sockfd;
     this->m_client_addr = client_addr;
+    this->m_worker = -1;
 
     // 设置端口复用
     int reuse = 1;
     setsockopt(this->m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-    // 添加到 epoll 对象中，指定 EPOLLONESHOT，一个线程处理一个 socket 通信
-    addFDEpoll(this->m_epoll_fd, this->m_sockfd, true, true);
+    // 添加到 epoll 对象中，指定 EPOLLONESHOT，一个线程处理一个 socket 通信；io_uring 后端的 socket 保持阻塞，由内核在可读写时完成操作
+    if (this->m_epoll_fd != -1) {
+        addFDEpoll(this->m_epoll_fd, this->m_sockfd, true, true);
+    }
     ++this->m_user_count;       // 连接的客户端数量 + 1
 
     // 初始化其余信息
@@ -96,43 +178,94 @@ void HttpConnection::init(int sockfd, const sockaddr_in& client_addr) {
 // 初始化其余的信息
 void HttpConnection::init() {
     this->bytes_to_send = 0;
-    this->bytes_have_send = 0;
+    this->m_response_start = 0;
+    this->m_chunk_count = 0;
+    this->m_chunk_index = 0;
+    this->m_entry_count = 0;
+    this->m_close_after = false;
+    this->m_more_requests = false;
+    this->m_deferred = false;
+
+    this->m_start_line = 0;
+    this->m_checked_index = 0;
+    this->m_read_index = 0;
+    this->m_write_index = 0;
+    this->initRequest();
+
+    this->m_read_buf.clear();
+    this->releaseOutQueue();
+}
 
+/*
+    一个请求处理完毕，准备解析流水线上的下一个请求
+    读缓冲区中已经收到的后续请求数据保留下来，从当前解析的位置继续解析
+*/
+void HttpConnection::initRequest() {
     this->m_check_state = CHECK_STATE_REQUESTLINE;      // 初始化状态为解析请求首行
     this->m_keep_alive = false;         // 默认不保持连接  Connection: keep-alive 保持连接
 
     this->m_method = GET;               // 默认 HTTP 请求方式为 GET
-    this->m_url = 0;                    // 请求目标文件的文件名
-    this->m_version = 0;
     this->m_content_length = 0;
-    this->m_host = 0;
-    this->m_start_line = 0;
-    this->m_checked_index = 0;
-    this->m_read_index = 0;
-    this->m_write_index = 0;
+    this->m_gzip = false;
+    this->m_vary = false;
+    this->m_range_count = 0;
+    this->m_request.clear();            // 请求行和请求头指向的数据即将被丢弃
+
+    this->m_start_line = this->m_checked_index;
+    this->m_request_start = this->m_checked_index;
+    this->m_read_buf.releaseLines();    // 上一个请求跨越分片的行已经不再使用
+}
+
+// 丢弃当前请求之前的数据，归还整个已经处理完的分片，腾出空间继续读取，已经解析出的指针同步移动
+void HttpConnection::compactReadBuffer() {
+    if (this->m_request_start == 0) {
+        return;
+    }
+
+    const char* moved = NULL;
+    int moved_offset = 0;
+    int shift = this->m_read_buf.consume(this->m_request_start, &moved, &moved_offset);
+    if (moved_offset > 0) {
+        this->m_request.relocate(moved, moved + ChainBuffer::SLICE_SIZE, moved_offset);
+    }
 
-    bzero(this->m_read_buf, READ_BUFFER_SIZE);
-    bzero(this->m_write_buf, WRITE_BUFFER_SIZE);
-    bzero(this->m_real_file, FILENAME_LEN);         // 目标文件的完整路径
+    this->m_read_index -= shift;
+    this->m_checked_index -= shift;
+    this->m_start_line -= shift;
+    this->m_request_start -= shift;
 }
 
-// 线程池工作队列满，丢弃读取的 HTTP 请求数据
-void HttpConnection::clearBuffer() {
-    this->init();
+/*
+    线程池过载时由 reactor 线程调用，请求还没有解析，访问日志中的请求行记为 "-"
+    预先生成的 503 响应很短，socket 的发送缓冲区一定能容纳，直接非阻塞地发送一次，不进入发送队列；
+    响应不保持连接，读缓冲区中的流水线请求随连接一起丢弃，客户端在 Retry-After 之后重新发送
+*/
+void HttpConnection::rejectOverloaded() {
+    const struct iovec& response = errorResponse(503, false);
+    ssize_t sent = send(this->m_sockfd, response.iov_base, response.iov_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent > 0) {
+        ServerStats::add(ServerStats::BYTES_OUT, sent);
+    }
+    ServerStats::request(503);
+    AccessLog::getInstance()->log(this->m_client_addr, std::string_view(), 503, response.iov_len);
 }
 
 // 循环读取客户端数据，直到无数据可读或者对方关闭连接
 bool HttpConnection::read() {
-    // m_read_index 记录 m_read_buf 数组的遍历情况
-    if (this->m_read_index >= READ_BUFFER_SIZE) {
-        // 没有数据可读
+    // 丢弃已经处理完毕的流水线请求，保留还没有处理的数据
+    this->compactReadBuffer();
+
+    // 缓存的数据已经达到上限，而且其中没有可以处理的完整请求（请求头或者请求体太大）
+    if (this->m_read_index >= m_read_limit) {
         return false;
     }
 
-    int bytes_read = 0;     // 记录读取到的字节数
+    ssize_t bytes_read = 0;     // 记录读取到的字节数
 
-    while (true) {
-        bytes_read = recv(this->m_sockfd, this->m_read_buf + this->m_read_index, this->READ_BUFFER_SIZE - this->m_read_index, 0);
+    // 达到上限时停止读取，剩余的流水线请求留在 socket 中，处理完已读取的请求后重新注册 EPOLLIN 时会再次触发
+    while (this->m_read_index < m_read_limit) {
+        // 普通的请求一次就能读完，只有在填满当前分片之后才申请新的分片，通过 readv() 一次读入多个分片
+        bytes_read = this->m_read_buf.readFrom(this->m_sockfd, m_read_limit - this->m_read_index);
         if (bytes_read == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 返回 EAGAIN 或 EWOULDBLOCK 表示没有数据可读
@@ -150,36 +283,63 @@ bool HttpConnection::read() {
         this->m_read_index += bytes_read;
     }
     // 输出每一次读取到的数据
-    //printf("read data:\n%s", this->m_read_buf);
+    //printf("read data:\n%s", this->m_read_buf.line(0, this->m_read_index));
+    return true;
+}
+
+// io_uring 后端收到数据，和 read() 一样先丢弃已经处理完毕的请求，再把数据追加到读缓冲区
+bool HttpConnection::appendInput(const char* data, int len) {
+    this->compactReadBuffer();
+    if (this->m_read_index >= m_read_limit) {
+        return false;
+    }
+    if (!this->m_read_buf.append(data, len)) {
+        return false;
+    }
+    this->m_read_index += len;
     return true;
 }
 
-// 获取 HTTP 请求的一行数据（解析一行，判断依据 \r\n）
+/*
+    获取 HTTP 请求的一行数据（解析一行，判断依据 \r\n）
+    在每个分片的连续数据中向量化查找 '\r' 或 '\n'，没有找到时 m_checked_index 停在已经扫描过的数据末尾，
+    请求分多次到达时从这里继续查找，不会重复扫描之前的数据
+*/
 HttpConnection::LINE_STATUS HttpConnection::parseLineData() {
-    char temp;
-    // 遍历读取到的字节流数据
-    for (; this->m_checked_index < this->m_read_index; ++this->m_checked_index) {
+    while (this->m_checked_index < this->m_read_index) {
+        int len = 0;
+        const char* begin = this->m_read_buf.span(this->m_checked_index, &len);
+        if (len > this->m_read_index - this->m_checked_index) {
+            len = this->m_read_index - this->m_checked_index;
+        }
 
-        temp = this->m_read_buf[this->m_checked_index];   // 当前检查的字符
+        const char* found = HttpScanner::findLineEnd(begin, begin + len);
+        if (found == NULL) {
+            // 当前分片中没有行结束符，继续查找下一个分片
+            this->m_checked_index += len;
+            continue;
+        }
+        this->m_checked_index += found - begin;
 
-        if (temp == '\r') {
+        if (*found == '\r') {
             if ((this->m_checked_index + 1) == this->m_read_index) {
                 // 指针指向地址比较，行数据最后一个字符是 '\r'，行数据不完整
                 return LINE_OPEN;
             }
-            else if (this->m_read_buf[this->m_checked_index + 1] == '\n') {
+            else if (this->m_read_buf.at(this->m_checked_index + 1) == '\n') {
                 // 一行完整数据，将 '\r' 和 '\n' 换成 '\0'
-                this->m_read_buf[this->m_checked_index++] = '\0';
-                this->m_read_buf[this->m_checked_index++] = '\0';
+                this->m_read_buf.at(this->m_checked_index++) = '\0';
+                this->m_read_buf.at(this->m_checked_index++) = '\0';
                 return LINE_OK;
             }
             return LINE_BAD;
         }
-        else if (temp == '\n') {
-            if ((this->m_checked_index > 1) && (this->m_read_buf[this->m_checked_index - 1] == '\r')) {
+        else {
+            // 找到的是 '\n'，前一个字符必须是 '\r'
+            if ((this->m_checked_index > 1) && (this->m_read_buf.at(this->m_checked_index - 1) == '\r')) {
                 // 一行完整数据，将 '\r' 和 '\n' 换成 '\0'
-                this->m_read_buf[this->m_checked_index - 1] = '\0';
-                this->m_read_buf[this->m_checked_index++] = '\0';
+                this->m_read_buf.at(this->m_checked_index - 1) = '\0';
+                this->m_read_buf.at(this->m_checked_index++) = '\0';
                 return LINE_OK;
             }
             return LINE_BAD;
@@ -190,19 +350,24 @@ HttpConnection::LINE_STATUS HttpConnection::parseLineData() {
     return LINE_OPEN;
 }
 
-// 解析 HTTP 请求行，获得请求方法，目标 URL，HTTP 版本
-HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text) {
+/*
+    解析 HTTP 请求行，获得请求方法，目标 URL，HTTP 版本
+    请求行的长度已知，分隔符通过向量化扫描查找，方法和版本只比较固定长度，每个字节只扫描一次
+*/
+HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text, int len) {
+    char* end = text + len;
+
     // GET /index.html HTTP/1.1
-    this->m_url = strpbrk(text, " \t");         // 判断第二个参数中的字符哪个在 text 中最先出现
-    if (this->m_url == NULL) {
+    char* url = (char*)HttpScanner::findDelimiter(text, end);     // 第一个空格或者制表符
+    if (url == NULL) {
         return BAD_REQUEST;
     }
 
     // GET\0/index.html HTTP/1.1
-    *this->m_url++ = '\0';
+    std::string_view method(text, url - text);
+    *url++ = '\0';
 
-    char* method = text;
-    if (strcasecmp(method, "GET") == 0) {       // 不区分大小，比较两个字符串，只支持 GET 请求
+    if (HttpRequest::equalsLower(method, "get")) {     // 不区分大小写，只支持 GET 请求
         this->m_method = GET;
     }
     else {
@@ -210,87 +375,115 @@ HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text) {
     }
 
     // /index.html HTTP/1.1
-    this->m_version = strpbrk(this->m_url, " \t");
-    if (this->m_version == NULL) {
+    char* version = (char*)HttpScanner::findDelimiter(url, end);
+    if (version == NULL) {
         return BAD_REQUEST;
     }
 
     // /index.html\0HTTP/1.1
-    *this->m_version++ = '\0';
-    if (strcasecmp(this->m_version, "HTTP/1.1") != 0) {
+    *version++ = '\0';
+    if (!HttpRequest::equalsLower(std::string_view(version, end - version), "http/1.1")) {
         // 只支持 HTTP1.1 
         return BAD_REQUEST;
     }
 
     // http://192.168.1.1:10000/index.html
-    if (strncasecmp(this->m_url, "http://", 7) == 0) {      // 不区分大小写，比较前 n 个字符
-        this->m_url += 7;   // 192.168.1.1:10000/index.html
-        this->m_url = strchr(this->m_url, '/');     // /index.html (查找指定字符第一次出现的位置)
+    std::string_view target(url, version - 1 - url);
+    if ((target.size() >= 7) && HttpRequest::equalsLower(target.substr(0, 7), "http://")) {
+        target.remove_prefix(7);            // 192.168.1.1:10000/index.html
+        size_t slash = target.find('/');    // /index.html (查找指定字符第一次出现的位置)
+        if (slash == std::string_view::npos) {
+            return BAD_REQUEST;
+        }
+        target.remove_prefix(slash);
     }
 
-    if ((this->m_url == NULL) || (this->m_url[0] != '/')) {
+    if (target.empty() || (target[0] != '/')) {
         return BAD_REQUEST;
     }
+    this->m_request.setRequestLine(method, target, std::string_view(version, end - version));
 
     this->m_check_state = CHECK_STATE_HEADER;       // 主状态机的检查状态变成检查请求头
 
     return NO_REQUEST;      // 继续解析 HTTP 请求内容
 }
 
-// 解析 HTTP 请求头信息
-HttpConnection::HTTP_CODE HttpConnection::parseRequestHeaders(char* text) {
+/*
+    解析 HTTP 请求头信息，每个请求头都记录到 m_request 中，之后可以按照编号或者名称 O(1) 查找
+    遇到空行时根据需要的请求头确定是否保持连接以及请求体的长度
+*/
+HttpConnection::HTTP_CODE HttpConnection::parseRequestHeaders(char* text, int len) {
     // 遇到空行，表示头部字段解析完毕
-    if (text[0] == '\0') {
-        if (this->m_content_length != 0) {
-            // 如果 HTTP 请求有请求体，则还需要读取 m_content_length 字节的请求体
-            // 状态机转移到 CHECK_STATE_CONTENT 状态            
-            this->m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
-        }
-        else {
-            // 否则说明我们已经得到了一个完整的 HTTP 请求
-            return GET_REQUEST;
-        }
+    if (len == 0) {
+        return this->finishHeaders();
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 处理 Connection 头部字段，Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");    // 计算前缀长度
-        if (strcasecmp(text, "keep-alive") == 0) {
-            this->m_keep_alive = true;
-        }
+
+    // Name: value，字段名和冒号之间不能有空白字符，值两端的空白字符去掉
+    const char* colon = (const char*)memchr(text, ':', len);
+    if ((colon == NULL) || (colon == text)) {
+        return BAD_REQUEST;
     }
-    else if (strncasecmp(text, "Proxy-Connection:", 17) == 0) {
-        // 处理 Proxy-Connection 头部字段，考虑代理服务器的行为（但是）
-        text += 17;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            this->m_keep_alive = true;
-        }
+    std::string_view name(text, colon - text);
+    std::string_view value(colon + 1, text + len - colon - 1);
+    while (!value.empty() && ((value.front() == ' ') || (value.front() == '\t'))) {
+        value.remove_prefix(1);
     }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        // 处理 Content-Length 头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        this->m_content_length = atol(text);    // 将字符串转换为长整型
+    while (!value.empty() && ((value.back() == ' ') || (value.back() == '\t'))) {
+        value.remove_suffix(1);
     }
-    else if (strncasecmp(text, "Host:", 5) == 0) {
-        // 处理 Host 头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        this->m_host = text;
+
+    this->m_request.addHeader(name, value);
+    return NO_REQUEST;  // 继续解析 HTTP 请求内容
+}
+
+// 请求头解析完毕，处理影响连接和请求体的请求头
+HttpConnection::HTTP_CODE HttpConnection::finishHeaders() {
+    // Connection: keep-alive 保持连接，也考虑代理服务器发送的 Proxy-Connection
+    // 旧进程排空连接期间不再保持连接，客户端在新的连接上继续发送请求，由新进程处理
+    this->m_keep_alive = HttpRequest::equalsLower(this->m_request.header(HDR_CONNECTION), "keep-alive") ||
+        HttpRequest::equalsLower(this->m_request.header(HDR_PROXY_CONNECTION), "keep-alive");
+    if (this->m_draining.load(std::memory_order_relaxed)) {
+        this->m_keep_alive = false;
     }
-    else {
-        // 请求体中的其它类型
-        //printf("unknow header %s\n", text);
+
+    // Content-Length 只能是十进制数字；多个不同的值无法确定请求的边界，代理和服务器可能各取一个，拒绝请求并关闭连接
+    if (this->m_request.conflicting(HDR_CONTENT_LENGTH)) {
+        return BAD_REQUEST;
     }
-    return NO_REQUEST;  // 继续解析 HTTP 请求内容
+    // 不支持分块等传输编码，带 Transfer-Encoding 的请求体边界无法确定，拒绝请求并关闭连接；
+    // 同时带 Content-Length 时代理可能按照其中任意一个确定边界，属于格式错误
+    if (this->m_request.hasHeader(HDR_TRANSFER_ENCODING)) {
+        return this->m_request.hasHeader(HDR_CONTENT_LENGTH) ? BAD_REQUEST : NOT_IMPLEMENTED;
+    }
+    if (this->m_request.hasHeader(HDR_CONTENT_LENGTH)) {
+        std::string_view length = this->m_request.header(HDR_CONTENT_LENGTH);
+        if (length.empty() || (length.size() > 18)) {
+            return BAD_REQUEST;
+        }
+        this->m_content_length = 0;
+        for (size_t i = 0; i < length.size(); ++i) {
+            if ((length[i] < '0') || (length[i] > '9')) {
+                return BAD_REQUEST;
+            }
+            this->m_content_length = this->m_content_length * 10 + (length[i] - '0');
+        }
+    }
+
+    if (this->m_content_length != 0) {
+        // 如果 HTTP 请求有请求体，则还需要读取 m_content_length 字节的请求体
+        // 状态机转移到 CHECK_STATE_CONTENT 状态
+        this->m_check_state = CHECK_STATE_CONTENT;
+        return NO_REQUEST;
+    }
+    // 否则说明我们已经得到了一个完整的 HTTP 请求
+    return GET_REQUEST;
 }
 
 // 这里并没有真正解析 HTTP 请求体信息，只是判断它是否被完整的读入了
-HttpConnection::HTTP_CODE HttpConnection::parseRequestContent(char* text) {
+// 请求体之后可能紧跟着流水线上的下一个请求，不能在请求体末尾写入 '\0'，只跳过请求体
+HttpConnection::HTTP_CODE HttpConnection::parseRequestContent() {
     if (this->m_read_index >= (this->m_content_length + this->m_checked_index)) {
-        text[this->m_content_length] = '\0';
+        this->m_checked_index += this->m_content_length;
         return GET_REQUEST;
     }
     return NO_REQUEST;      // 没有被完全读入
@@ -306,35 +499,45 @@ HttpConnection::HTTP_CODE HttpConnection::processRead() {
     HTTP_CODE ret = NO_REQUEST;
 
     char* text = 0;
+    long long parse_start = ServerStats::sampleStart();
+    // 请求体不完整时不能按行扫描请求体，否则 m_checked_index 会越过还没有读完的请求体
     while (((this->m_check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK)) ||
-        ((line_status = parseLineData()) == LINE_OK)) {
+        ((this->m_check_state != CHECK_STATE_CONTENT) && ((line_status = parseLineData()) == LINE_OK))) {
         // 解析到了一行完整的数据，或者解析到了请求体，也是完整的数据
 
-        // 获取一行数据
-        text = this->getLine();
+        // 获取一行数据，请求体不需要按行读取
+        if (this->m_check_state != CHECK_STATE_CONTENT) {
+            text = this->getLine();
+            if (text == NULL) {
+                // 拷贝跨越分片的行时内存不足，这一行之后的数据没有解析，不能继续使用这个连接
+                this->m_keep_alive = false;
+                return INTERNAL_ERROR;
+            }
+        }
+        int text_len = this->m_checked_index - this->m_start_line - 2;     // 行的长度，不包括已经换成 '\0' 的 \r\n
         this->m_start_line = this->m_checked_index;
         //printf("got 1 http line: %s\n", text);
 
         switch (this->m_check_state) {
         case CHECK_STATE_REQUESTLINE:
-            ret = this->parseRequestLine(text);
+            ret = this->parseRequestLine(text, text_len);
             if (ret == BAD_REQUEST) {
                 return BAD_REQUEST;
             }
             break;
         case CHECK_STATE_HEADER:
-            ret = this->parseRequestHeaders(text);
-            if (ret == BAD_REQUEST) {
-                return BAD_REQUEST;
+            ret = this->parseRequestHeaders(text, text_len);
+            if ((ret == BAD_REQUEST) || (ret == NOT_IMPLEMENTED)) {
+                return ret;
             }
             else if (ret == GET_REQUEST) {
-                return this->GetRequestFile();      // 表示获取一个完整的客户端请求，向客户端响应请求的内容
+                return this->finishRequest(parse_start);    // 表示获取一个完整的客户端请求，向客户端响应请求的内容
             }
             break;
         case CHECK_STATE_CONTENT:
-            ret = parseRequestContent(text);
+            ret = this->parseRequestContent();
             if (ret == GET_REQUEST) {
-                return this->GetRequestFile();
+                return this->finishRequest(parse_start);
             }
             else {
                 line_status = LINE_OPEN;        // 请求体数据没有被完全读入
@@ -347,79 +550,547 @@ HttpConnection::HTTP_CODE HttpConnection::processRead() {
     return NO_REQUEST;
 }
 
+/*
+    一个请求解析完毕，parse_start 是本次调用 processRead() 的时间，为 0 时这个请求没有被抽中计时
+    （请求分多次到达时只统计最后一次解析的耗时，不包括等待数据的时间）
+    保留的 STATS_URL 直接输出运行指标，不查找网站根目录中的文件
+*/
+HttpConnection::HTTP_CODE HttpConnection::finishRequest(long long parse_start) {
+    if (this->m_request.target() == STATS_URL) {
+        return STATS_REQUEST;
+    }
+    if (parse_start == 0) {
+        return this->GetRequestFile();
+    }
+    long long parsed = ServerStats::now();
+    ServerStats::observe(ServerStats::PARSE, parsed - parse_start);
+    HTTP_CODE ret = this->GetRequestFile();
+    ServerStats::observe(ServerStats::FILE_LOOKUP, ServerStats::now() - parsed);
+    return ret;
+}
+
+// 查找文件失败时 errno 对应的响应
+static HttpConnection::HTTP_CODE fileError(int err) {
+    switch (err) {
+    case EACCES:
+        return HttpConnection::FORBIDDEN_REQUEST;   // 没有访问权限
+    case EISDIR:
+        return HttpConnection::BAD_REQUEST;         // 请求的是目录
+    case ENOENT:
+    case ENOTDIR:
+    case ENAMETOOLONG:
+    case ELOOP:
+        return HttpConnection::NO_RESOURCE;         // 没有找到请求的文件
+    default:
+        return HttpConnection::BAD_REQUEST;         // 打开文件或者创建内存映射失败
+    }
+}
+
+/*
+    把请求的目标规范化成网站根目录下的路径，写入 out（最多 size 字节，不写 '\0'），返回路径的长度
+    - 合并连续的 '/'，去掉 "." 路径段，".." 回到上一级目录，末尾的 '/' 保留
+    - ".." 越过根目录时返回 -1，规范化后的路径超过 size 字节时返回 -2
+    同一个文件的不同写法（//szu.html、/./szu.html、/imgs/../szu.html）得到同一个缓存键，也不能访问网站根目录之外的文件
+*/
+static int normalizePath(std::string_view url, char* out, int size) {
+    int len = 0;
+    size_t i = 0;
+    while (i < url.size()) {
+        while ((i < url.size()) && (url[i] == '/')) {
+            ++i;
+        }
+        size_t begin = i;
+        while ((i < url.size()) && (url[i] != '/')) {
+            ++i;
+        }
+        std::string_view segment = url.substr(begin, i - begin);
+        if (segment.empty() || (segment == ".")) {
+            continue;
+        }
+        if (segment == "..") {
+            if (len == 0) {
+                return -1;
+            }
+            while (out[--len] != '/') {
+            }
+            continue;
+        }
+        if (len + 1 + (int)segment.size() > size) {
+            return -2;
+        }
+        out[len++] = '/';
+        memcpy(out + len, segment.data(), segment.size());
+        len += (int)segment.size();
+    }
+
+    // 根目录本身是 "/"，以 '/' 结尾的目标仍然按照目录处理
+    if ((len == 0) || (url.back() == '/')) {
+        if (len + 1 > size) {
+            return -2;
+        }
+        out[len++] = '/';
+    }
+    return len;
+}
+
 /*
     当得到一个完整、正确的 HTTP 请求时，我们就分析目标文件的属性，
-    如果目标文件存在、对所有用户可读，且不是目录，则使用 mmap 将
-    其映射到内存地址 m_file_address 处，并告诉调用者获取文件成功
+    如果目标文件存在、对所有用户可读，且不是目录，则从文件缓存中借用
+    该文件的内存映射（m_file_entry->address），并告诉调用者获取文件成功
 */
 HttpConnection::HTTP_CODE HttpConnection::GetRequestFile() {
+    // 目标文件的完整路径只在查找文件缓存时使用，不需要保存在连接对象中
+    char real_file[FILENAME_LEN];
+
     // "/home/utopiayouth/linux_study/webserver/resources"
-    strcpy(this->m_real_file, doc_root);
-    int len = strlen(doc_root);
+    int len = (int)m_doc_root.size();
+    memcpy(real_file, m_doc_root.data(), len);
 
-    // 请求资源的路径拼接, FILENAME_LEN - len - 1 多一个减一是因为字符串结束符 '\0'
-    strncpy(this->m_real_file + len, this->m_url, FILENAME_LEN - len - 1);
+    // 请求资源的路径规范化之后拼接, FILENAME_LEN - len - 1 多一个减一是因为字符串结束符 '\0'
+    // 越过网站根目录的请求是错误的请求，过长的路径不可能对应网站中的文件
+    int url_len = normalizePath(this->m_request.target(), real_file + len, FILENAME_LEN - len - 1);
+    if (url_len == -1) {
+        return BAD_REQUEST;
+    }
+    if (url_len < 0) {
+        return NO_RESOURCE;
+    }
+    real_file[len + url_len] = '\0';
+
+    // 命中缓存时不需要 stat()、open() 和 mmap()
+    FileCache* cache = FileCache::getInstance();
+    this->m_file_entry = cache->find(real_file);
+    if (this->m_file_entry == NULL) {
+        // 没有命中时条件请求先只用 stat() 的结果判断，304 响应不需要打开文件
+        HTTP_CODE ret = this->checkNotModified(real_file);
+        if (ret != FILE_REQUEST) {
+            return ret;
+        }
 
-    // 获取 m_real_file 文件相关的状态信息，存储到 struct stat 结构体中，-1 表示失败，0 表示成功
-    if (stat(this->m_real_file, &this->m_file_stat) < 0) {
-        return NO_RESOURCE;     // 没有找到请求的文件
+        // 需要发送响应体，由文件缓存加载文件
+        this->m_file_entry = cache->acquire(real_file);
+        if (this->m_file_entry == NULL) {
+            return fileError(errno);
+        }
     }
 
-    // 判断访问权限
-    if (!(m_file_stat.st_mode & S_IROTH)) {
-        return FORBIDDEN_REQUEST;
+    // 范围请求，If-Range 条件不满足时忽略 Range 发送整个文件
+    int ranges = 0;
+    if (this->m_request.hasHeader(HDR_RANGE) && this->ifRangeMatches()) {
+        ranges = this->parseRanges(this->m_file_entry->st.st_size);
+        this->m_range_count = (ranges > 0) ? ranges : 0;
     }
 
-    // 判断是否是目录
-    if (S_ISDIR(this->m_file_stat.st_mode)) {
-        return BAD_REQUEST;
+    // 文本类资源按照 Accept-Encoding 协商压缩，不管是否压缩，响应都随 Accept-Encoding 变化；范围总是针对未压缩的原始文件
+    GzipCache* gzip = GzipCache::getInstance();
+    if (gzip->enabled() && GzipCache::compressible(this->m_file_entry->path, this->m_file_entry->st.st_size)) {
+        this->m_vary = true;
+        if ((ranges == 0) && acceptsGzip(this->m_request.header(HDR_ACCEPT_ENCODING))) {
+            // 变体还没有准备好时发送原始文件，由后台线程准备，请求线程从不压缩
+            FileEntry* variant = gzip->acquire(this->m_file_entry);
+            if (variant) {
+                FileCache::getInstance()->release(this->m_file_entry);
+                this->m_file_entry = variant;
+                this->m_gzip = true;
+            }
+        }
     }
 
-    // 以只读方式打开文件
-    int fd = open(this->m_real_file, O_RDONLY);
-    if (fd == -1) {
-        return BAD_REQUEST;
+    // 条件请求先于范围请求判断，304 和 416 响应都需要保留缓存项（实体标签、文件大小），生成响应后归还
+    if (this->notModified()) {
+        return NOT_MODIFIED;
+    }
+    if (ranges < 0) {
+        return RANGE_NOT_SATISFIABLE;
     }
 
-    // 对待响应的文件创建内存映射
-    this->m_file_address = (char*)mmap(NULL, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (!this->m_file_address) {
-        return BAD_REQUEST;
+    return FILE_REQUEST;    // 文件请求，获取文件成功
+}
+
+/*
+    没有命中文件缓存的条件请求（不带 Range）：只用 stat() 得到的验证器判断客户端的副本是否仍然有效，
+    有效时 m_file_entry 是只有验证器的缓存项，返回 NOT_MODIFIED，整个过程不打开文件也不建立内存映射；
+    文件不存在等错误直接返回对应的状态，需要发送响应体时返回 FILE_REQUEST，由调用者加载文件
+    - 客户端接受 gzip 时先和 gzip 变体的验证器比较，再和原始文件的比较，客户端缓存的可能是其中任意一个
+*/
+HttpConnection::HTTP_CODE HttpConnection::checkNotModified(const char* path) {
+    if ((!this->m_request.hasHeader(HDR_IF_NONE_MATCH) && !this->m_request.hasHeader(HDR_IF_MODIFIED_SINCE)) ||
+        this->m_request.hasHeader(HDR_RANGE)) {
+        return FILE_REQUEST;
+    }
+    FileEntry* original = FileCache::statOnly(path);
+    if (original == NULL) {
+        return fileError(errno);
     }
 
-    close(fd);
+    GzipCache* gzip = GzipCache::getInstance();
+    if (gzip->enabled() && GzipCache::compressible(original->path, original->st.st_size)) {
+        this->m_vary = true;
+        FileEntry* variant = acceptsGzip(this->m_request.header(HDR_ACCEPT_ENCODING)) ? gzip->validators(original) : NULL;
+        if (variant != NULL) {
+            this->m_file_entry = variant;
+            this->m_gzip = true;
+            if (this->notModified()) {
+                FileCache::getInstance()->release(original);
+                return NOT_MODIFIED;
+            }
+            FileCache::getInstance()->release(variant);
+            this->m_gzip = false;
+        }
+    }
 
-    return FILE_REQUEST;    // 文件请求，获取文件成功
+    this->m_file_entry = original;
+    if (this->notModified()) {
+        return NOT_MODIFIED;
+    }
+    FileCache::getInstance()->release(original);
+    this->m_file_entry = NULL;
+    this->m_vary = false;
+    return FILE_REQUEST;
+}
+
+/*
+    If-Range 条件是否满足，满足时才按照 Range 发送部分内容
+    - 没有 If-Range 时满足
+    - 实体标签使用强比较：必须和文件的实体标签完全相同，弱标签 W/"xyz" 总是不匹配
+    - 日期必须和文件的修改时间完全相同（精确到秒）
+*/
+bool HttpConnection::ifRangeMatches() const {
+    std::string_view condition = this->m_request.header(HDR_IF_RANGE);
+    if (condition.empty()) {
+        return !this->m_request.hasHeader(HDR_IF_RANGE);
+    }
+    if ((condition.front() == '"') || (condition.substr(0, 2) == "W/")) {
+        return condition == this->m_file_entry->etag;
+    }
+    time_t date = 0;
+    return parseHttpDate(condition, &date) && (date == this->m_file_entry->st.st_mtime);
 }
 
-// 对内存映射区执行 munmap 操作，释放内存映射
+/*
+    条件请求：客户端缓存的副本是否仍然有效（RFC 7232 第 6 节的顺序）
+    - 有 If-None-Match 时只看它：列表中任意一个实体标签和当前发送的文件弱比较相同（忽略 W/ 前缀），或者是 "*"
+    - 否则看 If-Modified-Since：文件在该时间之后没有被修改过
+*/
+bool HttpConnection::notModified() const {
+    if (this->m_request.hasHeader(HDR_IF_NONE_MATCH)) {
+        std::string_view etag = this->m_file_entry->etag;
+        std::string_view list = this->m_request.header(HDR_IF_NONE_MATCH);
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view item = list.substr(0, comma);
+            list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+            while (!item.empty() && ((item.front() == ' ') || (item.front() == '\t'))) {
+                item.remove_prefix(1);
+            }
+            while (!item.empty() && ((item.back() == ' ') || (item.back() == '\t'))) {
+                item.remove_suffix(1);
+            }
+            if (item.substr(0, 2) == "W/") {
+                item.remove_prefix(2);
+            }
+            if ((item == "*") || (item == etag)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string_view since = this->m_request.header(HDR_IF_MODIFIED_SINCE);
+    time_t date = 0;
+    return !since.empty() && parseHttpDate(since, &date) && (this->m_file_entry->st.st_mtime <= date);
+}
+
+/*
+    网站根目录转换成绝对路径，文件缓存以完整路径为键，根目录的写法不同时也不会重复缓存同一个文件；
+    拼接请求路径时至少还要留出 "/" 和字符串结束符的位置
+*/
+bool HttpConnection::setDocRoot(const char* path) {
+    char resolved[PATH_MAX];
+    struct stat st;
+    if ((realpath(path, resolved) == NULL) || (stat(resolved, &st) == -1) || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    size_t len = strlen(resolved);
+    if ((len > 0) && (resolved[len - 1] == '/')) {
+        resolved[--len] = '\0';    // 根目录 "/"
+    }
+    if (len + 2 > (size_t)FILENAME_LEN) {
+        return false;
+    }
+    m_doc_root.assign(resolved, len);
+    return true;
+}
+
+/*
+    添加缓存策略，格式为 扩展名=秒数，例如 .css=86400、.html=0，扩展名为 "*" 时是其它文件的默认策略
+    同一个扩展名配置多次时以最后一次为准，Cache-Control 响应头在这里生成，响应时直接拷贝
+*/
+bool HttpConnection::addCachePolicy(const char* spec) {
+    const char* equal = strchr(spec, '=');
+    if ((equal == NULL) || (equal == spec) || (equal[1] == '\0')) {
+        return false;
+    }
+    char* end = NULL;
+    long max_age = strtol(equal + 1, &end, 10);
+    if ((*end != '\0') || (max_age < 0) || (max_age > 0x7fffffff)) {
+        return false;
+    }
+
+    CachePolicy* policy = &m_default_policy;
+    std::string_view suffix(spec, equal - spec);
+    if (suffix != "*") {
+        if ((suffix.front() != '.') || (suffix.size() >= sizeof(m_cache_policies[0].suffix))) {
+            return false;
+        }
+        int i = 0;
+        while ((i < m_cache_policy_count) && (suffix != m_cache_policies[i].suffix)) {
+            ++i;
+        }
+        if (i == MAX_CACHE_POLICIES) {
+            return false;
+        }
+        policy = &m_cache_policies[i];
+        memcpy(policy->suffix, suffix.data(), suffix.size());
+        policy->suffix[suffix.size()] = '\0';
+        if (i == m_cache_policy_count) {
+            ++m_cache_policy_count;
+        }
+    }
+
+    if (max_age > 0) {
+        policy->header_len = snprintf(policy->header, sizeof(policy->header), "Cache-Control: max-age=%ld\r\n", max_age);
+    }
+    else {
+        policy->header_len = snprintf(policy->header, sizeof(policy->header), "Cache-Control: no-cache\r\n");
+    }
+    return true;
+}
+
+// 读取一个十进制数，太大的数按照 max 处理，返回是否读到了数字
+static bool parseOffset(std::string_view& text, off_t max, off_t* value) {
+    size_t i = 0;
+    *value = 0;
+    while ((i < text.size()) && (text[i] >= '0') && (text[i] <= '9')) {
+        if (*value <= (max - (text[i] - '0')) / 10) {
+            *value = *value * 10 + (text[i] - '0');
+        }
+        else {
+            *value = max;
+        }
+        ++i;
+    }
+    text.remove_prefix(i);
+    return i > 0;
+}
+
+/*
+    解析 Range: bytes=0-499, 500-, -200，结果按照请求中的顺序存放在 m_ranges 中
+    - first-last：last 超出文件时截断到文件末尾，first 超出文件的范围不能满足
+    - first-：从 first 到文件末尾
+    - -suffix：文件的最后 suffix 个字节
+    - 返回可以满足的范围数量；返回 -1 表示所有范围都不能满足（416）
+    - 返回 0 表示忽略 Range 发送整个文件：不是 bytes 单位、语法错误、范围太多或者相互重叠
+      （重叠的范围会让一个小请求放大成很大的响应，RFC 7233 允许服务器直接忽略）
+*/
+int HttpConnection::parseRanges(off_t size) {
+    const off_t max = (off_t)(~(unsigned long long)0 >> 1);
+    std::string_view spec = this->m_request.header(HDR_RANGE);
+    if ((spec.size() < 6) || !HttpRequest::equalsLower(spec.substr(0, 6), "bytes=")) {
+        return 0;
+    }
+    spec.remove_prefix(6);
+
+    int count = 0;
+    bool satisfiable = false;
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = (comma == std::string_view::npos) ? std::string_view() : spec.substr(comma + 1);
+        while (!item.empty() && ((item.front() == ' ') || (item.front() == '\t'))) {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && ((item.back() == ' ') || (item.back() == '\t'))) {
+            item.remove_suffix(1);
+        }
+        if (item.empty()) {
+            continue;       // 列表中允许出现空元素
+        }
+
+        off_t first = 0;
+        off_t last = 0;
+        if (item.front() == '-') {
+            item.remove_prefix(1);
+            off_t suffix = 0;
+            if (!parseOffset(item, max, &suffix) || !item.empty()) {
+                return 0;
+            }
+            if ((suffix == 0) || (size == 0)) {
+                continue;   // 空的后缀范围不能满足
+            }
+            first = (suffix < size) ? size - suffix : 0;
+            last = size - 1;
+        }
+        else {
+            if (!parseOffset(item, max, &first) || item.empty() || (item.front() != '-')) {
+                return 0;
+            }
+            item.remove_prefix(1);
+            last = max;
+            if (!item.empty() && (!parseOffset(item, max, &last) || !item.empty())) {
+                return 0;
+            }
+            if (last < first) {
+                return 0;
+            }
+            if (first >= size) {
+                continue;   // 起始位置超出文件，该范围不能满足
+            }
+            if (last >= size) {
+                last = size - 1;
+            }
+        }
+
+        satisfiable = true;
+        if (count == MAX_RANGES) {
+            return 0;
+        }
+        for (int i = 0; i < count; ++i) {
+            if ((first <= this->m_ranges[i].last) && (this->m_ranges[i].first <= last)) {
+                return 0;
+            }
+        }
+        this->m_ranges[count].first = first;
+        this->m_ranges[count].last = last;
+        ++count;
+    }
+    return satisfiable ? count : -1;
+}
+
+// 归还借用的文件缓存项，内存映射由文件缓存统一管理
 void HttpConnection::unmap() {
-    if (this->m_file_address) {
-        munmap(this->m_file_address, this->m_file_stat.st_size);
-        m_file_address = NULL;
+    if (this->m_file_entry) {
+        FileCache::getInstance()->release(this->m_file_entry);
+        this->m_file_entry = NULL;
+    }
+    this->releaseEntries();
+}
+
+// 归还发送队列中已经发送完毕的响应借用的文件缓存项，推迟处理的请求借用的 m_file_entry 保留
+void HttpConnection::releaseEntries() {
+    for (int i = 0;i < this->m_entry_count;++i) {
+        FileCache::getInstance()->release(this->m_out->entries[i]);
+    }
+    this->m_entry_count = 0;
+}
+
+// 从分片池中申请发送队列，已经持有时直接使用
+bool HttpConnection::acquireOutQueue() {
+    if (this->m_out == NULL) {
+        this->m_out = (OutQueue*)SlicePool::getInstance()->acquire();
+    }
+    return this->m_out != NULL;
+}
+
+// 归还发送队列，调用者需要先归还其中的文件缓存项
+void HttpConnection::releaseOutQueue() {
+    if (this->m_out) {
+        SlicePool::getInstance()->release((char*)this->m_out);
+        this->m_out = NULL;
+    }
+    this->m_chunk_count = 0;
+    this->m_chunk_index = 0;
+    this->m_write_index = 0;
+    this->bytes_to_send = 0;
+    this->m_write_start = 0;
+    if (this->m_stats_body.capacity() > 0) {
+        std::string().swap(this->m_stats_body);
+    }
+}
+
+// 把一个数据块放入发送队列
+void HttpConnection::queueChunk(const char* base, int fd, off_t offset, off_t end) {
+    OutChunk* chunk = &this->m_out->chunks[this->m_chunk_count++];
+    chunk->base = base;
+    chunk->fd = fd;
+    chunk->offset = offset;
+    chunk->end = end;
+    this->bytes_to_send += end - offset;
+}
+
+// 已经发送了 bytes 字节，跳过发送完毕的数据块，记录没有发送完的数据块的发送位置
+void HttpConnection::consumeChunks(off_t bytes) {
+    ServerStats::add(ServerStats::BYTES_OUT, bytes);
+    this->bytes_to_send -= bytes;
+    while ((bytes > 0) && (this->m_chunk_index < this->m_chunk_count)) {
+        OutChunk* chunk = &this->m_out->chunks[this->m_chunk_index];
+        off_t remain = chunk->end - chunk->offset;
+        if (bytes < remain) {
+            chunk->offset += bytes;
+            return;
+        }
+        bytes -= remain;
+        chunk->offset = chunk->end;
+        ++this->m_chunk_index;
     }
 }
 
-// 写 HTTP 响应
+/*
+    写 HTTP 响应，依次发送发送队列中的数据块
+    - 连续的内存块（多个流水线响应的响应头和内存映射的响应体）合并成一次 sendmsg() 发送
+    - 遇到文件区间时先发送它前面的内存块，MSG_MORE 让内核等待随后的文件数据，再用 sendfile() 发送文件区间
+*/
 bool HttpConnection::write() {
-    int tmp = 0;
-    if (this->bytes_to_send == 0) {
-        // 将要发送的字节为 0，这一次响应结束
+    if (this->m_chunk_index >= this->m_chunk_count) {
+        // 没有需要发送的数据，继续等待下一个请求
         modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
-        this->init();
         return true;
     }
 
-    while (1) {
-        // 分散写，m_iv[2] 表示有两块内存区被分散写（同时操作两块内存区）
-        // 本项目操作的第一块内存区（即 this->m_write_buf, 存储了响应状态行, 响应头）
-        // 本项目操作的第二块内存区（即解析 HTTP 请求成功后创建的内存映射区, 是存储在 web 服务器上，发送给客户端的资源文件）
-        tmp = writev(this->m_sockfd, this->m_iv, this->m_iv_count);
+    while (this->m_chunk_index < this->m_chunk_count) {
+        OutChunk* chunk = &this->m_out->chunks[this->m_chunk_index];
+        ssize_t tmp = 0;
+
+        if (chunk->base == NULL) {
+            // 响应体由内核直接从文件页缓存发送到 socket，不经过用户态，offset 由我们自己维护，不影响共享 fd 的文件偏移
+            off_t offset = chunk->offset;
+            off_t remain = chunk->end - chunk->offset;
+            size_t count = ((size_t)remain > MAX_SENDFILE_CHUNK) ? MAX_SENDFILE_CHUNK : remain;
+            tmp = sendfile(this->m_sockfd, chunk->fd, &offset, count);
+            if (tmp == 0) {
+                // 文件在发送过程中被截断，无法再发送剩余的响应体
+                this->unmap();
+                return false;
+            }
+        }
+        else {
+            // 分散写，收集从当前位置开始的所有连续内存块
+            struct iovec iv[MAX_PIPELINE * 2];
+            int iv_count = 0;
+            bool more = false;
+            for (int i = this->m_chunk_index;i < this->m_chunk_count;++i) {
+                if (this->m_out->chunks[i].base == NULL) {
+                    more = true;
+                    break;
+                }
+                iv[iv_count].iov_base = (char*)this->m_out->chunks[i].base + this->m_out->chunks[i].offset;
+                iv[iv_count].iov_len = this->m_out->chunks[i].end - this->m_out->chunks[i].offset;
+                ++iv_count;
+            }
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iv;
+            msg.msg_iovlen = iv_count;
+            tmp = sendmsg(this->m_sockfd, &msg, more ? MSG_MORE : 0);
+        }
+
         if (tmp <= -1) {
             /*
                 如果 TCP 写缓冲区没有空间，则等待下一轮 EPOLLOUT 事件，重新调用 modifyFDEpoll() 是有必要的，
                 以便主线程在 epoll_wait() 时，可以检测到 web 程序触发了 EPOLLOUT 事件，需要向 TCP 写缓冲区中写数据,
                 在此期间，服务器无法立即接收到同一客户端的下一个请求（没有注册 EPOLLIN 事件），但可以保证连接的完整性。
+                每个数据块的发送位置记录在发送队列中，下一次 EPOLLOUT 时从中断的位置继续发送。
             */
             if (errno == EAGAIN) {
                 modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLOUT);
@@ -429,176 +1100,535 @@ bool HttpConnection::write() {
             return false;
         }
 
-        this->bytes_have_send += tmp;
-        this->bytes_to_send -= tmp;
+        this->consumeChunks(tmp);
+    }
 
-        if (this->bytes_have_send >= this->m_iv[0].iov_len) {
-            // 响应状态行和响应头发送完毕，发送响应体
-            this->m_iv[0].iov_len = 0;
-            this->m_iv[1].iov_base = this->m_file_address + (this->bytes_have_send - this->m_write_index);
-            this->m_iv[1].iov_len = this->bytes_to_send;
-        }
-        else {
-            // 继续发送响应状态行和响应头
-            this->m_iv[0].iov_base = this->m_write_buf + this->bytes_have_send;
-            this->m_iv[0].iov_len = this->m_iv[0].iov_len - tmp;
-        }
+    if (!this->finishWrite()) {
+        // 只响应一次，关闭 TCP 通信不用初始化 HTTP 任务类对象也行
+        // 下一个客户端连接到服务器上时，调用了 HTTP 任务类的初始化函数
+        return false;
+    }
 
-        if (this->bytes_to_send <= 0) {
-            // 没有数据要发送了
-            this->unmap();
-            modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+    // 读缓冲区中还有因为队列满而没有处理的请求时，由调用者继续处理，此时不能注册 EPOLLIN，避免两个线程同时处理该连接
+    if (!this->m_more_requests) {
+        modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+    }
+    return true;
+}
 
-            if (this->m_keep_alive) {
-                // HTTP 响应写入到内核缓冲区成功，初始化该连接对象的缓冲区，准备接收下一次HTTP请求
-                this->init();
-                return true;
-            }
-            else {
-                // 只响应一次，关闭 TCP 通信不用初始化 HTTP 任务类对象也行
-                // 下一个客户端连接到服务器上时，调用了 HTTP 任务类的初始化函数
-                return false;
-            }
+// 排队的响应全部发送完毕，归还文件缓存项和发送队列
+bool HttpConnection::finishWrite() {
+    if (this->m_write_start != 0) {
+        ServerStats::observe(ServerStats::WRITE, ServerStats::now() - this->m_write_start);
+    }
+    this->releaseEntries();
+    this->releaseOutQueue();
+
+    // 丢弃已经处理完毕的请求，读缓冲区中没有剩余的数据时归还所有分片，空闲的 keep-alive 连接不占用缓冲区
+    this->compactReadBuffer();
+    return !this->m_close_after;
+}
+
+/*
+    io_uring 后端的发送：把从当前位置开始的连续内存块填入发送队列中的 msghdr，由调用者提交 sendmsg()；
+    如果内存块之后（或者当前位置）是文件区间，fd、offset、count 返回它剩余的部分，由调用者通过 splice 发送
+*/
+const struct msghdr* HttpConnection::nextSend(int* fd, off_t* offset, off_t* count) {
+    int iov_count = 0;
+    int i = this->m_chunk_index;
+    for (; i < this->m_chunk_count; ++i) {
+        OutChunk* chunk = &this->m_out->chunks[i];
+        if (chunk->base == NULL) {
+            break;
         }
+        this->m_out->iov[iov_count].iov_base = (char*)chunk->base + chunk->offset;
+        this->m_out->iov[iov_count].iov_len = chunk->end - chunk->offset;
+        ++iov_count;
+    }
+
+    *fd = -1;
+    if (i < this->m_chunk_count) {
+        OutChunk* chunk = &this->m_out->chunks[i];
+        *fd = chunk->fd;
+        *offset = chunk->offset;
+        *count = chunk->end - chunk->offset;
     }
+
+    if (iov_count == 0) {
+        return NULL;
+    }
+    memset(&this->m_out->msg, 0, sizeof(this->m_out->msg));
+    this->m_out->msg.msg_iov = this->m_out->iov;
+    this->m_out->msg.msg_iovlen = iov_count;
+    return &this->m_out->msg;
 }
 
-// 往写缓冲区中写入待发送的数据，format 参数表示格式化参数列表，和 printf 的第一个参数类似
-bool HttpConnection::addResponse(const char* format, ...) {
-    if (this->m_write_index >= WRITE_BUFFER_SIZE) {
+// 往写缓冲区中追加预先生成的响应片段，写缓冲区放不下时返回 false
+bool HttpConnection::addResponse(std::string_view text) {
+    if (this->m_write_index + (int)text.size() > WRITE_BUFFER_SIZE) {
         return false;       // 写缓冲区满
     }
+    memcpy(this->m_out->write_buf + this->m_write_index, text.data(), text.size());
+    this->m_write_index += text.size();
+    return true;
+}
 
-    va_list arg_list;           // 存储可变参数列表的信息 
-    va_start(arg_list, format); // format 确定可变参数列表的起始位置
-
-    // 将可变的参数列表内容写入到缓冲区中，如 add_response("%s %s", "xi", "xi");
-    int len = vsnprintf(this->m_write_buf + this->m_write_index, WRITE_BUFFER_SIZE - 1 - this->m_write_index, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - this->m_write_index)) {
+// 往写缓冲区中追加十进制整数
+bool HttpConnection::addNumber(long long value) {
+    if (this->m_write_index + 20 > WRITE_BUFFER_SIZE) {
         return false;
     }
-    this->m_write_index += len;
-
-    va_end(arg_list);           // 清理参数列表变量
+    this->m_write_index += formatDecimal((unsigned long long)value, this->m_out->write_buf + this->m_write_index);
     return true;
 }
 
 // 响应状态行
-bool HttpConnection::addStatusLine(int status_num, const char* status_content) {
-    return this->addResponse("%s %d %s\r\n", "HTTP/1.1", status_num, status_content);
+bool HttpConnection::addStatusLine(std::string_view status_line) {
+    return this->addResponse(status_line);
 }
 
 // 响应头
-void HttpConnection::addHeaders(int content_len) {
+bool HttpConnection::addHeaders(off_t content_len, std::string_view content_type) {
     this->addContentLength(content_len);      // 如果请求资源成功，content_length 表示资源的大小（响应体大小）
-    this->addContentType();
+    this->addContentType(content_type);
+    this->addContentEncoding();
     this->addKeepAlive();
-    this->addBlankLine();
+    return this->addBlankLine();
+}
+
+// 响应头：内容编码，以及告诉缓存响应随 Accept-Encoding 变化
+bool HttpConnection::addContentEncoding() {
+    if (this->m_gzip && !this->addResponse(HEADER_GZIP)) {
+        return false;
+    }
+    if (this->m_vary && !this->addResponse(HEADER_VARY)) {
+        return false;
+    }
+    return true;
+}
+
+/*
+    响应头：验证器和缓存策略，200、206 和 304 响应使用
+    - gzip 变体的缓存项有自己的实体标签，修改时间和原始文件相同
+    - Cache-Control 按照原始文件的扩展名选择，响应头在配置时已经生成
+*/
+bool HttpConnection::addValidators() {
+    this->addResponse("ETag: ");
+    this->addResponse(this->m_file_entry->etag);
+    this->addResponse("\r\nLast-Modified: ");
+    this->addResponse(std::string_view(this->m_file_entry->last_modified, HTTP_DATE_LEN));
+    if (!this->addResponse(HEADER_CRLF)) {
+        return false;
+    }
+
+    const CachePolicy* policy = &m_default_policy;
+    std::string_view path = this->originalPath();
+    for (int i = 0; i < m_cache_policy_count; ++i) {
+        std::string_view suffix = m_cache_policies[i].suffix;
+        if ((path.size() > suffix.size()) && (path.substr(path.size() - suffix.size()) == suffix)) {
+            policy = &m_cache_policies[i];
+            break;
+        }
+    }
+    return this->addResponse(std::string_view(policy->header, policy->header_len));
+}
+
+// 当前文件的原始路径，gzip 变体去掉 ".gz" 后缀，用来选择 MIME 类型和缓存策略
+std::string_view HttpConnection::originalPath() const {
+    std::string_view path = this->m_file_entry->path;
+    if (this->m_gzip) {
+        path.remove_suffix(3);
+    }
+    return path;
 }
 
 // 响应头：响应体长度
-bool HttpConnection::addContentLength(int content_len) {
-    return this->addResponse("Content-Length: %d\r\n", content_len);
+bool HttpConnection::addContentLength(off_t content_len) {
+    this->addResponse("Content-Length: ");
+    this->addNumber(content_len);
+    return this->addResponse(HEADER_CRLF);
 }
 
 // 响应头：是否保持连接
 bool HttpConnection::addKeepAlive() {
-    return this->addResponse("Connection: %s\r\n", (this->m_keep_alive == true) ? "keep-alive" : "close");
+    return this->addResponse(this->m_keep_alive ? HEADER_KEEP_ALIVE : HEADER_CLOSE);
 }
 
 // 响应头：空白行
 bool HttpConnection::addBlankLine() {
-    return this->addResponse("%s", "\r\n");
+    return this->addResponse(HEADER_CRLF);
 }
 
 // 响应体
-bool HttpConnection::addContent(const char* content) {
-    return this->addResponse("%s", content);
+bool HttpConnection::addContent(std::string_view content) {
+    return this->addResponse(content);
+}
+
+// 响应体类型，content_type 是完整的 Content-Type 响应头
+bool HttpConnection::addContentType(std::string_view content_type) {
+    return this->addResponse(content_type);
 }
 
-// 响应体类型
-bool HttpConnection::addContentType() {
-    return this->addResponse("Content-Type: %s\r\n", "text/html");
+// 响应头：Content-Range: bytes first-last/size，或者 first 为 -1 时 bytes */size
+bool HttpConnection::addContentRange(off_t first, off_t last, off_t size) {
+    this->addResponse("Content-Range: bytes ");
+    if (first < 0) {
+        this->addResponse("*");
+    }
+    else {
+        this->addNumber(first);
+        this->addResponse("-");
+        this->addNumber(last);
+    }
+    this->addResponse("/");
+    this->addNumber(size);
+    return this->addResponse(HEADER_CRLF);
 }
 
-// 根据服务器处理 HTTP 请求的结果，决定返回给客户端的内容
+// 根据服务器处理 HTTP 请求的结果，决定返回给客户端的内容，响应追加到发送队列的末尾
 bool HttpConnection::processWrite(HTTP_CODE ret) {
+    // 第一个响应入队时才申请发送队列和写缓冲区
+    if (!this->acquireOutQueue()) {
+        return false;
+    }
+    if (this->m_chunk_count == 0) {
+        this->m_write_start = ServerStats::sampleStart();
+    }
+
+    int start = this->m_write_index;    // 当前响应在写缓冲区中的起始位置
+    int status = 500;
+    this->m_response_start = this->bytes_to_send;
+
     switch (ret) {
     case INTERNAL_ERROR:
-        this->addStatusLine(500, error_500_title);
-        this->addHeaders(strlen(error_500_form));
-        if (this->addContent(error_500_form) == false) {
-            return false;
-        }
+        status = 500;
         break;
     case BAD_REQUEST:
-        this->addStatusLine(400, error_400_title);
-        this->addHeaders(strlen(error_400_form));
-        if (this->addContent(error_400_form) == false) {
-            return false;
-        }
+        // 格式错误的请求之后，读缓冲区中剩余数据的边界不可信（例如非法的 Content-Length 使请求体被当作下一个请求），
+        // 不再保持连接，防止请求走私
+        status = 400;
+        this->m_keep_alive = false;
+        break;
+    case NOT_IMPLEMENTED:
+        // 请求体没有读取，读缓冲区中剩余的数据不能当作下一个请求
+        status = 501;
+        this->m_keep_alive = false;
         break;
     case NO_RESOURCE:
-        this->addStatusLine(404, error_404_title);
-        this->addHeaders(strlen(error_404_form));
-        if (this->addContent(error_404_form) == false) {
-            return false;
-        }
+        status = 404;
         break;
     case FORBIDDEN_REQUEST:
-        this->addStatusLine(403, error_403_title);
-        this->addHeaders(strlen(error_403_form));
-        if (this->addContent(error_403_form) == false) {
+        status = 403;
+        break;
+    case NOT_MODIFIED:
+        // 只有响应头，没有响应体，也不发送 Content-Length 和 Content-Encoding，客户端继续使用缓存的副本；
+        // 选中的变体由 ETag 表示，Vary 仍然需要发送
+        this->addStatusLine(STATUS_304);
+        this->addValidators();
+        if (this->m_vary) {
+            this->addResponse(HEADER_VARY);
+        }
+        FileCache::getInstance()->release(this->m_file_entry);
+        this->m_file_entry = NULL;
+        this->addKeepAlive();
+        if (this->addBlankLine() == false) {
             return false;
         }
-        break;
+        this->queueChunk(this->m_out->write_buf, -1, start, this->m_write_index);
+        this->m_close_after = !this->m_keep_alive;
+        this->logResponse(304);
+        return true;
+    case RANGE_NOT_SATISFIABLE:
+        // 告诉客户端文件的实际大小，文件缓存项只用来获取大小
+        this->addStatusLine(STATUS_416);
+        this->addContentRange(-1, -1, this->m_file_entry->st.st_size);
+        FileCache::getInstance()->release(this->m_file_entry);
+        this->m_file_entry = NULL;
+        this->addHeaders(ERROR_416_FORM.size(), MIME_HTML.header);
+        if (this->addContent(ERROR_416_FORM) == false) {
+            return false;
+        }
+        this->queueChunk(this->m_out->write_buf, -1, start, this->m_write_index);
+        this->m_close_after = !this->m_keep_alive;
+        this->logResponse(416);
+        return true;
+    case STATS_REQUEST:
+        return this->processStatsWrite();
     case FILE_REQUEST:
+        if (this->m_range_count > 0) {
+            return this->processRangeWrite();
+        }
+
         // 请求服务器资源文件成功
         // 也需要返回对应的响应状态行，响应头（基于HTTP协议），这样返回的服务器资源才能正确地被运行 HTTP 协议的浏览器解析
-        this->addStatusLine(200, ok_200_title);
-        this->addHeaders(this->m_file_stat.st_size);
-        // 分散写对象初始化，涉及到两块内存区
-        this->m_iv[0].iov_base = this->m_write_buf;
-        this->m_iv[0].iov_len = this->m_write_index;
-        this->m_iv[1].iov_base = this->m_file_address;
-        this->m_iv[1].iov_len = this->m_file_stat.st_size;
-        this->m_iv_count = 2;
-
-        this->bytes_to_send = this->m_write_index + this->m_file_stat.st_size;
+        this->addStatusLine(STATUS_200);
+        this->addResponse(HEADER_ACCEPT_RANGES);
+        this->addValidators();
+        if (!this->addHeaders(this->m_file_entry->st.st_size, mimeType(this->originalPath()).header)) {
+            return false;
+        }
+        this->queueChunk(this->m_out->write_buf, -1, start, this->m_write_index);
+
+        // 响应体：内存映射的文件和响应头一起分散写，没有内存映射的大文件通过 sendfile() 发送
+        if (this->m_file_entry->st.st_size > 0) {
+            this->queueFileRange(0, this->m_file_entry->st.st_size);
+        }
+
+        // 文件缓存项在响应发送完毕后归还
+        this->m_out->entries[this->m_entry_count++] = this->m_file_entry;
+        this->m_file_entry = NULL;
+        this->m_close_after = !this->m_keep_alive;
+        this->logResponse(200);
         return true;
     default:
         return false;
     }
 
-    // 状态码为 200 以外的，需要返回给客户端的内容
-    this->m_iv[0].iov_base = this->m_write_buf;
-    this->m_iv[0].iov_len = this->m_write_index;
-    this->m_iv_count = 1;
-    this->bytes_to_send = this->m_write_index;
+    // 400、403、404、500、501 响应不依赖请求，整个响应预先生成，直接放入发送队列，不占用写缓冲区
+    const struct iovec& response = errorResponse(status, this->m_keep_alive);
+    this->queueChunk((const char*)response.iov_base, -1, 0, response.iov_len);
+    this->m_close_after = !this->m_keep_alive;
+    this->logResponse(status);
+    return true;
+}
+
+// 一个响应放入了发送队列，记录状态码和访问日志，响应的字节数是这次放入发送队列的数据量
+void HttpConnection::logResponse(int status) {
+    ServerStats::request(status);
+    AccessLog::getInstance()->log(this->m_client_addr, this->m_request.target(), status, this->bytes_to_send - this->m_response_start);
+}
+
+/*
+    写运行指标响应，指标在这里汇总，响应体保存在连接对象中直到发送完毕
+    一批响应中只能有一个运行指标响应（canQueueResponse() 保证），之后的请求在发送完毕后继续处理
+*/
+bool HttpConnection::processStatsWrite() {
+    int start = this->m_write_index;
+    this->m_stats_body.clear();
+    ServerStats::render(&this->m_stats_body, this->m_user_count.load(std::memory_order_relaxed));
+
+    this->addStatusLine(STATUS_200);
+    this->addResponse(HEADER_NO_STORE);
+    this->addContentLength(this->m_stats_body.size());
+    this->addContentType(HEADER_METRICS_TYPE);
+    this->addKeepAlive();
+    if (!this->addBlankLine()) {
+        return false;
+    }
+    this->queueChunk(this->m_out->write_buf, -1, start, this->m_write_index);
+    this->queueChunk(this->m_stats_body.data(), -1, 0, this->m_stats_body.size());
+    this->m_close_after = !this->m_keep_alive;
+    this->logResponse(200);
     return true;
 }
 
+/*
+    写 206 响应，范围的内容和整个文件一样零拷贝发送
+    - 一个范围：Content-Range 响应头加上文件中的一段
+    - 多个范围：multipart/byteranges，每个部分的分隔行和部分头部写在写缓冲区中，和文件中的各段交替放入发送队列
+*/
+bool HttpConnection::processRangeWrite() {
+    off_t size = this->m_file_entry->st.st_size;
+    std::string_view content_type = mimeType(this->originalPath()).header;
+
+    if (this->m_range_count == 1) {
+        const ByteRange& range = this->m_ranges[0];
+        int start = this->m_write_index;
+        this->addStatusLine(STATUS_206);
+        this->addContentRange(range.first, range.last, size);
+        this->addValidators();
+        if (!this->addHeaders(range.last - range.first + 1, content_type)) {
+            return false;
+        }
+        this->queueChunk(this->m_out->write_buf, -1, start, this->m_write_index);
+        this->queueFileRange(range.first, range.last + 1);
+    }
+    else {
+        // 随机的分隔符，文件内容中恰好出现该分隔符的可能性可以忽略
+        unsigned long long seed = nextBoundary();
+        char boundary[16];
+        for (int i = 15; i >= 0; --i) {
+            boundary[i] = "0123456789abcdef"[seed & 0xf];
+            seed >>= 4;
+        }
+        std::string_view boundary_view(boundary, sizeof(boundary));
+
+        // 响应头中的 Content-Length 需要所有部分的总长度，先写各部分的头部，最后写响应头
+        int part_start[MAX_RANGES + 1];
+        off_t content_len = 0;
+        for (int i = 0; i < this->m_range_count; ++i) {
+            const ByteRange& range = this->m_ranges[i];
+            part_start[i] = this->m_write_index;
+            this->addResponse("\r\n--");
+            this->addResponse(boundary_view);
+            this->addResponse(HEADER_CRLF);
+            this->addContentType(content_type);
+            this->addContentRange(range.first, range.last, size);
+            if (!this->addBlankLine()) {
+                return false;
+            }
+            content_len += this->m_write_index - part_start[i] + range.last - range.first + 1;
+        }
+        part_start[this->m_range_count] = this->m_write_index;
+        this->addResponse("\r\n--");
+        this->addResponse(boundary_view);
+        if (!this->addResponse("--\r\n")) {
+            return false;
+        }
+        content_len += this->m_write_index - part_start[this->m_range_count];
+
+        // 响应头的 Content-Type 带上分隔符
+        int header_start = this->m_write_index;
+        this->addStatusLine(STATUS_206);
+        this->addValidators();
+        this->addContentLength(content_len);
+        this->addResponse("Content-Type: multipart/byteranges; boundary=");
+        this->addResponse(boundary_view);
+        this->addResponse(HEADER_CRLF);
+        this->addContentEncoding();
+        this->addKeepAlive();
+        if (!this->addBlankLine()) {
+            return false;
+        }
+
+        this->queueChunk(this->m_out->write_buf, -1, header_start, this->m_write_index);
+        for (int i = 0; i < this->m_range_count; ++i) {
+            this->queueChunk(this->m_out->write_buf, -1, part_start[i], part_start[i + 1]);
+            this->queueFileRange(this->m_ranges[i].first, this->m_ranges[i].last + 1);
+        }
+        this->queueChunk(this->m_out->write_buf, -1, part_start[this->m_range_count], header_start);
+    }
+
+    // 文件缓存项在响应发送完毕后归还
+    this->m_out->entries[this->m_entry_count++] = this->m_file_entry;
+    this->m_file_entry = NULL;
+    this->m_close_after = !this->m_keep_alive;
+    this->logResponse(206);
+    return true;
+}
+
+// 把当前文件的 [offset, end) 放入发送队列，有内存映射时和响应头一起分散写，否则通过 sendfile() 发送
+void HttpConnection::queueFileRange(off_t offset, off_t end) {
+    if (this->m_file_entry->address) {
+        this->queueChunk(this->m_file_entry->address, -1, offset, end);
+    }
+    else {
+        this->queueChunk(NULL, this->m_file_entry->fd, offset, end);
+    }
+}
+
+// 发送队列和写缓冲区还能容纳一个响应（最多两个数据块、一个文件缓存项），排队的运行指标响应发送完毕之前不再生成响应
+bool HttpConnection::canQueueResponse() const {
+    return (this->m_chunk_count + 2 <= MAX_PIPELINE * 2) &&
+        (this->m_entry_count < MAX_PIPELINE) &&
+        (WRITE_BUFFER_SIZE - this->m_write_index >= RESPONSE_RESERVE) &&
+        this->m_stats_body.empty();
+}
+
+// 多段范围响应需要 2 * 范围数量 + 2 个数据块，以及每个部分的头部占用的写缓冲区
+bool HttpConnection::canQueueFile() const {
+    if (this->m_range_count <= 1) {
+        return this->canQueueResponse();
+    }
+    return (this->m_chunk_count + 2 * this->m_range_count + 2 <= MAX_PIPELINE * 2) &&
+        (this->m_entry_count < MAX_PIPELINE) &&
+        (WRITE_BUFFER_SIZE - this->m_write_index >= RESPONSE_RESERVE + (this->m_range_count + 1) * PART_HEADER_RESERVE);
+}
+
+/*
+    解析读缓冲区中所有完整的请求（HTTP/1.1 流水线），按照请求的顺序把响应放入发送队列
+    - 剩余的数据不是一个完整的请求时停止，已经解析的部分保留在解析状态中，读到更多数据后继续
+    - 响应要求关闭连接时停止，之后的请求不再处理
+    - 发送队列或者写缓冲区满时停止，发送完毕后继续处理剩余的请求
+    - 放不下的多段范围响应推迟到发送队列清空之后生成，空的发送队列总能容纳一个这样的响应
+*/
+bool HttpConnection::prepareResponses() {
+    this->m_more_requests = false;
+    while (true) {
+        HTTP_CODE read_ret = FILE_REQUEST;
+        if (this->m_deferred) {
+            // 上一次推迟的请求已经解析完毕，借用的文件缓存项和范围还保存在连接对象中
+            this->m_deferred = false;
+        }
+        else {
+            read_ret = this->processRead();
+            if (read_ret == NO_REQUEST) {
+                // NO_REQUEST: 需要继续读取客户端请求的内容
+                return true;
+            }
+            if ((read_ret == FILE_REQUEST) && !this->canQueueFile()) {
+                this->m_deferred = true;
+                this->m_more_requests = true;
+                return true;
+            }
+        }
+
+        // 生成响应
+        if (!this->processWrite(read_ret)) {
+            return false;
+        }
+        this->initRequest();
+
+        if (this->m_close_after) {
+            return true;
+        }
+        if (!this->canQueueResponse()) {
+            this->m_more_requests = (this->m_request_start < this->m_read_index);
+            return true;
+        }
+    }
+}
+
 // 由线程池中的工作线程调用，这是处理 HTTP 请求的入口函数
 void HttpConnection::process() {
-    // 解析 HTTP 请求
-    HTTP_CODE read_ret = processRead();
-    if (read_ret == NO_REQUEST) {
-        // NO_REQUEST: 需要继续读取客户端请求的内容
-        modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+    // 每个请求的排队时间都交给准入控制，reactor 据此决定是否继续把请求交给线程池
+    long long now = ServerStats::now();
+    ServerStats::observe(ServerStats::QUEUE_WAIT, now - this->m_dispatch_ns);
+    AdmissionControl::getInstance()->observe(now - this->m_dispatch_ns, now);
+
+    // 解析所有完整的 HTTP 请求并生成响应
+    if (!this->prepareResponses()) {
+        this->closeConnection();
         return;
     }
 
-    // 生成响应
-    bool write_ret = processWrite(read_ret);
-    if (!write_ret) {
-        this->closeConnection();
+    if (this->m_chunk_count == 0) {
+        // 没有完整的请求，需要继续读取客户端请求的内容
+        modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+        return;
     }
 
     // 监测文件描述符写事件 
     modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLOUT);
 }
 
-HttpConnection::HttpConnection() {
+// 多 reactor 模式下由 reactor 线程调用，解析请求后不再等待 EPOLLOUT 事件，直接尝试发送响应
+bool HttpConnection::processInline() {
+    while (true) {
+        // 解析所有完整的 HTTP 请求并生成响应
+        if (!this->prepareResponses()) {
+            return false;
+        }
+
+        if (this->m_chunk_count == 0) {
+            // 没有完整的请求，需要继续读取客户端请求的内容
+            modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+            return true;
+        }
+
+        // 发送响应，TCP 写缓冲区满时 write() 会注册 EPOLLOUT 事件，剩余的数据在 EPOLLOUT 事件中继续发送
+        if (!this->write()) {
+            return false;
+        }
+
+        // 响应全部发送完毕后，继续处理读缓冲区中剩余的流水线请求
+        if (!this->hasBufferedRequest()) {
+            return true;
+        }
+    }
+}
+
+HttpConnection::HttpConnection() : m_epoll_fd(-1), m_sockfd(-1), m_file_entry(NULL), m_out(NULL), m_write_start(0), m_dispatch_ns(0), m_worker(-1) {
 
 }
 
@@ -0,0 +1,64 @@
+#include "../include/http_date.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char* DAYS[7] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char* MONTHS[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// 读取固定位数的十进制数字
+static bool parseDigits(std::string_view text, size_t pos, size_t count, int* value) {
+    *value = 0;
+    for (size_t i = pos; i < pos + count; ++i) {
+        if ((text[i] < '0') || (text[i] > '9')) {
+            return false;
+        }
+        *value = *value * 10 + (text[i] - '0');
+    }
+    return true;
+}
+
+bool parseHttpDate(std::string_view text, time_t* t) {
+    // Sun, 06 Nov 1994 08:49:37 GMT，长度固定为 29
+    if ((text.size() != 29) || (text[3] != ',') || (text[4] != ' ') || (text[7] != ' ') || (text[11] != ' ') ||
+        (text[16] != ' ') || (text[19] != ':') || (text[22] != ':') || (text.substr(25) != " GMT")) {
+        return false;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int year = 0;
+    if (!parseDigits(text, 5, 2, &tm.tm_mday) || !parseDigits(text, 12, 4, &year) ||
+        !parseDigits(text, 17, 2, &tm.tm_hour) || !parseDigits(text, 20, 2, &tm.tm_min) ||
+        !parseDigits(text, 23, 2, &tm.tm_sec)) {
+        return false;
+    }
+    tm.tm_year = year - 1900;
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (text.substr(8, 3) == MONTHS[i]) {
+            tm.tm_mon = i;
+            break;
+        }
+    }
+    if ((tm.tm_mon < 0) || (tm.tm_mday < 1) || (tm.tm_mday > 31) || (tm.tm_hour > 23) || (tm.tm_min > 59) || (tm.tm_sec > 60)) {
+        return false;
+    }
+
+    *t = timegm(&tm);
+    return *t != (time_t)-1;
+}
+
+void formatHttpDate(time_t t, char* buf) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char text[64];      // 年份超过 4 位时截断，不会越界
+    snprintf(text, sizeof(text), "%s, %02d %s %04d %02d:%02d:%02d GMT", DAYS[tm.tm_wday], tm.tm_mday,
+        MONTHS[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    memcpy(buf, text, HTTP_DATE_LEN);
+    buf[HTTP_DATE_LEN] = '\0';
+}
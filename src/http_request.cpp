@@ -0,0 +1,66 @@
+#include "../include/http_request.h"
+
+void HttpRequest::addHeader(std::string_view name, std::string_view value) {
+    HEADER_ID id = lookupHeader(name);
+    if (id != HDR_UNKNOWN) {
+        // 重复出现的常用请求头保留第一次出现的值，值不同时记录冲突
+        if (!this->hasHeader(id)) {
+            this->m_known[id] = value;
+            this->m_present |= (uint32_t)1 << id;
+        }
+        else if (this->m_known[id] != value) {
+            this->m_conflicts |= (uint32_t)1 << id;
+        }
+        return;
+    }
+
+    if (this->m_extra_count < MAX_EXTRA_HEADERS) {
+        this->m_extra[this->m_extra_count].name = name;
+        this->m_extra[this->m_extra_count].value = value;
+        ++this->m_extra_count;
+    }
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    HEADER_ID id = lookupHeader(name);
+    if (id != HDR_UNKNOWN) {
+        return this->header(id);
+    }
+
+    for (int i = 0; i < this->m_extra_count; ++i) {
+        const std::string_view& extra = this->m_extra[i].name;
+        if (extra.size() != name.size()) {
+            continue;
+        }
+        size_t j = 0;
+        while ((j < name.size()) && ((extra[j] | 0x20) == (name[j] | 0x20))) {
+            ++j;
+        }
+        if (j == name.size()) {
+            return this->m_extra[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+// 指向 [begin, end) 的 string_view 向前移动 offset 字节
+static void relocateView(std::string_view& view, const char* begin, const char* end, size_t offset) {
+    if ((view.data() != NULL) && (view.data() >= begin) && (view.data() < end)) {
+        view = std::string_view(view.data() - offset, view.size());
+    }
+}
+
+void HttpRequest::relocate(const char* begin, const char* end, size_t offset) {
+    relocateView(this->m_method, begin, end, offset);
+    relocateView(this->m_target, begin, end, offset);
+    relocateView(this->m_version, begin, end, offset);
+    for (int id = 0; id < HDR_COUNT; ++id) {
+        if (this->hasHeader((HEADER_ID)id)) {
+            relocateView(this->m_known[id], begin, end, offset);
+        }
+    }
+    for (int i = 0; i < this->m_extra_count; ++i) {
+        relocateView(this->m_extra[i].name, begin, end, offset);
+        relocateView(this->m_extra[i].value, begin, end, offset);
+    }
+}
@@ -0,0 +1,132 @@
+#include "../include/http_response.h"
+#include <string.h>
+#include <string>
+
+// 0 到 99 的两位十进制表示，每次处理两位数字
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int formatDecimal(unsigned long long value, char* buf) {
+    // 从低位向高位写入临时缓冲区的末尾，再整体拷贝
+    char digits[20];
+    char* p = digits + sizeof(digits);
+    while (value >= 100) {
+        int pair = (int)(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        int pair = (int)value * 2;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    else {
+        *--p = (char)('0' + value);
+    }
+    int len = (int)(digits + sizeof(digits) - p);
+    memcpy(buf, p, len);
+    return len;
+}
+
+const MimeType& mimeType(std::string_view path) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if ((dot == std::string_view::npos) || ((slash != std::string_view::npos) && (dot < slash))) {
+        return MIME_DEFAULT;
+    }
+    std::string_view extension = path.substr(dot + 1);
+
+    for (size_t i = 0; i < sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]); ++i) {
+        std::string_view candidate = MIME_TYPES[i].extension;
+        if (candidate.size() != extension.size()) {
+            continue;
+        }
+        size_t j = 0;
+        while ((j < extension.size()) && ((extension[j] | 0x20) == candidate[j])) {
+            ++j;
+        }
+        if (j == extension.size()) {
+            return MIME_TYPES[i];
+        }
+    }
+    return MIME_DEFAULT;
+}
+
+// 预先生成的错误响应，下标依次是 400、403、404、500、501、503，每种分别有保持连接和关闭连接两个版本
+struct ErrorResponses {
+    std::string text[6][2];
+    struct iovec iov[6][2];
+
+    ErrorResponses() {
+        static const char* status_lines[6] = {
+            "HTTP/1.1 400 Bad Request\r\n",
+            "HTTP/1.1 403 Forbidden\r\n",
+            "HTTP/1.1 404 Not Found\r\n",
+            "HTTP/1.1 500 Internal Error\r\n",
+            "HTTP/1.1 501 Not Implemented\r\n",
+            "HTTP/1.1 503 Service Unavailable\r\n"
+        };
+        static const char* forms[6] = {
+            "Your request has bad syntax or is inherently impossible to satisfy.\n",
+            "You do not have permission to get file from this server.\n",
+            "The requested file was not found on this server.\n",
+            "There was an unusual problem serving the requested file.\n",
+            "The request uses a transfer coding this server does not implement.\n",
+            "The server is overloaded, please try again later.\n"
+        };
+
+        for (int i = 0; i < 6; ++i) {
+            for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+                std::string& response = this->text[i][keep_alive];
+                response = status_lines[i];
+                if (i == 5) {
+                    response += "Retry-After: " + std::to_string(RETRY_AFTER_SECONDS) + "\r\n";
+                }
+                response += "Content-Length: " + std::to_string(strlen(forms[i])) + "\r\n";
+                response += MIME_HTML.header;
+                response += keep_alive ? HEADER_KEEP_ALIVE : HEADER_CLOSE;
+                response += HEADER_CRLF;
+                response += forms[i];
+                this->iov[i][keep_alive].iov_base = (void*)response.data();
+                this->iov[i][keep_alive].iov_len = response.size();
+            }
+        }
+    }
+};
+
+const struct iovec& errorResponse(int status, bool keep_alive) {
+    // 第一次调用时生成，C++11 保证局部静态变量的初始化是线程安全的
+    static const ErrorResponses responses;
+
+    int index = 3;
+    switch (status) {
+    case 400:
+        index = 0;
+        break;
+    case 403:
+        index = 1;
+        break;
+    case 404:
+        index = 2;
+        break;
+    case 501:
+        index = 4;
+        break;
+    case 503:
+        index = 5;
+        break;
+    default:
+        break;
+    }
+    return responses.iov[index][keep_alive ? 1 : 0];
+}
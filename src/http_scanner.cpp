@@ -0,0 +1,119 @@
+#include "../include/http_scanner.h"
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86
+#endif
+
+// 逐字节比较，用于没有向量指令的 CPU 和不足一个向量的尾部数据
+static const char* findScalar(const char* begin, const char* end, char a, char b) {
+    for (const char* p = begin; p < end; ++p) {
+        if ((*p == a) || (*p == b)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#ifdef HTTP_SCANNER_X86
+
+// SSE4.2 的 pcmpestri 一条指令就能在 16 字节中查找字符集合中的任意字符，返回第一个匹配的下标
+__attribute__((target("sse4.2")))
+static const char* findSSE42(const char* begin, const char* end, char a, char b) {
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const char* p = begin;
+    for (; end - p >= 16; p += 16) {
+        __m128i data = _mm_loadu_si128((const __m128i*)p);
+        int index = _mm_cmpestri(set, 2, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) {
+            return p + index;
+        }
+    }
+    return findScalar(p, end, a, b);
+}
+
+// AVX2 一次比较 32 字节，两个字符分别比较后合并成位掩码，最低的置位就是第一个匹配的位置
+__attribute__((target("avx2")))
+static const char* findAVX2(const char* begin, const char* end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const char* p = begin;
+    for (; end - p >= 32; p += 32) {
+        __m256i data = _mm256_loadu_si256((const __m256i*)p);
+        __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(data, va), _mm256_cmpeq_epi8(data, vb));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(eq);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    // 剩余不足 32 字节，支持 AVX2 的 CPU 一定支持 SSE4.2
+    return findSSE42(p, end, a, b);
+}
+
+#endif
+
+HttpScanner::FindFunc HttpScanner::m_find = findScalar;
+HttpScanner::IMPL HttpScanner::m_impl = HttpScanner::SCALAR;
+
+bool HttpScanner::supported(IMPL impl) {
+    switch (impl) {
+    case SCALAR:
+        return true;
+#ifdef HTTP_SCANNER_X86
+    case SSE42:
+        __builtin_cpu_init();   // 静态初始化阶段调用时，CPU 信息可能还没有初始化
+        return __builtin_cpu_supports("sse4.2");
+    case AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool HttpScanner::setImpl(IMPL impl) {
+    if (!supported(impl)) {
+        return false;
+    }
+    switch (impl) {
+#ifdef HTTP_SCANNER_X86
+    case SSE42:
+        m_find = findSSE42;
+        break;
+    case AVX2:
+        m_find = findAVX2;
+        break;
+#endif
+    default:
+        m_find = findScalar;
+        break;
+    }
+    m_impl = impl;
+    return true;
+}
+
+const char* HttpScanner::implName(IMPL impl) {
+    switch (impl) {
+    case SCALAR:
+        return "scalar";
+    case SSE42:
+        return "sse4.2";
+    case AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+// 启动时选择 CPU 支持的最快实现
+static bool selectBestImpl() {
+    for (int impl = HttpScanner::IMPL_COUNT - 1; impl > HttpScanner::SCALAR; --impl) {
+        if (HttpScanner::setImpl((HttpScanner::IMPL)impl)) {
+            return true;
+        }
+    }
+    return HttpScanner::setImpl(HttpScanner::SCALAR);
+}
+static bool scanner_selected = selectBestImpl();
@@ -5,12 +5,12 @@ SortTimerLst::SortTimerLst() :head(NULL), tail(NULL) {
 
 }
 
-// 链表被销毁时，删除其中所有的定时器
+// 链表被销毁时，摘下其中所有的定时器，结点由调用者释放
 SortTimerLst::~SortTimerLst() {
     UtilTimer* tmp = this->head;
     while (tmp) {
         this->head = tmp->next;
-        delete tmp;
+        tmp->prev = tmp->next = NULL;
         tmp = this->head;
     }
 }
@@ -83,38 +83,30 @@ void SortTimerLst::delTimer(UtilTimer* timer) {
 
     // 链表中只有一个定时器，即目标定时器
     if (timer == this->head && timer == this->tail) {
-        delete timer;
         this->head = this->tail = NULL;
-        return;
     }
-
     /*
         如果链表中至少有两个定时器，且目标定时器是链表的头结点，
-        则将链表的头结点重置为原头结点的下一个结点，然后删除目标定时器
+        则将链表的头结点重置为原头结点的下一个结点
     */
-    if (timer == this->head) {
+    else if (timer == this->head) {
         this->head = this->head->next;
         this->head->prev = NULL;
-        delete timer;
-        return;
     }
-
     /*
         如果链表中至少有两个定时器，且目标定时器是链表的尾结点，
-        则将链表的尾结点重置为原尾结点的前一个结点，然后删除目标定时器
+        则将链表的尾结点重置为原尾结点的前一个结点
     */
-    if (timer == this->tail) {
+    else if (timer == this->tail) {
         this->tail = this->tail->prev;
         this->tail->next = NULL;
-        delete timer;
-        return;
     }
-
-    // 如果目标定时器位于链表的中间，则把它前后的定时器串联起来，然后删除目标定时器
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
-    timer = NULL;
+    // 如果目标定时器位于链表的中间，则把它前后的定时器串联起来
+    else {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+    }
+    timer->next = timer->prev = NULL;   // 取下的结点指针指向置 NULL，防止野指针的出现
 }
 
 /*
@@ -126,7 +118,7 @@ void SortTimerLst::tick() {
         return;
     }
     //printf("timer tick.\n");
-    time_t cur = time(NULL);    // 获取当前系统时间
+    long long cur = getCurrentMs();     // 获取当前时间
     UtilTimer* tmp = this->head;
 
     // 从头结点开始，依次处理每个定时器，直到遇到一个尚未到期的定时器
@@ -140,15 +132,18 @@ void SortTimerLst::tick() {
             break;
         }
 
-        // 调用定时器的回调函数，以执行定时任务
-        tmp->cb_func(tmp->user_data);
-
-        // 执行完定时器中的定时任务之后，就将它从链表中删除，并重置链表头结点
+        // 先将到期的定时器从链表中摘下并重置链表头结点，回调函数中可以重新添加该定时器
         this->head = tmp->next;
         if (this->head != NULL) {
             this->head->prev = NULL;
         }
-        delete tmp;
+        else {
+            this->tail = NULL;
+        }
+        tmp->next = NULL;
+
+        // 调用定时器的回调函数，以执行定时任务
+        tmp->cb_func(tmp->user_data);
         tmp = this->head;     // tmp 重新赋值为 this->head
     }
 }
@@ -188,4 +183,115 @@ void SortTimerLst::addTimer(UtilTimer* timer, UtilTimer* head) {
         // 更新尾指针
         this->tail = timer;
     }
-}
\ No newline at end of file
+}
+
+TimeWheel::TimeWheel(int slot_ms) :
+    m_cur_slot(0), m_slot_ms(slot_ms), m_count(0) {
+    for (int i = 0; i < SLOTS; ++i) {
+        this->m_slots[i] = NULL;
+    }
+    this->m_cur_time = getCurrentMs();
+}
+
+// 将目标定时器添加到时间轮中
+void TimeWheel::addTimer(UtilTimer* timer) {
+    if (timer == NULL) {
+        return;
+    }
+    if (timer->slot != -1) {
+        this->delTimer(timer);
+    }
+
+    /*
+        计算定时器在多少个槽间隔之后到期（向上取整，定时器不会提前到期），至少是下一个槽
+        指针第一次转到目标槽需要 (ticks - 1) % SLOTS + 1 次转动，之后每 SLOTS 次转动经过一次，
+        所以还需要再经过 (ticks - 1) / SLOTS 圈
+    */
+    long long delay = timer->expire - this->m_cur_time;
+    long long ticks = (delay <= 0) ? 1 : (delay + this->m_slot_ms - 1) / this->m_slot_ms;
+    timer->rotation = (int)((ticks - 1) >> SLOT_BITS);
+    timer->slot = (int)((this->m_cur_slot + ticks) & (SLOTS - 1));
+
+    // 插入目标槽链表的头部
+    UtilTimer*& head = this->m_slots[timer->slot];
+    timer->prev = NULL;
+    timer->next = head;
+    if (head) {
+        head->prev = timer;
+    }
+    head = timer;
+    ++this->m_count;
+}
+
+// 定时器的超时时间改变后，从原来的槽中取出，放入新的槽中
+void TimeWheel::adjustTimer(UtilTimer* timer) {
+    this->addTimer(timer);
+}
+
+// 将目标定时器从所在槽的链表中删除
+void TimeWheel::delTimer(UtilTimer* timer) {
+    if (timer == NULL || timer->slot == -1) {
+        return;
+    }
+
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    }
+    else {
+        this->m_slots[timer->slot] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = timer->next = NULL;   // 取下的结点指针指向置 NULL，防止野指针的出现
+    timer->slot = -1;
+    --this->m_count;
+}
+
+/*
+    指针每转动一个槽，处理该槽上到期的定时器
+*/
+void TimeWheel::tick(long long now) {
+    if (this->m_count == 0) {
+        // 时间轮中没有定时器，直接把指针转到当前时间，不需要逐个槽转动
+        long long ticks = (now - this->m_cur_time) / this->m_slot_ms;
+        if (ticks > 0) {
+            this->m_cur_time += ticks * this->m_slot_ms;
+            this->m_cur_slot = (int)((this->m_cur_slot + ticks) & (SLOTS - 1));
+        }
+        return;
+    }
+
+    while (this->m_cur_time + this->m_slot_ms <= now) {
+        this->m_cur_time += this->m_slot_ms;
+        this->m_cur_slot = (this->m_cur_slot + 1) & (SLOTS - 1);
+
+        UtilTimer* tmp = this->m_slots[this->m_cur_slot];
+        while (tmp) {
+            UtilTimer* next = tmp->next;
+            if (tmp->rotation > 0) {
+                // 还需要再转 rotation 圈才到期
+                --tmp->rotation;
+            }
+            else {
+                // 定时器到期，先从时间轮中删除再调用回调函数，回调函数中可以重新添加该定时器
+                this->delTimer(tmp);
+                tmp->cb_func(tmp->user_data);
+            }
+            tmp = next;
+        }
+    }
+}
+
+// 从当前槽的下一个槽开始，找到第一个非空的槽
+long long TimeWheel::nextExpire() const {
+    if (this->m_count == 0) {
+        return -1;
+    }
+    for (int i = 1; i <= SLOTS; ++i) {
+        if (this->m_slots[(this->m_cur_slot + i) & (SLOTS - 1)]) {
+            return this->m_cur_time + (long long)i * this->m_slot_ms;
+        }
+    }
+    return -1;
+}
@@ -8,18 +8,20 @@
 #include<sys/epoll.h>
 #include<signal.h>
 #include"../include/thread_pool.h"
+#include"../include/work_stealing_pool.h"
 #include"../include/http_connection.h"
 #include "../include/lst_timer.h"
+#include "../include/file_cache.h"
+#include "../include/gzip_cache.h"
+#include "../include/config.h"
+#include "../include/reactor.h"
+#include "../include/uring.h"
+#include "../include/access_log.h"
+#include "../include/admission_control.h"
+#include "../include/hot_upgrade.h"
+#include "../include/cpu_affinity.h"
 
-#define MAX_FD 65535                // 支持最大的文件描述符个数（最大的连接客户端数）
-#define MAX_EVENT_NUMBER 65535      // epoll 监听的最大的 IO 事件数量
-#define TIMESLOT 5                  // 定时器发送信号的间隔时间（秒）
-#define MAX_THREADS 5               // 线程池最大的线程数量
 
-
-static int pipefd[2];               // 定时器发送的信号通过管道传输，0 是读端，1是写端
-static SortTimerLst timer_lst;      // 定时器双向链表，一个 TCP 连接对应一个定时器
-static int epoll_fd = 0;            // epoll 事件
 HttpConnection* users = new HttpConnection[MAX_FD];     // 客户端的 TCP 连接任务类对象
 ClientData* lst_users = new ClientData[MAX_FD];         // 定时器客户端信息类对象
 
@@ -29,82 +31,15 @@ void addSignal(int sig, void(handler)(int)) {
     memset(&sa, '\0', sizeof(sa));
     sa.sa_handler = handler;
     sigfillset(&sa.sa_mask);    // 设置阻塞信号集
-    assert(sigaction(sig, &sa, NULL) != -1);
-}
-
-// 添加信号处理函数，管道写端
-void sigHandler(int sig) {
-    int save_errno = errno;
-    int msg = sig;
-    send(pipefd[1], (char*)&msg, 1, 0);
-    errno = save_errno;
-}
-
-// 超时函数处理
-void timerHandler() {
-    // 定时处理任务，实际上就是调用tick()函数
-    timer_lst.tick();
-    // 因为一次 alarm 调用只会引起一次 SIGALRM 信号，所以我们要重新定时，发送 SIGALRM 信号
-    alarm(TIMESLOT);
-}
-
-// 定时器回调函数，删除超时连接的 socket 上的注册事件
-extern void cbFunc(ClientData* user_data) {
-    users[user_data->sockfd].closeConnection();
-}
-
-// 设置文件描述符非阻塞
-extern int setNonBlocking(int fd);
-
-// 添加文件描述符到 epoll 对象中
-extern void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot);
-
-// 从 epoll 对象中删除文件描述符
-extern void removeFDEpoll(int epoll_fd, int fd);
-
-// 修改 epoll 对象中的文件描述符
-extern void modifyFDEpoll(int epoll_fd, int fd, int event_num);
-
-
-int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        printf("Usage: %s port_number\n", basename(argv[0]));
-        exit(-1);
-    }
-
-    // 获取端口号
-    int port = atoi(argv[1]);
-
-    // 对 SIGPIPE 信号进行处理
-    // SIGPIPE: Broken pipe 向一个没有读端的管道写数据
-    addSignal(SIGPIPE, SIG_IGN);
-    addSignal(SIGALRM, sigHandler);
-    addSignal(SIGTERM, sigHandler);
-    bool stop_server = false;
-
-    // 创建 epoll 对象，事件数组，添加
-    epoll_event events[MAX_EVENT_NUMBER];
-
-    // 创建 epoll 对象，参数可以是任何大于 0 的值
-    epoll_fd = epoll_create(5);
-
-    // 创建线程池，初始化线程池
-    ThreadPool<HttpConnection>* pool = NULL;
-    try {
-        pool = new ThreadPool<HttpConnection>(MAX_THREADS, MAX_FD);
-    }
-    catch (...) {
-        // 创建线程池失败，参数 ... 表示捕获所有类型的异常
+    // 不能写在 assert() 中，定义了 NDEBUG 的优化构建会把整个调用去掉
+    if (sigaction(sig, &sa, NULL) == -1) {
+        perror("sigaction");
         exit(-1);
     }
+}
 
-    // 创建一对相互连接的匿名套接字，适用于本地 IPC，支持全双工通信
-    int ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert(ret != -1);
-    setNonBlocking(pipefd[1]);
-    addFDEpoll(epoll_fd, pipefd[0], false, false);
-
-    // 创建监听用的文件描述符
+// 创建监听用的文件描述符，多 reactor 模式下每个 reactor 通过 SO_REUSEPORT 绑定同一个端口，由内核在它们之间分配新连接
+int createListenSocket(int port, bool reuse_port) {
     int listen_fd = socket(PF_INET, SOCK_STREAM, 0);
     if (listen_fd == -1) {
         perror("socket");
@@ -119,6 +54,9 @@ int main(int argc, char* argv[]) {
     // 设置端口复用
     int reuse = 1;
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuse_port) {
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    }
 
     // 绑定监听用的文件描述符
     int ret1 = bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
@@ -133,139 +71,151 @@ int main(int argc, char* argv[]) {
         perror("listen");
         exit(-1);
     }
+    return listen_fd;
+}
 
-    // 将监听的文件描述符添加到 epoll 对象中，监听的文件描述符不需要 EPOLLONESHOT
-    addFDEpoll(epoll_fd, listen_fd, false, false);
 
-    // 初始化 HttpConnection 的 static 参数
-    HttpConnection::m_epoll_fd = epoll_fd;
+int main(int argc, char* argv[]) {
+    // 解析命令行参数，获取端口号等配置
+    Config config;
+    if (!config.parse(argc, argv)) {
+        Config::usage(basename(argv[0]));
+        exit(-1);
+    }
+    int port = config.port;
+
+    // 由旧进程启动（不停机升级）时接收它的监听 socket，监听队列中的连接不会丢失
+    HotUpgrade::init(argv);
+    int inherited[HotUpgrade::MAX_LISTENERS];
+    int inherited_count = HotUpgrade::inherit(inherited, HotUpgrade::MAX_LISTENERS);
+    if (inherited_count < 0) {
+        printf("failed to receive listening sockets from the old process.\n");
+        exit(-1);
+    }
 
-    bool timeout = false;
-    alarm(TIMESLOT);
+    // 网站的根目录
+    if (!config.doc_root.empty() && !HttpConnection::setDocRoot(config.doc_root.c_str())) {
+        printf("invalid document root: %s\n", config.doc_root.c_str());
+        Config::usage(basename(argv[0]));
+        exit(-1);
+    }
 
-    // 检测 epoll 对象中的 IO 缓冲区变化
-    while (!stop_server) {
-        int num = epoll_wait(epoll_fd, events, MAX_EVENT_NUMBER, -1);
-        if ((num < 0) && (errno != EINTR)) {
-            // 被中断，或者 epoll_wait() 出错
-            printf("epoll failure.\n");
-            break;
+    // 按扩展名的缓存策略
+    for (size_t i = 0; i < config.cache_policies.size(); ++i) {
+        if (!HttpConnection::addCachePolicy(config.cache_policies[i].c_str())) {
+            printf("invalid cache policy: %s\n", config.cache_policies[i].c_str());
+            Config::usage(basename(argv[0]));
+            exit(-1);
         }
+    }
 
-        // 循环遍历 epoll 对象的 IO 事件数组
-        for (int i = 0;i < num;++i) {
-
-            int sockfd = events[i].data.fd;
+    // 设置文件缓存的容量，需要在创建线程池之前设置
+    FileCache* file_cache = FileCache::getInstance();
+    file_cache->setCapacity(config.cache_max_bytes, config.cache_max_files);
+    file_cache->setMapLimit(config.map_limit);
 
-            if (sockfd == listen_fd) {
-                struct sockaddr_in client_addr;
-                socklen_t addr_len = sizeof(client_addr);
-                int communication_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &addr_len);
-                if (communication_fd < 0) {
-                    perror("accept");
-                    printf("errno is %d.\n", errno);
-                }
+    // 对 SIGPIPE 信号进行处理
+    // SIGPIPE: Broken pipe 向一个没有读端的管道写数据
+    addSignal(SIGPIPE, SIG_IGN);
 
-                if (HttpConnection::m_user_count >= MAX_FD) {
-                    // 客户端的连接数已满
-                    close(communication_fd);
-                    continue;
-                }
+    // 创建线程之前屏蔽 SIGTERM、SIGINT 和 SIGHUP，新线程继承信号屏蔽字，这些信号只通过主 reactor 的 signalfd 读取
+    Reactor::blockSignals();
 
-                // 将新的客户端连接数据初始化，在数组中保存客户端的连接信息
-                users[communication_fd].init(communication_fd, client_addr);
+    // 启动后台压缩线程，需要在屏蔽信号之后，线程继承信号屏蔽字
+    if (!GzipCache::getInstance()->setCapacity(config.gzip_max_bytes)) {
+        perror("gzip");
+    }
 
-                // 定时器需要的 ClientData 初始化
-                lst_users[communication_fd].address = client_addr;
-                lst_users[communication_fd].sockfd = communication_fd;
+    // 启动访问日志线程，需要在请求处理线程启动之前
+    if (!config.access_log.empty() && !AccessLog::getInstance()->open(config.access_log.c_str(), config.access_log_rotate)) {
+        perror("access log");
+        exit(-1);
+    }
 
-                // 创建定时器，设置其回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到链表 timer_lst 中
-                UtilTimer* timer = new UtilTimer;
-                timer->user_data = &lst_users[communication_fd];
-                timer->cb_func = cbFunc;
-                time_t cur = time(NULL);    // 获取当前系统时间
-                timer->expire = cur + 3 * TIMESLOT;
-                lst_users[communication_fd].timer = timer;
-                timer_lst.addTimer(timer);
+    // 单 reactor 模式下创建线程池，初始化线程池；多 reactor 模式下请求在 reactor 线程中处理，不需要线程池
+    bool multi_reactor = (config.reactors > 0);
+    int reactor_count = multi_reactor ? config.reactors : 1;
+    ThreadPool<HttpConnection>* pool = NULL;
+    WorkStealingPool<HttpConnection>* ws_pool = NULL;
 
-                printf("communication_fd = %d, addr = %s.\n", communication_fd, inet_ntoa(client_addr.sin_addr));
+    // 绑定 CPU 时前 reactor_count 个 CPU 分配给 reactor，之后的 CPU 依次分配给工作线程，CPU 不够时循环使用
+    int cpu_count = (int)config.cpus.size();
+    std::vector<int> worker_cpus;
+    for (int i = 0;(cpu_count > 0) && (i < config.threads);++i) {
+        worker_cpus.push_back(config.cpus[(reactor_count + i) % cpu_count]);
+    }
+    const int* pool_cpus = worker_cpus.empty() ? NULL : worker_cpus.data();
 
+    if (!multi_reactor) {
+        AdmissionControl::getInstance()->setTarget(config.queue_target_ms);
+        try {
+            if (config.work_stealing) {
+                ws_pool = new WorkStealingPool<HttpConnection>(config.threads, MAX_FD, pool_cpus, (int)worker_cpus.size());
             }
-            else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                // 客户端发生异常断开或者错误等事件
-                users[sockfd].closeConnection();
-            }
-            else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
-                // 处理信号
-                int sig;
-                char signals[1024];
-                ret = recv(pipefd[0], signals, sizeof(signals), 0);
-                if (ret == -1 || ret == 0) {
-                    continue;
-                }
-                else {
-                    for (int i = 0;i < ret;++i) {
-                        switch (signals[i]) {
-                        case SIGALRM:
-                            // 用 timeout 标记有定时任务需要处理，但不立即处理定时任务
-                            // 这是因为定时任务的优先级不是很高，程序优先处理其它更重要的任务
-                            timeout = true;
-                            break;
-                        case SIGTERM:
-                            stop_server = true;
-                        }
-                    }
-                }
-            }
-            else if (events[i].events & EPOLLIN) {
-                // 通信文件描述符读缓冲区有数据
-                UtilTimer* timer = lst_users[sockfd].timer;
-                if (users[sockfd].read()) {
-                    // 一次性把所有数据读完，users + sockfd 找到对应的 HTTP 任务类对象
-                    if (!pool->append(users + sockfd)) {
-                        // 线程池工作队列已满，HTTP 请求数据丢失
-                        users[sockfd].clearBuffer();
-                        continue;
-                    }
-
-                    // 成功读取数据，调整该连接对应的定时器，以延迟该连接被关闭的时间（客户端还在活跃）
-                    if (timer) {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 3 * TIMESLOT;
-                        //printf("adjust timer once.\n");
-                        timer_lst.adjustTimer(timer);
-                    }
-                }
-                else {
-                    // 移除定时器
-                    if (timer) {
-                        timer_lst.delTimer(timer);
-                    }
-                    users[sockfd].closeConnection();
-                }
-            }
-            else if (events[i].events & EPOLLOUT) {
-                if (!users[sockfd].write()) {
-                    // 如果客户端的 keep-alive = false，只写一次 HTTP 响应
-                    users[sockfd].closeConnection();
-                }
+            else {
+                pool = new ThreadPool<HttpConnection>(config.threads, MAX_FD, pool_cpus, (int)worker_cpus.size());
             }
+        }
+        catch (...) {
+            // 创建线程池失败，参数 ... 表示捕获所有类型的异常
+            exit(-1);
+        }
+    }
+
+    // io_uring 后端需要较新的内核（多路 accept / recv、提供缓冲区环），不支持时使用 epoll
+    bool io_uring = config.io_uring;
+    if (io_uring && !Uring::supported()) {
+        printf("io_uring is not supported by this kernel, falling back to epoll.\n");
+        io_uring = false;
+    }
+
+    // 初始化所有 reactor 共享的连接对象数组和连接空闲超时时间
+    Reactor::setConnections(users, lst_users);
+    Reactor::setIdleTimeout(config.idle_timeout);
+    HttpConnection::setReadLimit(config.read_limit);
 
+    // 创建 reactor，第 0 个是运行在主线程中的主 reactor，每个 reactor 拥有自己的监听 socket，优先使用旧进程传来的监听 socket
+    Reactor** reactors = new Reactor*[reactor_count];
+    try {
+        for (int i = 0;i < reactor_count;++i) {
+            int listen_fd = (i < inherited_count) ? inherited[i] : createListenSocket(port, multi_reactor);
+            reactors[i] = new Reactor(listen_fd, i == 0, pool, ws_pool, io_uring);
         }
+    }
+    catch (...) {
+        perror("reactor");
+        exit(-1);
+    }
+    reactors[0]->setPeers(reactors, reactor_count);
 
-        // 最后处理定时事件，因为 I/O 有更高优先级，当然，这样做会存在定时误差
-        // 定时误差导致更容易断开不活跃的连接
-        if (timeout) {
-            timerHandler();
-            timeout = false;
+    for (int i = 1;i < reactor_count;++i) {
+        if (!reactors[i]->start((cpu_count > 0) ? config.cpus[i % cpu_count] : -1)) {
+            perror("pthread_create");
+            exit(-1);
         }
+    }
 
+    // 新的 reactor 已经开始监听，通知旧进程停止 accept
+    for (int i = reactor_count;i < inherited_count;++i) {
+        close(inherited[i]);
     }
+    HotUpgrade::ready();
 
-    close(epoll_fd);
-    close(listen_fd);
-    close(pipefd[1]);
-    close(pipefd[0]);
+    // 所有线程都已经创建（后台线程不继承主 reactor 的绑定），最后把主线程绑定到第一个 CPU 上
+    if (cpu_count > 0) {
+        CpuAffinity::pinSelf(config.cpus[0]);
+    }
+
+    // 主 reactor 在主线程中运行，收到 SIGTERM 后通知其它 reactor 退出，升级时所有 reactor 在连接排空后各自退出
+    reactors[0]->run();
+
+    for (int i = 1;i < reactor_count;++i) {
+        reactors[i]->join();
+    }
+    for (int i = 0;i < reactor_count;++i) {
+        delete reactors[i];
+    }
+    delete[] reactors;
 
     // 工作任务对象数组
     delete[] users;
@@ -275,6 +225,10 @@ int main(int argc, char* argv[]) {
 
     // 线程池对象
     delete pool;
+    delete ws_pool;
+
+    // 写完剩余的访问日志
+    AccessLog::getInstance()->close();
 
     return 0;
-}
\ No newline at end of file
+}
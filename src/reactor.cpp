@@ -0,0 +1,905 @@
+#include "../include/reactor.h"
+#include "../include/file_cache.h"
+#include "../include/gzip_cache.h"
+#include "../include/uring.h"
+#include "../include/hot_upgrade.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+// 设置文件描述符非阻塞
+extern int setNonBlocking(int fd);
+
+// 添加文件描述符到 epoll 对象中
+extern void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot);
+
+// 主 reactor 通过 signalfd 处理的信号：SIGTERM 和 SIGINT 退出服务器，SIGHUP 清空文件缓存和 gzip 变体缓存，SIGUSR2 不停机升级
+static void getHandledSignals(sigset_t* mask) {
+    sigemptyset(mask);
+    sigaddset(mask, SIGTERM);
+    sigaddset(mask, SIGINT);
+    sigaddset(mask, SIGHUP);
+    sigaddset(mask, SIGUSR2);
+}
+
+// io_uring 后端的参数：提交队列项数量，提供缓冲区的数量和大小，发送文件时中转管道的目标容量
+static const unsigned URING_ENTRIES = 1024;
+static const unsigned URING_BUFFERS = 512;
+static const unsigned URING_BUFFER_SIZE = 4096;
+static const int URING_PIPE_SIZE = 1024 * 1024;
+
+// io_uring 完成事件的类型，和文件描述符一起编码在 user_data 中：(类型 << 32) | fd
+enum URING_EVENT {
+    URING_ACCEPT = 1,
+    URING_TIMER,
+    URING_WAKEUP,
+    URING_SIGNAL,
+    URING_NOTIFY,
+    URING_RECV,
+    URING_SEND,
+    URING_SPLICE_IN,        // 文件 -> 管道
+    URING_SPLICE_OUT,       // 管道 -> socket
+    URING_UPGRADE,          // 升级时等待新进程的回复
+    URING_CANCEL            // 取消操作本身的完成事件，不需要处理
+};
+
+static inline uint64_t uringData(int type, int fd) {
+    return ((uint64_t)type << 32) | (uint32_t)fd;
+}
+
+/*
+    io_uring 后端每个连接的状态，以文件描述符为下标，和连接对象数组一样被所有 reactor 共享
+    连接关闭时如果还有提交给内核的操作没有完成，文件描述符不能立即关闭（否则可能被复用），等到 inflight 归零
+*/
+struct UringConnection {
+    int pipe_fds[2];        // 发送文件的中转管道，第一次发送文件区间时创建
+    bool has_pipe;
+    int pipe_size;          // 管道的容量，一次 splice 最多发送的字节数
+    int pipe_bytes;         // 已经进入管道但还没有发送到 socket 的字节数
+    int inflight;           // 提交给内核还没有完成的操作数量（多路 recv 算一个）
+    int send_inflight;      // 其中发送相关的操作数量
+    bool recv_armed;        // 多路 recv 是否仍然有效
+    bool pending_input;     // 发送期间收到了新的数据，发送完毕后需要处理
+    bool closing;           // 已经决定关闭，等待未完成的操作结束
+};
+static UringConnection uring_conns[MAX_FD];
+
+// 当前线程运行的 io_uring reactor，定时器回调函数通过它关闭超时的连接
+static thread_local Reactor* uring_reactor = NULL;
+
+// 静态成员变量需要初始化
+HttpConnection* Reactor::m_users = NULL;
+ClientData* Reactor::m_lst_users = NULL;
+int Reactor::m_idle_timeout = IDLE_TIMEOUT_MS;
+
+Reactor::Reactor(int listen_fd, bool main, ThreadPool<HttpConnection>* pool, WorkStealingPool<HttpConnection>* ws_pool, bool io_uring) :
+    m_listen_fd(listen_fd), m_signal_fd(-1), m_notify_fd(-1), m_main(main), m_stop(false),
+    m_timer_armed(-1), m_events(NULL), m_pool(pool), m_ws_pool(ws_pool), m_peers(NULL), m_peer_count(0), m_thread(0),
+    m_io_uring(io_uring), m_uring(NULL), m_upgrade_fd(-1), m_upgrade_pid(0), m_drain(false), m_draining(false), m_drain_deadline(0) {
+    // 创建 epoll 对象，参数可以是任何大于 0 的值
+    this->m_epoll_fd = epoll_create(5);
+    if (this->m_epoll_fd == -1) {
+        throw std::exception();
+    }
+
+    // 时间轮的 timerfd，使用单调时钟，按照需要设置为下一个定时器到期的绝对时间
+    this->m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (this->m_timer_fd == -1) {
+        throw std::exception();
+    }
+
+    // 其它线程通过 eventfd 唤醒当前 reactor
+    this->m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->m_event_fd == -1) {
+        throw std::exception();
+    }
+
+    if (this->m_main) {
+        // 信号已经被所有线程屏蔽，主 reactor 通过 signalfd 同步地读取它们
+        sigset_t mask;
+        getHandledSignals(&mask);
+        this->m_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (this->m_signal_fd == -1) {
+            throw std::exception();
+        }
+
+        // 被缓存的文件发生变化时，inotify 文件描述符可读，由主 reactor 使对应的缓存项失效
+        this->m_notify_fd = FileCache::getInstance()->getNotifyFd();
+    }
+
+    // io_uring 后端在 reactor 线程中创建 io_uring，失败时才退回到 epoll
+    if (!this->m_io_uring) {
+        this->registerEpoll();
+    }
+}
+
+void Reactor::registerEpoll() {
+    this->m_events = new epoll_event[MAX_EVENT_NUMBER];
+    addFDEpoll(this->m_epoll_fd, this->m_timer_fd, false, false);
+    addFDEpoll(this->m_epoll_fd, this->m_event_fd, false, false);
+
+    // 将监听的文件描述符添加到 epoll 对象中，监听的文件描述符不需要 EPOLLONESHOT
+    addFDEpoll(this->m_epoll_fd, this->m_listen_fd, false, false);
+
+    if (this->m_signal_fd != -1) {
+        addFDEpoll(this->m_epoll_fd, this->m_signal_fd, false, false);
+    }
+    if (this->m_notify_fd != -1) {
+        addFDEpoll(this->m_epoll_fd, this->m_notify_fd, false, false);
+    }
+}
+
+Reactor::~Reactor() {
+    close(this->m_epoll_fd);
+    if (this->m_listen_fd != -1) {
+        close(this->m_listen_fd);
+    }
+    close(this->m_timer_fd);
+    close(this->m_event_fd);
+    if (this->m_signal_fd != -1) {
+        close(this->m_signal_fd);
+    }
+    delete[] this->m_events;
+}
+
+void Reactor::blockSignals() {
+    sigset_t mask;
+    getHandledSignals(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+void Reactor::setConnections(HttpConnection* users, ClientData* lst_users) {
+    m_users = users;
+    m_lst_users = lst_users;
+}
+
+void Reactor::setPeers(Reactor** peers, int count) {
+    this->m_peers = peers;
+    this->m_peer_count = count;
+}
+
+// 定时器回调函数，删除超时连接的 socket 上的注册事件，定时器已经从时间轮中删除
+void Reactor::cbFunc(ClientData* user_data) {
+    ServerStats::add(ServerStats::TIMER_EXPIRIES);
+    if (uring_reactor) {
+        uring_reactor->closeUring(user_data->sockfd, false);
+        return;
+    }
+    m_users[user_data->sockfd].closeConnection();
+}
+
+bool Reactor::start(int cpu) {
+    // 线程一开始就运行在绑定的 CPU 上，事件数组等在线程中第一次写入的内存分配在该 CPU 的 NUMA 结点上
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    CpuAffinity::setAttr(&attr, cpu);
+    int ret = pthread_create(&this->m_thread, &attr, worker, this);
+    pthread_attr_destroy(&attr);
+    return ret == 0;
+}
+
+void Reactor::join() {
+    if (this->m_thread) {
+        pthread_join(this->m_thread, NULL);
+    }
+}
+
+void Reactor::stop() {
+    this->m_stop = true;
+    uint64_t one = 1;
+    ssize_t ret = write(this->m_event_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+void Reactor::drain() {
+    this->m_drain = true;
+    uint64_t one = 1;
+    ssize_t ret = write(this->m_event_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+void* Reactor::worker(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    reactor->run();
+    return reactor;
+}
+
+void Reactor::run() {
+    if (this->m_io_uring) {
+        if (this->runUring()) {
+            return;
+        }
+        printf("io_uring setup failed, falling back to epoll.\n");
+        this->registerEpoll();
+    }
+
+    // 检测 epoll 对象中的 IO 缓冲区变化
+    while (!this->m_stop) {
+        int num = epoll_wait(this->m_epoll_fd, this->m_events, MAX_EVENT_NUMBER, -1);
+        if ((num < 0) && (errno != EINTR)) {
+            // epoll_wait() 出错（信号都已经被屏蔽，正常情况下不会被中断）
+            printf("epoll failure.\n");
+            break;
+        }
+
+        bool timeout = false;
+
+        // 循环遍历 epoll 对象的 IO 事件数组
+        for (int i = 0;i < num;++i) {
+
+            int sockfd = this->m_events[i].data.fd;
+
+            if (sockfd == this->m_listen_fd) {
+                this->handleAccept();
+            }
+            else if (sockfd == this->m_timer_fd) {
+                // 用 timeout 标记有定时任务需要处理，但不立即处理定时任务
+                // 这是因为定时任务的优先级不是很高，程序优先处理其它更重要的任务
+                uint64_t expirations;
+                ssize_t ret = read(this->m_timer_fd, &expirations, sizeof(expirations));
+                (void)ret;
+                timeout = true;
+            }
+            else if (sockfd == this->m_event_fd) {
+                // 被其它线程唤醒，退出标记在循环条件中检查
+                uint64_t value;
+                ssize_t ret = read(this->m_event_fd, &value, sizeof(value));
+                (void)ret;
+            }
+            else if (sockfd == this->m_signal_fd) {
+                this->handleSignal();
+            }
+            else if ((sockfd == this->m_upgrade_fd) && (sockfd != -1)) {
+                this->finishUpgrade();
+            }
+            else if ((sockfd == this->m_notify_fd) && (this->m_events[i].events & EPOLLIN)) {
+                // 被缓存的文件发生了变化
+                FileCache::getInstance()->handleNotify();
+            }
+            else if (this->m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                // 客户端发生异常断开或者错误等事件
+                this->closeConnection(sockfd);
+            }
+            else if (this->m_events[i].events & EPOLLIN) {
+                this->handleRead(sockfd);
+            }
+            else if (this->m_events[i].events & EPOLLOUT) {
+                this->handleWrite(sockfd);
+            }
+        }
+
+        // 最后处理定时事件，因为 I/O 有更高优先级
+        if (timeout) {
+            this->timerHandler();
+        }
+
+        if (this->m_drain && !this->m_draining) {
+            this->startDrain();
+        }
+        if (this->m_draining) {
+            this->checkDrain();
+        }
+    }
+}
+
+void Reactor::handleAccept() {
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    int communication_fd = accept(this->m_listen_fd, (struct sockaddr*)&client_addr, &addr_len);
+    if (communication_fd < 0) {
+        // 多 reactor 共享监听队列时，连接可能已经被其它 reactor 接受
+        if (errno != EAGAIN) {
+            perror("accept");
+            printf("errno is %d.\n", errno);
+        }
+        return;
+    }
+
+    this->addConnection(communication_fd, client_addr, this->m_epoll_fd);
+}
+
+bool Reactor::addConnection(int communication_fd, const sockaddr_in& client_addr, int epoll_fd) {
+    if (HttpConnection::m_user_count >= MAX_FD) {
+        // 客户端的连接数已满
+        close(communication_fd);
+        return false;
+    }
+
+    // 将新的客户端连接数据初始化，在数组中保存客户端的连接信息，连接注册到当前 reactor 的 epoll 对象中
+    m_users[communication_fd].init(communication_fd, client_addr, epoll_fd);
+    ServerStats::add(ServerStats::ACCEPTS);
+
+    // 定时器需要的 ClientData 初始化
+    m_lst_users[communication_fd].address = client_addr;
+    m_lst_users[communication_fd].sockfd = communication_fd;
+
+    // 设置内嵌定时器的回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到时间轮 m_time_wheel 中
+    UtilTimer* timer = &m_lst_users[communication_fd].timer;
+    timer->user_data = &m_lst_users[communication_fd];
+    timer->cb_func = cbFunc;
+    timer->expire = getCurrentMs() + m_idle_timeout;
+    this->m_time_wheel.addTimer(timer);
+
+    // 新的定时器比 timerfd 的到期时间更早时，重新设置 timerfd
+    if ((this->m_timer_armed == -1) || (timer->expire < this->m_timer_armed)) {
+        this->armTimer();
+    }
+
+    return true;
+}
+
+void Reactor::handleSignal() {
+    struct signalfd_siginfo info;
+    while (read(this->m_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+        case SIGTERM:
+        case SIGINT:
+            // 通知所有 reactor 退出
+            for (int i = 0;i < this->m_peer_count;++i) {
+                this->m_peers[i]->stop();
+            }
+            this->m_stop = true;
+            break;
+        case SIGHUP:
+            // 丢弃所有缓存的文件和压缩变体，之后的请求重新打开文件
+            FileCache::getInstance()->clear();
+            GzipCache::getInstance()->clear();
+            break;
+        case SIGUSR2:
+            this->startUpgrade();
+            break;
+        }
+    }
+}
+
+void Reactor::startUpgrade() {
+    if ((this->m_upgrade_fd != -1) || this->m_draining) {
+        // 上一次升级还没有结束，或者已经把监听 socket 交给了新进程
+        return;
+    }
+
+    int fds[HotUpgrade::MAX_LISTENERS];
+    int count = 0;
+    for (int i = 0; (i < this->m_peer_count) && (count < HotUpgrade::MAX_LISTENERS); ++i) {
+        fds[count++] = this->m_peers[i]->m_listen_fd;
+    }
+    this->m_upgrade_fd = HotUpgrade::spawn(fds, count, &this->m_upgrade_pid);
+    if (this->m_upgrade_fd == -1) {
+        perror("upgrade");
+        return;
+    }
+    printf("upgrade: started new process %d.\n", (int)this->m_upgrade_pid);
+
+    // 新进程启动需要一段时间，期间继续正常服务，回复（或者新进程退出）时 socket 可读
+    if (this->m_uring) {
+        this->armPoll(URING_UPGRADE, this->m_upgrade_fd);
+    }
+    else {
+        addFDEpoll(this->m_epoll_fd, this->m_upgrade_fd, false, false);
+    }
+}
+
+void Reactor::finishUpgrade() {
+    char ok = 0;
+    ssize_t ret = read(this->m_upgrade_fd, &ok, 1);
+    if (this->m_uring) {
+        Uring::prepCancel(this->m_uring->getSqe(), uringData(URING_UPGRADE, this->m_upgrade_fd), uringData(URING_CANCEL, 0));
+    }
+    else {
+        epoll_ctl(this->m_epoll_fd, EPOLL_CTL_DEL, this->m_upgrade_fd, NULL);
+    }
+    close(this->m_upgrade_fd);
+    this->m_upgrade_fd = -1;
+
+    if ((ret != 1) || (ok != 1)) {
+        // 新进程没有接管监听 socket 就退出了，继续使用旧进程服务
+        printf("upgrade: new process %d failed, still serving.\n", (int)this->m_upgrade_pid);
+        // 新进程关闭通道之后马上就会退出，阻塞等待回收，否则刚关闭通道、还没有退出的进程会成为僵尸进程
+        while ((waitpid(this->m_upgrade_pid, NULL, 0) < 0) && (errno == EINTR)) {
+        }
+        return;
+    }
+
+    // 新进程已经在 accept，之后的响应都不再保持连接，所有 reactor 停止 accept 并等待连接关闭
+    printf("upgrade: new process %d is serving, draining connections.\n", (int)this->m_upgrade_pid);
+    HttpConnection::m_draining = true;
+    for (int i = 0; i < this->m_peer_count; ++i) {
+        this->m_peers[i]->drain();
+    }
+}
+
+/*
+    监听 socket 已经由新进程持有，关闭自己的副本不会影响监听队列，已经完成握手还没有 accept 的连接由新进程接受
+    空闲的保持连接由空闲超时关闭，活跃的连接在下一个响应（Connection: close）发送完毕后关闭
+*/
+void Reactor::startDrain() {
+    this->m_draining = true;
+    if (this->m_uring) {
+        Uring::prepCancel(this->m_uring->getSqe(), uringData(URING_ACCEPT, this->m_listen_fd), uringData(URING_CANCEL, 0));
+    }
+    else {
+        epoll_ctl(this->m_epoll_fd, EPOLL_CTL_DEL, this->m_listen_fd, NULL);
+    }
+    close(this->m_listen_fd);
+    this->m_listen_fd = -1;
+
+    this->m_drain_deadline = getCurrentMs() + DRAIN_TIMEOUT_MS;
+    this->m_drain_timer.cb_func = drainFunc;
+}
+
+void Reactor::checkDrain() {
+    long long now = getCurrentMs();
+    if ((HttpConnection::m_user_count == 0) || (now >= this->m_drain_deadline)) {
+        this->m_stop = true;
+        return;
+    }
+
+    // 连接可能在其它 reactor 或者工作线程中关闭，定期检查
+    if (this->m_drain_timer.slot == -1) {
+        this->m_drain_timer.expire = now + DRAIN_CHECK_MS;
+        this->m_time_wheel.addTimer(&this->m_drain_timer);
+        if ((this->m_timer_armed == -1) || (this->m_drain_timer.expire < this->m_timer_armed)) {
+            this->armTimer();
+        }
+    }
+}
+
+void Reactor::handleRead(int sockfd) {
+    // 通信文件描述符读缓冲区有数据，一次性把所有数据读完
+    if (m_users[sockfd].read()) {
+        this->handleRequest(sockfd);
+    }
+    else {
+        this->closeConnection(sockfd);
+    }
+}
+
+void Reactor::handleRequest(int sockfd) {
+    UtilTimer* timer = &m_lst_users[sockfd].timer;
+    if (this->m_pool || this->m_ws_pool) {
+        // 排队时间持续超过目标值或者线程池工作队列已满时不再排队，立即返回 503 并关闭连接，客户端不必等到空闲超时
+        long long now = ServerStats::now();
+        if (!AdmissionControl::getInstance()->admit(now)) {
+            ServerStats::add(ServerStats::OVERLOAD_SHED);
+            m_users[sockfd].rejectOverloaded();
+            this->closeConnection(sockfd);
+            return;
+        }
+        // users + sockfd 找到对应的 HTTP 任务类对象
+        if (!this->dispatch(m_users + sockfd, now)) {
+            ServerStats::add(ServerStats::QUEUE_FULL);
+            m_users[sockfd].rejectOverloaded();
+            this->closeConnection(sockfd);
+            return;
+        }
+    }
+    else if (!m_users[sockfd].processInline()) {
+        // 在当前 reactor 线程中解析请求并直接发送响应，失败或者不需要保持连接时关闭连接
+        this->closeConnection(sockfd);
+        return;
+    }
+
+    // 成功读取数据，调整该连接对应的定时器，以延迟该连接被关闭的时间（客户端还在活跃）
+    // 定时器只会被延后，timerfd 不需要重新设置，到期时发现没有需要处理的定时器会设置为下一个到期时间
+    timer->expire = getCurrentMs() + m_idle_timeout;
+    this->m_time_wheel.adjustTimer(timer);
+}
+
+bool Reactor::dispatch(HttpConnection* user, long long now) {
+    user->markDispatched(now);
+    if (this->m_ws_pool) {
+        return this->m_ws_pool->append(user);
+    }
+    return this->m_pool->append(user);
+}
+
+void Reactor::handleWrite(int sockfd) {
+    if (!m_users[sockfd].write()) {
+        // 如果客户端的 keep-alive = false，只写一次 HTTP 响应
+        this->closeConnection(sockfd);
+    }
+    else if (m_users[sockfd].hasBufferedRequest()) {
+        // 响应发送完毕，读缓冲区中还有流水线请求没有处理，不需要等待 EPOLLIN 事件，直接继续处理
+        this->handleRequest(sockfd);
+    }
+}
+
+/*
+    关闭连接之前必须把定时器从时间轮中删除，否则文件描述符被复用之后，
+    内嵌在 ClientData 中的定时器结点还挂在时间轮上，会误关闭新的连接
+*/
+void Reactor::closeConnection(int sockfd) {
+    this->m_time_wheel.delTimer(&m_lst_users[sockfd].timer);
+    m_users[sockfd].closeConnection();
+}
+
+// 超时函数处理
+void Reactor::timerHandler() {
+    // 定时处理任务，实际上就是调用tick()函数
+    this->m_time_wheel.tick();
+
+    // timerfd 是一次性的，已经到期，重新设置为下一个定时器到期的时间
+    this->m_timer_armed = -1;
+    this->armTimer();
+}
+
+void Reactor::armTimer() {
+    long long next = this->m_time_wheel.nextExpire();
+    if (next == this->m_timer_armed) {
+        return;
+    }
+
+    // it_value 为 0 表示取消定时
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next != -1) {
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000;
+    }
+    timerfd_settime(this->m_timer_fd, (next != -1) ? TFD_TIMER_ABSTIME : 0, &its, NULL);
+    this->m_timer_armed = next;
+}
+
+/*
+    io_uring 事件循环
+    - 监听 socket 上提交一次多路 accept，每接受一个连接产生一个完成事件
+    - timerfd、eventfd、signalfd 和 inotify 文件描述符提交多路 poll，可读时和 epoll 模式一样读取它们
+    - 处理完一批完成事件时新准备的提交队列项（recv、sendmsg、splice 等），在下一次等待时和等待一起通过一次 io_uring_enter() 提交
+*/
+bool Reactor::runUring() {
+    Uring uring;
+    if (!uring.init(URING_ENTRIES) || !uring.setupBuffers(URING_BUFFERS, URING_BUFFER_SIZE)) {
+        return false;
+    }
+    this->m_uring = &uring;
+    uring_reactor = this;
+
+    Uring::prepAcceptMultishot(uring.getSqe(), this->m_listen_fd, uringData(URING_ACCEPT, this->m_listen_fd));
+    this->armPoll(URING_TIMER, this->m_timer_fd);
+    this->armPoll(URING_WAKEUP, this->m_event_fd);
+    if (this->m_signal_fd != -1) {
+        this->armPoll(URING_SIGNAL, this->m_signal_fd);
+    }
+    if (this->m_notify_fd != -1) {
+        this->armPoll(URING_NOTIFY, this->m_notify_fd);
+    }
+
+    while (!this->m_stop) {
+        int ret = uring.submitAndWait(1);
+        if ((ret < 0) && (ret != -EINTR) && (ret != -EAGAIN) && (ret != -EBUSY)) {
+            // EAGAIN 和 EBUSY 表示完成队列溢出，处理完已有的完成事件之后重试
+            printf("io_uring failure.\n");
+            break;
+        }
+
+        // 完成事件中的数据先取出再标记为已处理，处理过程中会继续准备新的提交队列项
+        bool timeout = false;
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring.peekCqe()) != NULL) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring.seen();
+
+            int type = (int)(user_data >> 32);
+            if (type == URING_TIMER) {
+                // 和 epoll 模式一样，定时任务放在最后处理
+                uint64_t expirations;
+                ssize_t n = read(this->m_timer_fd, &expirations, sizeof(expirations));
+                (void)n;
+                timeout = true;
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    this->armPoll(URING_TIMER, this->m_timer_fd);
+                }
+                continue;
+            }
+            this->handleUringEvent(type, (int)(uint32_t)user_data, res, flags);
+        }
+
+        if (timeout) {
+            this->timerHandler();
+        }
+
+        if (this->m_drain && !this->m_draining) {
+            this->startDrain();
+        }
+        if (this->m_draining) {
+            this->checkDrain();
+        }
+    }
+
+    uring_reactor = NULL;
+    this->m_uring = NULL;
+    return true;
+}
+
+void Reactor::handleUringEvent(int type, int fd, int res, unsigned flags) {
+    bool more = flags & IORING_CQE_F_MORE;
+    UringConnection* conn = &uring_conns[fd];
+
+    switch (type) {
+    case URING_ACCEPT: {
+        if (!more && !this->m_stop && (this->m_listen_fd != -1)) {
+            Uring::prepAcceptMultishot(this->m_uring->getSqe(), this->m_listen_fd, uringData(URING_ACCEPT, this->m_listen_fd));
+        }
+        if (res < 0) {
+            // 排空时取消多路 accept 会产生 ECANCELED
+            if ((res != -EAGAIN) && (res != -ECANCELED)) {
+                printf("accept: %s.\n", strerror(-res));
+            }
+            return;
+        }
+
+        // 多路 accept 不返回客户端地址，从 socket 中获取
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+        getpeername(res, (struct sockaddr*)&client_addr, &addr_len);
+
+        memset(&uring_conns[res], 0, sizeof(uring_conns[res]));
+        if (this->addConnection(res, client_addr, -1)) {
+            this->armRecv(res);
+        }
+        return;
+    }
+    case URING_WAKEUP: {
+        // 被其它线程唤醒，退出标记在循环条件中检查
+        uint64_t value;
+        ssize_t n = read(this->m_event_fd, &value, sizeof(value));
+        (void)n;
+        if (!more) {
+            this->armPoll(URING_WAKEUP, this->m_event_fd);
+        }
+        return;
+    }
+    case URING_SIGNAL:
+        this->handleSignal();
+        if (!more) {
+            this->armPoll(URING_SIGNAL, this->m_signal_fd);
+        }
+        return;
+    case URING_UPGRADE:
+        // 取消之后的完成事件属于已经关闭的 socket，忽略
+        if ((fd == this->m_upgrade_fd) && (res > 0)) {
+            this->finishUpgrade();
+        }
+        return;
+    case URING_NOTIFY:
+        // 被缓存的文件发生了变化
+        FileCache::getInstance()->handleNotify();
+        if (!more) {
+            this->armPoll(URING_NOTIFY, this->m_notify_fd);
+        }
+        return;
+    case URING_RECV: {
+        if (!more) {
+            --conn->inflight;
+            conn->recv_armed = false;
+        }
+        if (res > 0) {
+            // 数据拷贝到连接的读缓冲区后立即把提供缓冲区放回环中
+            unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            bool ok = conn->closing || m_users[fd].appendInput(this->m_uring->buffer(bid), res);
+            this->m_uring->recycleBuffer(bid);
+            if (conn->closing) {
+                break;
+            }
+            if (!ok) {
+                this->closeUring(fd, true);
+                return;
+            }
+            if (!conn->recv_armed) {
+                this->armRecv(fd);
+            }
+            if (conn->send_inflight > 0) {
+                // 上一批响应还在发送，发送完毕后再处理新的请求，保证响应的顺序
+                conn->pending_input = true;
+            }
+            else {
+                this->serveUring(fd);
+            }
+            return;
+        }
+        if ((res == -ENOBUFS) && !conn->closing) {
+            // 提供缓冲区暂时用完，多路 recv 被终止，重新提交
+            this->armRecv(fd);
+            return;
+        }
+        if (!conn->closing) {
+            // 对方关闭连接或者出错
+            this->closeUring(fd, true);
+            return;
+        }
+        break;
+    }
+    case URING_SEND:
+    case URING_SPLICE_IN:
+    case URING_SPLICE_OUT:
+        --conn->inflight;
+        --conn->send_inflight;
+        if (conn->closing) {
+            break;
+        }
+        if (res == -ECANCELED) {
+            // 链接中前一个操作没有完整完成，后面的操作被取消，剩余的数据在下一批中重新发送
+        }
+        else if ((res < 0) || ((res == 0) && (type == URING_SPLICE_IN))) {
+            // 发送出错，或者文件在发送过程中被截断，无法再发送剩余的响应体
+            this->closeUring(fd, true);
+            return;
+        }
+        else if (type == URING_SPLICE_OUT) {
+            conn->pipe_bytes -= res;
+        }
+        else {
+            // 进入管道的文件数据和发送出去的内存块一样从发送队列中扣除，管道中的数据由 pipe_bytes 记录
+            m_users[fd].consumeChunks(res);
+            if (type == URING_SPLICE_IN) {
+                conn->pipe_bytes += res;
+            }
+        }
+        this->continueUring(fd);
+        return;
+    default:
+        return;
+    }
+
+    // 连接正在关闭，最后一个操作完成时真正关闭
+    if (conn->closing && (conn->inflight == 0)) {
+        this->finishClose(fd);
+    }
+}
+
+void Reactor::armPoll(int type, int fd) {
+    Uring::prepPollMultishot(this->m_uring->getSqe(), fd, uringData(type, fd));
+}
+
+void Reactor::armRecv(int sockfd) {
+    Uring::prepRecvMultishot(this->m_uring->getSqe(), sockfd, uringData(URING_RECV, sockfd));
+    uring_conns[sockfd].recv_armed = true;
+    ++uring_conns[sockfd].inflight;
+}
+
+void Reactor::serveUring(int sockfd) {
+    // 解析所有完整的 HTTP 请求并生成响应
+    HttpConnection* user = m_users + sockfd;
+    if (!user->prepareResponses()) {
+        this->closeUring(sockfd, true);
+        return;
+    }
+
+
+    // 成功读取数据，调整该连接对应的定时器，需要在发送之前调整（发送失败时会删除定时器）
+    UtilTimer* timer = &m_lst_users[sockfd].timer;
+    timer->expire = getCurrentMs() + m_idle_timeout;
+    this->m_time_wheel.adjustTimer(timer);
+
+    if (user->hasPendingOutput()) {
+        this->sendUring(sockfd);
+    }
+}
+
+/*
+    提交发送队列中的下一批数据
+    - 连续的内存块合并成一个 sendmsg()，MSG_WAITALL 让内核发送完所有数据才完成，只有出错时才会提前结束并取消链接的后续操作
+    - 文件区间通过两个链接的 splice 发送：文件 -> 管道 -> socket，数据不经过用户态；
+      紧随内存块之后的文件区间和 sendmsg() 链接在一起，响应头和响应体在同一次提交中按顺序发送
+    - 上一批中因为链接被取消而留在管道中的数据，先单独发送
+*/
+void Reactor::sendUring(int sockfd) {
+    UringConnection* conn = &uring_conns[sockfd];
+    Uring* uring = this->m_uring;
+    uring->reserve(3);
+
+    if (conn->pipe_bytes > 0) {
+        Uring::prepSplice(uring->getSqe(), conn->pipe_fds[0], -1, sockfd, conn->pipe_bytes, uringData(URING_SPLICE_OUT, sockfd));
+        ++conn->inflight;
+        ++conn->send_inflight;
+        return;
+    }
+
+    int file_fd = -1;
+    off_t offset = 0;
+    off_t count = 0;
+    const struct msghdr* msg = m_users[sockfd].nextSend(&file_fd, &offset, &count);
+
+    if ((file_fd != -1) && !conn->has_pipe) {
+        // 第一次发送文件区间时创建中转管道，尽量扩大容量以减少 splice 的次数
+        if (pipe2(conn->pipe_fds, O_CLOEXEC) < 0) {
+            file_fd = -1;
+            if (msg == NULL) {
+                this->closeUring(sockfd, true);
+                return;
+            }
+        }
+        else {
+            conn->has_pipe = true;
+            fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, URING_PIPE_SIZE);
+            conn->pipe_size = fcntl(conn->pipe_fds[1], F_GETPIPE_SZ);
+        }
+    }
+
+    if (msg) {
+        struct io_uring_sqe* sqe = uring->getSqe();
+        Uring::prepSendMsg(sqe, sockfd, msg, MSG_NOSIGNAL | MSG_WAITALL | ((file_fd != -1) ? MSG_MORE : 0), uringData(URING_SEND, sockfd));
+        if (file_fd != -1) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        ++conn->inflight;
+        ++conn->send_inflight;
+    }
+
+    if (file_fd != -1) {
+        unsigned len = (count > conn->pipe_size) ? conn->pipe_size : (unsigned)count;
+        struct io_uring_sqe* in = uring->getSqe();
+        Uring::prepSplice(in, file_fd, offset, conn->pipe_fds[1], len, uringData(URING_SPLICE_IN, sockfd));
+        in->flags |= IOSQE_IO_LINK;
+        Uring::prepSplice(uring->getSqe(), conn->pipe_fds[0], -1, sockfd, len, uringData(URING_SPLICE_OUT, sockfd));
+        conn->inflight += 2;
+        conn->send_inflight += 2;
+    }
+}
+
+void Reactor::continueUring(int sockfd) {
+    UringConnection* conn = &uring_conns[sockfd];
+    if (conn->send_inflight > 0) {
+        // 同一批中还有操作没有完成
+        return;
+    }
+
+    HttpConnection* user = m_users + sockfd;
+    if ((conn->pipe_bytes > 0) || user->hasPendingOutput()) {
+        this->sendUring(sockfd);
+        return;
+    }
+
+    // 排队的响应全部发送完毕
+    if (!user->finishWrite()) {
+        this->closeUring(sockfd, true);
+        return;
+    }
+    if (user->hasBufferedRequest() || conn->pending_input) {
+        // 读缓冲区中还有没有处理的流水线请求，或者发送期间收到了新的数据
+        conn->pending_input = false;
+        this->serveUring(sockfd);
+    }
+}
+
+/*
+    关闭 io_uring 后端的连接，定时器回调中调用时定时器已经从时间轮中删除
+    还有提交给内核的操作时先 shutdown()，让它们尽快完成（recv 返回 0，发送返回错误），最后一个操作完成时再关闭文件描述符
+*/
+void Reactor::closeUring(int sockfd, bool del_timer) {
+    UringConnection* conn = &uring_conns[sockfd];
+    if (conn->closing) {
+        return;
+    }
+    if (del_timer) {
+        this->m_time_wheel.delTimer(&m_lst_users[sockfd].timer);
+    }
+    if (conn->inflight > 0) {
+        conn->closing = true;
+        shutdown(sockfd, SHUT_RDWR);
+        return;
+    }
+    this->finishClose(sockfd);
+}
+
+void Reactor::finishClose(int sockfd) {
+    UringConnection* conn = &uring_conns[sockfd];
+    if (conn->has_pipe) {
+        close(conn->pipe_fds[0]);
+        close(conn->pipe_fds[1]);
+    }
+    memset(conn, 0, sizeof(*conn));
+    m_users[sockfd].closeConnection();
+}
@@ -0,0 +1,141 @@
+#include "../include/server_stats.h"
+#include <stdio.h>
+#include <string.h>
+
+// 静态成员变量需要初始化
+ServerStats::Shard* ServerStats::m_shards[ServerStats::MAX_SHARDS];
+std::atomic<int> ServerStats::m_shard_count(0);
+ServerStats::Shard ServerStats::m_discard;
+
+// 计数器在 Prometheus 中的名称和说明，状态码计数器合并成一个带 code 标签的指标
+static const char* const counter_names[] = {
+    "webserver_accepts_total",
+    "webserver_queue_full_drops_total",
+    "webserver_overload_shed_total",
+    "webserver_timer_expiries_total",
+    "webserver_response_bytes_total",
+    "webserver_access_log_drops_total"
+};
+static const char* const counter_help[] = {
+    "Accepted client connections.",
+    "Request batches answered with 503 because the thread pool queue was full.",
+    "Request batches answered with 503 because the thread pool queue delay stayed above the admission target.",
+    "Connections closed by the idle timeout.",
+    "Response bytes handed to the kernel.",
+    "Access log records dropped because the thread's log ring was full."
+};
+static const int status_codes[] = { 200, 206, 304, 400, 403, 404, 416, 500, 501, 503 };
+
+static const char* const histogram_names[] = {
+    "webserver_queue_wait_seconds",
+    "webserver_parse_seconds",
+    "webserver_file_lookup_seconds",
+    "webserver_write_seconds"
+};
+static const char* const histogram_help[] = {
+    "Time from handing a connection to the thread pool until a worker picks it up.",
+    "Time spent parsing a request line and headers (sampled).",
+    "Time spent looking up the requested file in the file cache (sampled).",
+    "Time from queueing the first response of a batch until the whole batch is sent (sampled)."
+};
+
+static_assert(sizeof(counter_names) / sizeof(counter_names[0]) == ServerStats::REQ_200, "one name per plain counter");
+static_assert(sizeof(status_codes) / sizeof(status_codes[0]) == ServerStats::COUNTER_COUNT - ServerStats::REQ_200, "one code per status counter");
+static_assert(sizeof(histogram_names) / sizeof(histogram_names[0]) == ServerStats::HISTOGRAM_COUNT, "one name per histogram");
+
+/*
+    分片在线程第一次记录时申请，线程退出后也不释放：线程数量在启动时就确定了，
+    保留分片让退出线程记录的数据仍然计入总数
+*/
+ServerStats::Shard* ServerStats::registerShard() {
+    int index = m_shard_count.load(std::memory_order_relaxed);
+    Shard* local = &m_discard;
+    while (index < MAX_SHARDS) {
+        if (m_shard_count.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+            local = new Shard;
+            for (int i = 0; i < COUNTER_COUNT; ++i) {
+                local->counters[i].store(0, std::memory_order_relaxed);
+            }
+            for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+                for (int b = 0; b <= BUCKETS; ++b) {
+                    local->buckets[h][b].store(0, std::memory_order_relaxed);
+                }
+                local->sums[h].store(0, std::memory_order_relaxed);
+            }
+            // 读取线程看到指针时分片已经初始化完毕
+            __atomic_store_n(&m_shards[index], local, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    m_local = local;
+    return local;
+}
+
+void ServerStats::request(int status) {
+    for (int i = 0; i < COUNTER_COUNT - REQ_200; ++i) {
+        if (status_codes[i] == status) {
+            add((COUNTER)(REQ_200 + i));
+            return;
+        }
+    }
+}
+
+void ServerStats::render(std::string* out, int connections) {
+    // 汇总所有已经注册的分片，分片可能刚刚占用了编号还没有发布，跳过即可
+    uint64_t counters[COUNTER_COUNT] = { 0 };
+    uint64_t buckets[HISTOGRAM_COUNT][BUCKETS + 1];
+    uint64_t sums[HISTOGRAM_COUNT] = { 0 };
+    memset(buckets, 0, sizeof(buckets));
+    int count = m_shard_count.load(std::memory_order_relaxed);
+    for (int s = 0; s < count; ++s) {
+        Shard* shard = __atomic_load_n(&m_shards[s], __ATOMIC_ACQUIRE);
+        if (shard == NULL) {
+            continue;
+        }
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+            for (int b = 0; b <= BUCKETS; ++b) {
+                buckets[h][b] += shard->buckets[h][b].load(std::memory_order_relaxed);
+            }
+            sums[h] += shard->sums[h].load(std::memory_order_relaxed);
+        }
+    }
+
+    char line[512];
+    out->append("# HELP webserver_connections Open client connections.\n# TYPE webserver_connections gauge\n");
+    snprintf(line, sizeof(line), "webserver_connections %d\n", connections);
+    out->append(line);
+
+    for (int i = 0; i < REQ_200; ++i) {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                 counter_names[i], counter_help[i], counter_names[i], counter_names[i], (unsigned long long)counters[i]);
+        out->append(line);
+    }
+
+    out->append("# HELP webserver_responses_total Responses by status code.\n# TYPE webserver_responses_total counter\n");
+    for (int i = REQ_200; i < COUNTER_COUNT; ++i) {
+        snprintf(line, sizeof(line), "webserver_responses_total{code=\"%d\"} %llu\n",
+                 status_codes[i - REQ_200], (unsigned long long)counters[i]);
+        out->append(line);
+    }
+
+    // 直方图的桶在 Prometheus 中是累积的，上界以秒为单位
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+        const char* name = histogram_names[h];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_help[h], name);
+        out->append(line);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            cumulative += buckets[h][b];
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n",
+                     name, (double)(1ULL << (BUCKET_SHIFT + b)) / 1e9, (unsigned long long)cumulative);
+            out->append(line);
+        }
+        cumulative += buckets[h][BUCKETS];
+        snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n",
+                 name, (unsigned long long)cumulative, name, sums[h] / 1e9, name, (unsigned long long)cumulative);
+        out->append(line);
+    }
+}
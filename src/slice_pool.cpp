@@ -0,0 +1,181 @@
+#include "../include/slice_pool.h"
+#include <sys/mman.h>
+
+SlicePool::SlicePool() : m_partial(NULL), m_cold(NULL), m_empty_warm(0), m_slabs(0) {
+
+}
+
+SlicePool* SlicePool::getInstance() {
+    static SlicePool pool;
+    return &pool;
+}
+
+SlicePool::LocalCache::~LocalCache() {
+    SlicePool::getInstance()->releaseBatch(this->slices, this->count);
+    this->count = 0;
+}
+
+SlicePool::LocalCache& SlicePool::localCache() {
+    static thread_local LocalCache cache;
+    return cache;
+}
+
+char* SlicePool::acquire() {
+    LocalCache& cache = localCache();
+    if (cache.count == 0) {
+        // 本地缓存已空，从全局池批量申请
+        cache.count = this->acquireBatch(cache.slices, LOCAL_BATCH);
+        if (cache.count == 0) {
+            return NULL;
+        }
+    }
+    return cache.slices[--cache.count];
+}
+
+void SlicePool::release(char* slice) {
+    LocalCache& cache = localCache();
+    if (cache.count == LOCAL_CACHE_SIZE) {
+        // 本地缓存已满，把最早放入的一批归还给全局池
+        this->releaseBatch(cache.slices, LOCAL_BATCH);
+        cache.count -= LOCAL_BATCH;
+        for (int i = 0; i < cache.count; ++i) {
+            cache.slices[i] = cache.slices[i + LOCAL_BATCH];
+        }
+    }
+    cache.slices[cache.count++] = slice;
+}
+
+size_t SlicePool::slabCount() {
+    this->m_lock.lock();
+    size_t slabs = this->m_slabs;
+    this->m_lock.unlock();
+    return slabs;
+}
+
+int SlicePool::acquireBatch(char** slices, int count) {
+    int got = 0;
+    this->m_lock.lock();
+    while (got < count) {
+        Slab* slab = this->m_partial;
+        if (slab == NULL) {
+            // 优先使用物理内存已经归还的 slab，再次访问时由内核按页重新分配
+            slab = this->m_cold;
+            if (slab != NULL) {
+                this->unlinkSlab(&this->m_cold, slab);
+                slab->cold = false;
+            }
+            else {
+                slab = this->newSlab();
+                if (slab == NULL) {
+                    break;
+                }
+            }
+            this->pushSlab(&this->m_partial, slab, true);
+            ++this->m_empty_warm;
+        }
+
+        if (slab->free_count == SLAB_SLICES - 1) {
+            --this->m_empty_warm;
+        }
+        while ((got < count) && (slab->free_count > 0)) {
+            int index = slab->free[--slab->free_count];
+            slices[got++] = (char*)slab + ((size_t)index << SLICE_SHIFT);
+        }
+        if (slab->free_count == 0) {
+            this->unlinkSlab(&this->m_partial, slab);
+        }
+    }
+    this->m_lock.unlock();
+    return got;
+}
+
+void SlicePool::releaseBatch(char** slices, int count) {
+    this->m_lock.lock();
+    for (int i = 0; i < count; ++i) {
+        Slab* slab = slabOf(slices[i]);
+        int index = (int)((slices[i] - (char*)slab) >> SLICE_SHIFT);
+        if (slab->free_count == 0) {
+            // slab 重新有了空闲分片
+            this->pushSlab(&this->m_partial, slab, true);
+        }
+        slab->free[slab->free_count++] = index;
+        if (slab->free_count < SLAB_SLICES - 1) {
+            continue;
+        }
+
+        // slab 中所有的分片都空闲了，放到链表末尾，最后才被使用
+        this->unlinkSlab(&this->m_partial, slab);
+        if (this->m_empty_warm < KEEP_WARM_SLABS) {
+            this->pushSlab(&this->m_partial, slab, false);
+            ++this->m_empty_warm;
+        }
+        else {
+            // 已经保留了足够多的空闲 slab，把这个 slab 的物理内存还给内核（slab 头所在的页除外）
+            madvise((char*)slab + SLICE_SIZE, SLAB_SIZE - SLICE_SIZE, MADV_DONTNEED);
+            slab->cold = true;
+            this->pushSlab(&this->m_cold, slab, true);
+        }
+    }
+    this->m_lock.unlock();
+}
+
+SlicePool::Slab* SlicePool::newSlab() {
+    // 多申请一个 slab 的空间，截取其中按照 SLAB_SIZE 对齐的部分
+    size_t length = SLAB_SIZE * 2;
+    char* raw = (char*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char* aligned = (char*)(((uintptr_t)raw + SLAB_SIZE - 1) & ~(uintptr_t)(SLAB_SIZE - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    if (aligned + SLAB_SIZE < raw + length) {
+        munmap(aligned + SLAB_SIZE, raw + length - aligned - SLAB_SIZE);
+    }
+
+    Slab* slab = (Slab*)aligned;
+    slab->prev = NULL;
+    slab->next = NULL;
+    slab->cold = false;
+    slab->free_count = 0;
+    for (int i = SLAB_SLICES - 1; i >= 1; --i) {
+        slab->free[slab->free_count++] = i;
+    }
+    ++this->m_slabs;
+    return slab;
+}
+
+void SlicePool::unlinkSlab(Slab** list, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+void SlicePool::pushSlab(Slab** list, Slab* slab, bool front) {
+    if (front || (*list == NULL)) {
+        slab->prev = NULL;
+        slab->next = *list;
+        if (*list) {
+            (*list)->prev = slab;
+        }
+        *list = slab;
+        return;
+    }
+
+    Slab* tail = *list;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    tail->next = slab;
+    slab->prev = tail;
+    slab->next = NULL;
+}
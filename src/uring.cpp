@@ -0,0 +1,298 @@
+#include "../include/uring.h"
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+static int sysSetup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sysRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+Uring::Uring() :
+    m_ring_fd(-1), m_sq_ptr(MAP_FAILED), m_sq_size(0), m_sq_head(NULL), m_sq_tail(NULL), m_sq_mask(0), m_sq_entries(0),
+    m_sq_array(NULL), m_sqes((struct io_uring_sqe*)MAP_FAILED), m_sqes_size(0), m_sqe_tail(0), m_to_submit(0),
+    m_cq_ptr(MAP_FAILED), m_cq_size(0), m_cq_head(NULL), m_cq_tail(NULL), m_cq_mask(0), m_cqes(NULL),
+    m_buf_ring((struct io_uring_buf_ring*)MAP_FAILED), m_buf_ring_size(0), m_buffers((char*)MAP_FAILED),
+    m_buffer_count(0), m_buffer_size(0) {
+
+}
+
+Uring::~Uring() {
+    this->destroy();
+}
+
+void Uring::destroy() {
+    if (this->m_buffers != MAP_FAILED) {
+        munmap(this->m_buffers, (size_t)this->m_buffer_count * this->m_buffer_size);
+        this->m_buffers = (char*)MAP_FAILED;
+    }
+    if (this->m_buf_ring != MAP_FAILED) {
+        munmap(this->m_buf_ring, this->m_buf_ring_size);
+        this->m_buf_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+    }
+    if (this->m_sqes != MAP_FAILED) {
+        munmap(this->m_sqes, this->m_sqes_size);
+        this->m_sqes = (struct io_uring_sqe*)MAP_FAILED;
+    }
+    if ((this->m_cq_ptr != MAP_FAILED) && (this->m_cq_ptr != this->m_sq_ptr)) {
+        munmap(this->m_cq_ptr, this->m_cq_size);
+    }
+    this->m_cq_ptr = MAP_FAILED;
+    if (this->m_sq_ptr != MAP_FAILED) {
+        munmap(this->m_sq_ptr, this->m_sq_size);
+        this->m_sq_ptr = MAP_FAILED;
+    }
+    if (this->m_ring_fd != -1) {
+        close(this->m_ring_fd);
+        this->m_ring_fd = -1;
+    }
+}
+
+bool Uring::supported() {
+    // 多路 recv 从 6.0 开始支持，无法通过 probe 检测，只能看内核版本
+    struct utsname name;
+    if ((uname(&name) < 0) || (atoi(name.release) < 6)) {
+        return false;
+    }
+
+    Uring ring;
+    if (!ring.init(8) || !ring.setupBuffers(8, 64)) {
+        return false;
+    }
+
+    // 检查用到的操作码
+    size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, probe_size);
+    if (probe == NULL) {
+        return false;
+    }
+    bool ok = (sysRegister(ring.m_ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0);
+    const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SPLICE, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL };
+    for (size_t i = 0; ok && (i < sizeof(ops) / sizeof(ops[0])); ++i) {
+        ok = (ops[i] <= probe->last_op) && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+bool Uring::init(unsigned entries) {
+    // 完成队列比提交队列大，多路 recv 和 accept 一次提交会产生多个完成事件
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    this->m_ring_fd = sysSetup(entries, &params);
+    if ((this->m_ring_fd < 0) && (errno == EINVAL)) {
+        // 6.1 之前的内核不支持 DEFER_TASKRUN
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+        params.cq_entries = entries * 4;
+        this->m_ring_fd = sysSetup(entries, &params);
+    }
+    if (this->m_ring_fd < 0) {
+        this->m_ring_fd = -1;
+        return false;
+    }
+
+    // 映射提交队列和完成队列
+    this->m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && (this->m_cq_size > this->m_sq_size)) {
+        this->m_sq_size = this->m_cq_size;
+    }
+    this->m_sq_ptr = mmap(NULL, this->m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->m_ring_fd, IORING_OFF_SQ_RING);
+    if (this->m_sq_ptr == MAP_FAILED) {
+        this->destroy();
+        return false;
+    }
+    if (single_mmap) {
+        this->m_cq_ptr = this->m_sq_ptr;
+    }
+    else {
+        this->m_cq_ptr = mmap(NULL, this->m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->m_ring_fd, IORING_OFF_CQ_RING);
+        if (this->m_cq_ptr == MAP_FAILED) {
+            this->destroy();
+            return false;
+        }
+    }
+    this->m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->m_sqes = (struct io_uring_sqe*)mmap(NULL, this->m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->m_ring_fd, IORING_OFF_SQES);
+    if (this->m_sqes == MAP_FAILED) {
+        this->destroy();
+        return false;
+    }
+
+    char* sq = (char*)this->m_sq_ptr;
+    this->m_sq_head = (unsigned*)(sq + params.sq_off.head);
+    this->m_sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    this->m_sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    this->m_sq_entries = *(unsigned*)(sq + params.sq_off.ring_entries);
+    this->m_sq_array = (unsigned*)(sq + params.sq_off.array);
+    this->m_sqe_tail = *this->m_sq_tail;
+
+    char* cq = (char*)this->m_cq_ptr;
+    this->m_cq_head = (unsigned*)(cq + params.cq_off.head);
+    this->m_cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    this->m_cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    this->m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool Uring::setupBuffers(unsigned count, unsigned size) {
+    this->m_buf_ring_size = count * sizeof(struct io_uring_buf);
+    this->m_buf_ring = (struct io_uring_buf_ring*)mmap(NULL, this->m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (this->m_buf_ring == MAP_FAILED) {
+        return false;
+    }
+    this->m_buffers = (char*)mmap(NULL, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (this->m_buffers == MAP_FAILED) {
+        return false;
+    }
+    this->m_buffer_count = count;
+    this->m_buffer_size = size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)this->m_buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = BUFFER_GROUP;
+    if (sysRegister(this->m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return false;
+    }
+
+    // 所有缓冲区放入环中
+    for (unsigned bid = 0; bid < count; ++bid) {
+        struct io_uring_buf* buf = this->ringEntry(bid);
+        buf->addr = (uint64_t)(uintptr_t)this->buffer(bid);
+        buf->len = size;
+        buf->bid = (uint16_t)bid;
+    }
+    __atomic_store_n(&this->m_buf_ring->tail, (uint16_t)count, __ATOMIC_RELEASE);
+    return true;
+}
+
+void Uring::recycleBuffer(unsigned bid) {
+    // 只有当前线程往环中放入缓冲区，尾部不需要原子读取
+    uint16_t tail = this->m_buf_ring->tail;
+    struct io_uring_buf* buf = this->ringEntry(tail & (this->m_buffer_count - 1));
+    buf->addr = (uint64_t)(uintptr_t)this->buffer(bid);
+    buf->len = this->m_buffer_size;
+    buf->bid = (uint16_t)bid;
+    __atomic_store_n(&this->m_buf_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* Uring::getSqe() {
+    unsigned head = __atomic_load_n(this->m_sq_head, __ATOMIC_ACQUIRE);
+    if (this->m_sqe_tail - head >= this->m_sq_entries) {
+        // 提交队列满，先把准备好的项交给内核
+        this->submitAndWait(0);
+        head = __atomic_load_n(this->m_sq_head, __ATOMIC_ACQUIRE);
+        if (this->m_sqe_tail - head >= this->m_sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned index = this->m_sqe_tail & this->m_sq_mask;
+    struct io_uring_sqe* sqe = &this->m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    this->m_sq_array[index] = index;
+    ++this->m_sqe_tail;
+    ++this->m_to_submit;
+    return sqe;
+}
+
+void Uring::reserve(unsigned count) {
+    unsigned head = __atomic_load_n(this->m_sq_head, __ATOMIC_ACQUIRE);
+    if (this->m_sqe_tail - head + count > this->m_sq_entries) {
+        this->submitAndWait(0);
+    }
+}
+
+int Uring::submitAndWait(unsigned wait_nr) {
+    __atomic_store_n(this->m_sq_tail, this->m_sqe_tail, __ATOMIC_RELEASE);
+
+    // DEFER_TASKRUN 模式下只有带 GETEVENTS 的 io_uring_enter() 才会产生完成事件，所以总是带上它
+    int ret = sysEnter(this->m_ring_fd, this->m_to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+    if (ret < 0) {
+        return -errno;
+    }
+    this->m_to_submit -= ((unsigned)ret < this->m_to_submit) ? (unsigned)ret : this->m_to_submit;
+    return ret;
+}
+
+struct io_uring_cqe* Uring::peekCqe() {
+    unsigned head = *this->m_cq_head;
+    if (head == __atomic_load_n(this->m_cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &this->m_cqes[head & this->m_cq_mask];
+}
+
+void Uring::seen() {
+    __atomic_store_n(this->m_cq_head, *this->m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void Uring::prepAcceptMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void Uring::prepRecvMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = user_data;
+}
+
+void Uring::prepPollMultishot(struct io_uring_sqe* sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+}
+
+void Uring::prepSendMsg(struct io_uring_sqe* sqe, int fd, const struct msghdr* msg, unsigned flags, uint64_t user_data) {
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+    sqe->user_data = user_data;
+}
+
+void Uring::prepCancel(struct io_uring_sqe* sqe, uint64_t target, uint64_t user_data) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+void Uring::prepSplice(struct io_uring_sqe* sqe, int fd_in, int64_t off_in, int fd_out, unsigned len, uint64_t user_data) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = fd_out;
+    sqe->off = (uint64_t)-1;            // 输出端总是 socket 或者管道，没有偏移
+    sqe->splice_off_in = (uint64_t)off_in;
+    sqe->splice_fd_in = fd_in;
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
@@ -0,0 +1,105 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    HdrHistogram 风格的延迟直方图（单位纳秒），记录和合并都是 O(1)，内存大小固定
+    - 小于 2 * SUB_BUCKETS 的值每个值一个桶，之后每个 2 的幂区间再分成 SUB_BUCKETS 个等宽的桶，
+      相对误差不超过 1 / SUB_BUCKETS（约 0.8%），覆盖 0 到 2^63 纳秒
+    - 分位数返回桶中最大的等价值（和 HdrHistogram 的 highestEquivalentValue 一致），最大值和平均值是精确的
+*/
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS) * SUB_BUCKETS;
+
+    LatencyHistogram() { this->reset(); }
+
+    void reset() {
+        memset(this->m_counts, 0, sizeof(this->m_counts));
+        this->m_total = 0;
+        this->m_sum = 0;
+        this->m_max = 0;
+    }
+
+    void record(int64_t value) {
+        if (value < 0) {
+            value = 0;
+        }
+        ++this->m_counts[index(value)];
+        ++this->m_total;
+        this->m_sum += value;
+        if (value > this->m_max) {
+            this->m_max = value;
+        }
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS; ++i) {
+            this->m_counts[i] += other.m_counts[i];
+        }
+        this->m_total += other.m_total;
+        this->m_sum += other.m_sum;
+        if (other.m_max > this->m_max) {
+            this->m_max = other.m_max;
+        }
+    }
+
+    // 分位数 q（0 到 1），没有记录时返回 0
+    int64_t percentile(double q) const {
+        if (this->m_total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(q * this->m_total + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += this->m_counts[i];
+            if (seen >= rank) {
+                int64_t high = highest(i);
+                return (high < this->m_max) ? high : this->m_max;
+            }
+        }
+        return this->m_max;
+    }
+
+    uint64_t count() const { return this->m_total; }
+    int64_t max() const { return this->m_max; }
+    double mean() const { return this->m_total ? (double)this->m_sum / this->m_total : 0; }
+
+private:
+    uint64_t m_counts[BUCKETS];
+    uint64_t m_total;
+    int64_t m_sum;
+    int64_t m_max;
+
+    /*
+        值 v 的最高位为 msb，v < 2 * SUB_BUCKETS 时下标就是 v；
+        否则 shift = msb - SUB_BITS，v >> shift 落在 [SUB_BUCKETS, 2 * SUB_BUCKETS) 中，下标为 shift * SUB_BUCKETS + (v >> shift)
+    */
+    static int index(int64_t value) {
+        if (value < 2 * SUB_BUCKETS) {
+            return (int)value;
+        }
+        int msb = 63 - __builtin_clzll((uint64_t)value);
+        int shift = msb - SUB_BITS;
+        return shift * SUB_BUCKETS + (int)(value >> shift);
+    }
+
+    // 下标为 i 的桶中最大的值
+    static int64_t highest(int i) {
+        if (i < 2 * SUB_BUCKETS) {
+            return i;
+        }
+        int shift = i / SUB_BUCKETS - 1;
+        int64_t sub = i - shift * SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+#endif
@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+/*
+    HTTP/1.1 压力测试工具，取代每个客户端 fork 一个进程、只会发送 HTTP/1.0 请求的 webbench
+    - 多线程，每个线程用自己的 epoll 对象驱动一部分连接，连接默认保持（keep-alive），每个连接可以有多个流水线请求
+    - 闭环模式（默认）：每个连接始终保持 depth 个未完成的请求，测量服务器能达到的最大吞吐量
+    - 开环模式（-R）：按照固定的总速率安排请求，每个请求有一个预定的发送时间，连接上的请求数已满时请求排队等待，
+      延迟从预定时间而不是实际发送时间开始计算（修正协调遗漏，coordinated omission），服务器的停顿会完整地反映在尾延迟中
+    - 结束时以 JSON 输出吞吐量和 p50 / p90 / p99 / p99.9 / 最大延迟
+*/
+
+static const int MAX_DEPTH = 64;                // 每个连接最多的流水线请求数量
+static const int READ_BUFFER_SIZE = 64 * 1024;  // 每个连接的接收缓冲区，响应体直接丢弃，只需要容纳响应头
+static const long long RECONNECT_DELAY_NS = 100 * 1000000LL;    // 连接失败之后重新连接的间隔
+
+static inline long long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 测试配置，由命令行参数解析得到
+struct LoadConfig {
+    std::string host;
+    int port;
+    std::string path;
+    int threads;
+    int connections;
+    int duration;           // 秒
+    int depth;              // 每个连接的流水线深度
+    double rate;            // 开环模式的总请求速率（每秒），0 表示闭环模式
+    bool keep_alive;
+    struct sockaddr_in addr;
+    std::string request;    // 预先生成的请求
+};
+
+// 一个线程的统计结果
+struct LoadStats {
+    long long requests;     // 发送的请求数量
+    long long responses;    // 收到的完整响应数量
+    long long bytes;        // 收到的字节数
+    long long connect_errors;
+    long long read_errors;  // 连接在还有未完成的请求时出错或者被关闭
+    long long status_errors;    // 状态码不是 2xx 或 3xx 的响应
+    long long parse_errors; // 无法解析的响应
+    long long backlog;      // 开环模式下结束时还在排队没有发送的请求数量
+    LatencyHistogram latency;       // 从预定时间开始的延迟（闭环模式下和实际发送时间相同）
+    LatencyHistogram uncorrected;   // 从实际发送时间开始的延迟
+
+    LoadStats() : requests(0), responses(0), bytes(0), connect_errors(0), read_errors(0),
+        status_errors(0), parse_errors(0), backlog(0) {}
+
+    void merge(const LoadStats& other) {
+        this->requests += other.requests;
+        this->responses += other.responses;
+        this->bytes += other.bytes;
+        this->connect_errors += other.connect_errors;
+        this->read_errors += other.read_errors;
+        this->status_errors += other.status_errors;
+        this->parse_errors += other.parse_errors;
+        this->backlog += other.backlog;
+        this->latency.merge(other.latency);
+        this->uncorrected.merge(other.uncorrected);
+    }
+};
+
+// 客户端连接
+struct Connection {
+    int fd;
+    bool connected;
+    long long reconnect_at;         // 连接断开后下一次重新连接的时间，0 表示立即
+
+    std::string out;                // 还没有写入 socket 的请求数据
+    size_t out_offset;
+
+    // 未完成请求的先进先出队列：预定时间和实际发送时间
+    long long intended[MAX_DEPTH];
+    long long sent[MAX_DEPTH];
+    int head;
+    int inflight;
+
+    // 开环模式：下一个请求的预定时间，以及已经到期但因为流水线已满还没有发送的请求的预定时间
+    long long next_due;
+    std::deque<long long> backlog;
+
+    // 响应解析状态
+    char in[READ_BUFFER_SIZE];
+    int in_len;
+    bool in_body;                   // 响应头已经解析完毕，正在跳过响应体
+    long long body_left;
+    int status;
+    bool close_after;               // 响应要求关闭连接
+
+    Connection() : fd(-1), connected(false), reconnect_at(0), out_offset(0), head(0), inflight(0), next_due(0),
+        in_len(0), in_body(false), body_left(0), status(0), close_after(false) {}
+};
+
+// 压测线程，拥有自己的 epoll 对象和一部分连接
+class Worker {
+public:
+    Worker(const LoadConfig* config, int connections, double rate) :
+        m_config(config), m_conns(connections), m_rate(rate), m_epoll_fd(-1), m_timer_fd(-1), m_thread(0) {}
+
+    bool start() { return pthread_create(&this->m_thread, NULL, entry, this) == 0; }
+    void join() { pthread_join(this->m_thread, NULL); }
+    const LoadStats& stats() const { return this->m_stats; }
+
+private:
+    const LoadConfig* m_config;
+    std::vector<Connection> m_conns;
+    double m_rate;                  // 当前线程负责的请求速率，0 表示闭环模式
+    long long m_interval;           // 开环模式下每个连接相邻两个请求的预定间隔
+    int m_epoll_fd;
+    int m_timer_fd;                 // 开环模式下设置为最早的预定时间
+    long long m_timer_armed;
+    long long m_start;
+    long long m_end;
+    pthread_t m_thread;
+    LoadStats m_stats;
+
+    static void* entry(void* arg) {
+        ((Worker*)arg)->run();
+        return NULL;
+    }
+
+    void run();
+    void connect(Connection* conn, long long now);
+    void disconnect(Connection* conn, long long now, bool error);
+    void schedule(Connection* conn, long long now);
+    void enqueue(Connection* conn, long long intended, long long now);
+    bool flush(Connection* conn);
+    bool readResponses(Connection* conn);
+    int parseHeaders(Connection* conn);
+    void complete(Connection* conn, long long now);
+    void updateEvents(Connection* conn);
+    void armTimer(long long now);
+};
+
+void Worker::run() {
+    this->m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    this->m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    this->m_timer_armed = -1;
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(this->m_epoll_fd, EPOLL_CTL_ADD, this->m_timer_fd, &event);
+
+    this->m_start = nowNs();
+    this->m_end = this->m_start + this->m_config->duration * 1000000000LL;
+
+    // 开环模式下每个连接分担相同的速率，第一个请求的预定时间在一个间隔内错开，避免所有连接同时发送
+    int count = (int)this->m_conns.size();
+    this->m_interval = (this->m_rate > 0) ? (long long)(count * 1e9 / this->m_rate) : 0;
+    for (int i = 0; i < count; ++i) {
+        Connection* conn = &this->m_conns[i];
+        conn->next_due = this->m_start + (this->m_interval * i) / count;
+        this->connect(conn, this->m_start);
+    }
+
+    epoll_event events[256];
+    while (true) {
+        long long now = nowNs();
+        if (now >= this->m_end) {
+            break;
+        }
+
+        // 安排到期的请求，重新连接断开的连接
+        for (int i = 0; i < count; ++i) {
+            Connection* conn = &this->m_conns[i];
+            if (!conn->connected && (conn->fd == -1) && (now >= conn->reconnect_at)) {
+                this->connect(conn, now);
+            }
+            this->schedule(conn, now);
+        }
+        this->armTimer(now);
+
+        // 闭环模式只需要定期检查结束时间，开环模式由 timerfd 在下一个预定时间唤醒
+        long long wait_ms = (this->m_end - now) / 1000000 + 1;
+        int num = epoll_wait(this->m_epoll_fd, events, 256, (int)((wait_ms < 100) ? wait_ms : 100));
+        now = nowNs();
+        for (int i = 0; i < num; ++i) {
+            Connection* conn = (Connection*)events[i].data.ptr;
+            if (conn == NULL) {
+                uint64_t expirations;
+                ssize_t ret = read(this->m_timer_fd, &expirations, sizeof(expirations));
+                (void)ret;
+                this->m_timer_armed = -1;
+                continue;
+            }
+            if (conn->fd == -1) {
+                continue;   // 同一批事件中已经断开
+            }
+
+            if (!conn->connected) {
+                // 非阻塞 connect() 完成
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                if (error != 0) {
+                    ++this->m_stats.connect_errors;
+                    this->disconnect(conn, now, false);
+                    conn->reconnect_at = now + RECONNECT_DELAY_NS;
+                    continue;
+                }
+                conn->connected = true;
+                this->schedule(conn, now);
+            }
+
+            if ((events[i].events & EPOLLIN) && !this->readResponses(conn)) {
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                this->disconnect(conn, now, true);
+                continue;
+            }
+            if (!this->flush(conn)) {
+                this->disconnect(conn, now, true);
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        this->m_stats.backlog += this->m_conns[i].backlog.size();
+        if (this->m_conns[i].fd != -1) {
+            close(this->m_conns[i].fd);
+        }
+    }
+    close(this->m_timer_fd);
+    close(this->m_epoll_fd);
+}
+
+void Worker::connect(Connection* conn, long long now) {
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd == -1) {
+        ++this->m_stats.connect_errors;
+        conn->reconnect_at = now + RECONNECT_DELAY_NS;
+        return;
+    }
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn->connected = false;
+    conn->out.clear();
+    conn->out_offset = 0;
+    conn->head = 0;
+    conn->inflight = 0;
+    conn->in_len = 0;
+    conn->in_body = false;
+
+    int ret = ::connect(conn->fd, (const struct sockaddr*)&this->m_config->addr, sizeof(this->m_config->addr));
+    if ((ret < 0) && (errno != EINPROGRESS)) {
+        ++this->m_stats.connect_errors;
+        close(conn->fd);
+        conn->fd = -1;
+        conn->reconnect_at = now + RECONNECT_DELAY_NS;
+        return;
+    }
+
+    // 连接完成之前等待可写事件
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = conn;
+    epoll_ctl(this->m_epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+}
+
+// 关闭连接，error 表示还有未完成的请求时计为读错误；开环模式下排队的请求保留，重新连接后继续发送
+void Worker::disconnect(Connection* conn, long long now, bool error) {
+    if (error && (conn->inflight > 0)) {
+        this->m_stats.read_errors += conn->inflight;
+    }
+    epoll_ctl(this->m_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->connected = false;
+    conn->inflight = 0;
+    conn->reconnect_at = now;
+}
+
+/*
+    安排连接上的请求
+    - 闭环模式：补足 depth 个未完成的请求
+    - 开环模式：所有到期的预定时间进入排队队列，流水线有空位时按照顺序发送，预定时间保持不变
+*/
+void Worker::schedule(Connection* conn, long long now) {
+    if (this->m_rate > 0) {
+        while (conn->next_due <= now) {
+            conn->backlog.push_back(conn->next_due);
+            conn->next_due += this->m_interval;
+        }
+    }
+    if (!conn->connected) {
+        return;
+    }
+
+    int depth = this->m_config->keep_alive ? this->m_config->depth : 1;
+    bool queued = false;
+    while (conn->inflight < depth) {
+        long long intended = now;
+        if (this->m_rate > 0) {
+            if (conn->backlog.empty()) {
+                break;
+            }
+            intended = conn->backlog.front();
+            conn->backlog.pop_front();
+        }
+        this->enqueue(conn, intended, now);
+        queued = true;
+    }
+    if (queued && !this->flush(conn)) {
+        this->disconnect(conn, now, true);
+    }
+}
+
+void Worker::enqueue(Connection* conn, long long intended, long long now) {
+    int slot = (conn->head + conn->inflight) % MAX_DEPTH;
+    conn->intended[slot] = intended;
+    conn->sent[slot] = now;
+    ++conn->inflight;
+    ++this->m_stats.requests;
+    conn->out.append(this->m_config->request);
+}
+
+// 尽量写出排队的请求数据，写不完时注册可写事件，出错时返回 false
+bool Worker::flush(Connection* conn) {
+    while (conn->out_offset < conn->out.size()) {
+        ssize_t n = send(conn->fd, conn->out.data() + conn->out_offset, conn->out.size() - conn->out_offset, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            return false;
+        }
+        conn->out_offset += n;
+    }
+    if (conn->out_offset == conn->out.size()) {
+        conn->out.clear();
+        conn->out_offset = 0;
+    }
+    this->updateEvents(conn);
+    return true;
+}
+
+void Worker::updateEvents(Connection* conn) {
+    epoll_event event;
+    uint32_t events = EPOLLIN;
+    if (!conn->out.empty()) {
+        events |= EPOLLOUT;
+    }
+    event.events = events;
+    event.data.ptr = conn;
+    epoll_ctl(this->m_epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+/*
+    读取并解析响应，响应体不保存，只根据 Content-Length 跳过
+    连接被关闭或者出错时断开连接并返回 false
+*/
+bool Worker::readResponses(Connection* conn) {
+    while (true) {
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, READ_BUFFER_SIZE - conn->in_len, 0);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                return true;
+            }
+            this->disconnect(conn, nowNs(), true);
+            return false;
+        }
+        if (n == 0) {
+            this->disconnect(conn, nowNs(), true);
+            return false;
+        }
+        this->m_stats.bytes += n;
+        conn->in_len += n;
+
+        int pos = 0;
+        while (true) {
+            if (conn->in_body) {
+                // 响应体可能为空，此时响应头之后没有数据也要完成该响应
+                long long take = conn->in_len - pos;
+                if (take > conn->body_left) {
+                    take = conn->body_left;
+                }
+                conn->body_left -= take;
+                pos += take;
+                if (conn->body_left > 0) {
+                    break;
+                }
+                conn->in_body = false;
+                long long now = nowNs();
+                this->complete(conn, now);
+                if (conn->close_after) {
+                    // 不保持连接，重新连接之后继续发送
+                    this->disconnect(conn, now, true);
+                    return false;
+                }
+                this->schedule(conn, now);
+                if (conn->fd == -1) {
+                    return false;
+                }
+                continue;
+            }
+
+            if (pos >= conn->in_len) {
+                break;
+            }
+
+            // 移动剩余的数据到缓冲区开头，解析响应头
+            if (pos > 0) {
+                memmove(conn->in, conn->in + pos, conn->in_len - pos);
+                conn->in_len -= pos;
+                pos = 0;
+            }
+            int header_len = this->parseHeaders(conn);
+            if (header_len == 0) {
+                break;      // 响应头不完整
+            }
+            if (header_len < 0) {
+                ++this->m_stats.parse_errors;
+                this->disconnect(conn, nowNs(), true);
+                return false;
+            }
+            pos = header_len;
+            conn->in_body = true;
+            if (conn->inflight == 0) {
+                // 服务器发送了没有对应请求的响应
+                ++this->m_stats.parse_errors;
+                this->disconnect(conn, nowNs(), false);
+                return false;
+            }
+        }
+
+        // 缓冲区中只剩响应体的一部分时丢弃它，剩余的是不完整的响应头时保留
+        if (pos >= conn->in_len) {
+            conn->in_len = 0;
+        }
+        else if (pos > 0) {
+            memmove(conn->in, conn->in + pos, conn->in_len - pos);
+            conn->in_len -= pos;
+        }
+        if (conn->in_len == READ_BUFFER_SIZE) {
+            // 响应头超过了接收缓冲区
+            ++this->m_stats.parse_errors;
+            this->disconnect(conn, nowNs(), true);
+            return false;
+        }
+    }
+}
+
+// 不区分大小写地比较响应头名称
+static bool headerIs(const char* line, const char* end, const char* name) {
+    size_t len = strlen(name);
+    return ((size_t)(end - line) > len) && (strncasecmp(line, name, len) == 0) && (line[len] == ':');
+}
+
+/*
+    解析缓冲区开头的响应头，返回响应头的长度（包括空行），不完整时返回 0，格式错误时返回 -1
+    只关心状态码、Content-Length 和 Connection: close
+*/
+int Worker::parseHeaders(Connection* conn) {
+    const char* begin = conn->in;
+    const char* end = (const char*)memmem(begin, conn->in_len, "\r\n\r\n", 4);
+    if (end == NULL) {
+        return 0;
+    }
+    if ((end - begin < 12) || (strncmp(begin, "HTTP/1.", 7) != 0)) {
+        return -1;
+    }
+    conn->status = atoi(begin + 9);
+    conn->body_left = 0;
+    conn->close_after = !this->m_config->keep_alive || (begin[7] == '0');
+
+    const char* line = (const char*)memchr(begin, '\n', end - begin) + 1;
+    while (line < end) {
+        const char* eol = (const char*)memchr(line, '\r', end - line + 1);
+        if (headerIs(line, eol, "Content-Length")) {
+            conn->body_left = atoll(line + 15);
+        }
+        else if (headerIs(line, eol, "Connection")) {
+            const char* value = line + 11;
+            while (*value == ' ') {
+                ++value;
+            }
+            if (strncasecmp(value, "close", 5) == 0) {
+                conn->close_after = true;
+            }
+        }
+        line = eol + 2;
+    }
+
+    // 304 和 HEAD 一样没有响应体
+    if ((conn->status == 304) || (conn->status == 204)) {
+        conn->body_left = 0;
+    }
+    return (int)(end + 4 - begin);
+}
+
+// 一个响应接收完毕，记录先进先出队列头部请求的延迟
+void Worker::complete(Connection* conn, long long now) {
+    int slot = conn->head;
+    conn->head = (conn->head + 1) % MAX_DEPTH;
+    --conn->inflight;
+    ++this->m_stats.responses;
+    if ((conn->status < 200) || (conn->status >= 400)) {
+        ++this->m_stats.status_errors;
+    }
+    this->m_stats.latency.record(now - conn->intended[slot]);
+    this->m_stats.uncorrected.record(now - conn->sent[slot]);
+}
+
+// 开环模式下把 timerfd 设置为最早的预定时间
+void Worker::armTimer(long long now) {
+    if (this->m_rate <= 0) {
+        return;
+    }
+    long long next = -1;
+    for (size_t i = 0; i < this->m_conns.size(); ++i) {
+        Connection* conn = &this->m_conns[i];
+        // 流水线已满的连接要等响应到达才能发送，不需要定时唤醒
+        int depth = this->m_config->keep_alive ? this->m_config->depth : 1;
+        if (conn->connected && (conn->inflight >= depth)) {
+            continue;
+        }
+        if ((next == -1) || (conn->next_due < next)) {
+            next = conn->next_due;
+        }
+    }
+    if ((next == -1) || (next == this->m_timer_armed)) {
+        return;
+    }
+    if (next <= now) {
+        next = now + 1;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000000000LL;
+    its.it_value.tv_nsec = next % 1000000000LL;
+    timerfd_settime(this->m_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    this->m_timer_armed = next;
+}
+
+// 解析 http://host:port/path
+static bool parseUrl(const char* url, LoadConfig* config) {
+    const char* prefix = "http://";
+    if (strncmp(url, prefix, strlen(prefix)) != 0) {
+        return false;
+    }
+    std::string rest = url + strlen(prefix);
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+    config->path = (slash == std::string::npos) ? "/" : rest.substr(slash);
+    size_t colon = authority.find(':');
+    config->host = authority.substr(0, colon);
+    config->port = (colon == std::string::npos) ? 80 : atoi(authority.c_str() + colon + 1);
+    if (config->host.empty() || (config->port <= 0)) {
+        return false;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(config->host.c_str(), NULL, &hints, &result) != 0) {
+        return false;
+    }
+    config->addr = *(struct sockaddr_in*)result->ai_addr;
+    config->addr.sin_port = htons(config->port);
+    freeaddrinfo(result);
+    return true;
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [options] http://host:port/path\n", name);
+    printf("  -t <threads>  worker threads, each with its own epoll loop (default 2)\n");
+    printf("  -c <count>    connections, spread across threads (default 64)\n");
+    printf("  -d <seconds>  test duration (default 10)\n");
+    printf("  -p <depth>    pipelined requests per connection, 1-%d (default 1)\n", MAX_DEPTH);
+    printf("  -R <rate>     open-loop mode: total requests per second, latency measured from the intended send time\n");
+    printf("  -C            send Connection: close and reconnect after every response\n");
+}
+
+static void printLatency(const char* name, const LatencyHistogram& hist, bool last) {
+    printf("  \"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f, \"mean\": %.1f}%s\n",
+        name, hist.percentile(0.5) / 1e3, hist.percentile(0.9) / 1e3, hist.percentile(0.99) / 1e3,
+        hist.percentile(0.999) / 1e3, hist.max() / 1e3, hist.mean() / 1e3, last ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+    config.threads = 2;
+    config.connections = 64;
+    config.duration = 10;
+    config.depth = 1;
+    config.rate = 0;
+    config.keep_alive = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:p:R:C")) != -1) {
+        switch (opt) {
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 'd':
+            config.duration = atoi(optarg);
+            break;
+        case 'p':
+            config.depth = atoi(optarg);
+            break;
+        case 'R':
+            config.rate = atof(optarg);
+            break;
+        case 'C':
+            config.keep_alive = false;
+            break;
+        default:
+            usage(basename(argv[0]));
+            return 1;
+        }
+    }
+    if ((optind >= argc) || !parseUrl(argv[optind], &config) || (config.threads <= 0) || (config.connections <= 0) ||
+        (config.duration <= 0) || (config.depth <= 0) || (config.depth > MAX_DEPTH) || (config.rate < 0)) {
+        usage(basename(argv[0]));
+        return 1;
+    }
+    if (config.threads > config.connections) {
+        config.threads = config.connections;
+    }
+
+    config.request = "GET " + config.path + " HTTP/1.1\r\nHost: " + config.host + "\r\n";
+    config.request += config.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // 连接和速率按照连接数量分配给线程
+    std::vector<Worker*> workers;
+    for (int i = 0; i < config.threads; ++i) {
+        int conns = config.connections / config.threads + ((i < config.connections % config.threads) ? 1 : 0);
+        double rate = config.rate * conns / config.connections;
+        workers.push_back(new Worker(&config, conns, rate));
+    }
+    long long start = nowNs();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        if (!workers[i]->start()) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    LoadStats total;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->join();
+        total.merge(workers[i]->stats());
+        delete workers[i];
+    }
+    double elapsed = (nowNs() - start) / 1e9;
+
+    // 结果以 JSON 输出到标准输出，延迟单位为微秒
+    printf("{\n");
+    printf("  \"url\": \"http://%s:%d%s\",\n", config.host.c_str(), config.port, config.path.c_str());
+    printf("  \"mode\": \"%s\",\n", (config.rate > 0) ? "open" : "closed");
+    printf("  \"threads\": %d,\n", config.threads);
+    printf("  \"connections\": %d,\n", config.connections);
+    printf("  \"pipeline\": %d,\n", config.keep_alive ? config.depth : 1);
+    printf("  \"keep_alive\": %s,\n", config.keep_alive ? "true" : "false");
+    printf("  \"target_rate\": %.1f,\n", config.rate);
+    printf("  \"duration_s\": %.3f,\n", elapsed);
+    printf("  \"requests\": %lld,\n", total.requests);
+    printf("  \"responses\": %lld,\n", total.responses);
+    printf("  \"backlog\": %lld,\n", total.backlog);
+    printf("  \"errors\": {\"connect\": %lld, \"read\": %lld, \"status\": %lld, \"parse\": %lld},\n",
+        total.connect_errors, total.read_errors, total.status_errors, total.parse_errors);
+    printf("  \"throughput_rps\": %.1f,\n", total.responses / elapsed);
+    printf("  \"throughput_mbps\": %.2f,\n", total.bytes * 8 / elapsed / 1e6);
+    printLatency("latency_us", total.latency, false);
+    printLatency("latency_uncorrected_us", total.uncorrected, true);
+    printf("}\n");
+    return 0;
+}